@@ -0,0 +1,447 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aho_corasick.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_X86_AC
+#include <immintrin.h>
+#endif
+
+/* A state as the scan holds it: the offset of its row if it is dense, else
+   the complement of its number */
+#define AC_ENCODE(ac, s) ((s) < (ac)->ndense ? (s) * (ac)->rowlen : ~(s))
+
+/* The trie while it is built: each state's edges form a list */
+struct ac_trie {
+    int            *first;  /* first edge of each state, or -1          */
+    int            *next;   /* next edge of the same state, or -1       */
+    unsigned short *cls;    /* class of each edge                       */
+    int            *to;     /* target of each edge                      */
+    int             nstates;
+};
+
+static int trie_child(const struct ac_trie *t, int s, int c)
+{
+    int e;
+
+    for (e = t->first[s]; e >= 0; e = t->next[e])
+        if (t->cls[e] == c)
+            return t->to[e];
+    return -1;
+}
+
+/* Edges are numbered by their target, which has exactly one incoming edge */
+static int trie_add(struct ac_trie *t, int s, int c)
+{
+    int v = t->nstates++;
+
+    t->first[v] = -1;
+    t->cls[v]   = (unsigned short) c;
+    t->to[v]    = v;
+    t->next[v]  = t->first[s];
+    t->first[s] = v;
+    return v;
+}
+
+/******************************************************************************/
+int ac_build(struct ac_automaton *ac, const char *const *pats, const long *lens, int npats,
+             long dense_bytes)
+{
+    struct ac_trie t;
+    unsigned char used[256] = {0};
+    int  *end_state = NULL, *order = NULL, *new_id = NULL, *old_fail = NULL;
+    int  *edges = NULL;
+    long  cap = 1, i, k;
+    int  *row;
+    int   s, v, u, f, c, e, head, tail, nedges, ret = -1;
+
+    memset(ac, 0, sizeof(*ac));
+    memset(&t, 0, sizeof(t));
+    if (npats < 1)
+        return -1;
+    for (i = 0; i < npats; i++) {
+        if (lens[i] < 1)
+            return -1;
+        cap += lens[i];
+        for (k = 0; k < lens[i]; k++)
+            used[(unsigned char) pats[i][k]] = 1;
+    }
+    if (cap > 0x7fffffff)
+        return -1;
+
+    //Byte classes: 0 for bytes in no pattern, then one per byte used
+    ac->nclasses = 1;
+    for (i = 0; i < 256; i++)
+        ac->cls[i] = used[i] ? (unsigned short) ac->nclasses++ : 0;
+
+    ac->npats = npats;
+    ac->lens  = malloc(npats * sizeof(long));
+    t.first   = malloc(cap * sizeof(int));
+    t.next    = malloc(cap * sizeof(int));
+    t.cls     = malloc(cap * sizeof(unsigned short));
+    t.to      = malloc(cap * sizeof(int));
+    end_state = malloc(npats * sizeof(int));
+    if (!ac->lens || !t.first || !t.next || !t.cls || !t.to || !end_state)
+        goto done;
+
+    //Insert the patterns
+    t.first[0] = -1;
+    t.nstates  = 1;
+    for (i = 0; i < npats; i++) {
+        s = 0;
+        for (k = 0; k < lens[i]; k++) {
+            c = ac->cls[(unsigned char) pats[i][k]];
+            v = trie_child(&t, s, c);
+            s = v >= 0 ? v : trie_add(&t, s, c);
+        }
+        end_state[i] = s;
+        ac->lens[i] = lens[i];
+        if (lens[i] > ac->maxlen)
+            ac->maxlen = lens[i];
+        if (!ac->start[(unsigned char) pats[i][0]]) {
+            ac->start[(unsigned char) pats[i][0]] = 1;
+            if (ac->nstart < 8)
+                ac->start_bytes[ac->nstart] = (unsigned char) pats[i][0];
+            ac->nstart++;
+        }
+    }
+    ac->nstates = t.nstates;
+
+    //Breadth first order and failure links. A child's failure link is the
+    // deepest proper suffix state that has an edge on the same class
+    order    = malloc(t.nstates * sizeof(int));
+    new_id   = malloc(t.nstates * sizeof(int));
+    old_fail = malloc(t.nstates * sizeof(int));
+    if (!order || !new_id || !old_fail)
+        goto done;
+    order[0] = 0;
+    old_fail[0] = 0;
+    for (head = 0, tail = 1; head < tail; head++) {
+        u = order[head];
+        new_id[u] = head;
+        for (e = t.first[u]; e >= 0; e = t.next[e]) {
+            v = t.to[e];
+            order[tail++] = v;
+            if (u == 0) {
+                old_fail[v] = 0;
+                continue;
+            }
+            for (f = old_fail[u]; f != 0 && trie_child(&t, f, t.cls[e]) < 0; f = old_fail[f])
+                ;
+            f = trie_child(&t, f, t.cls[e]);
+            old_fail[v] = f >= 0 && f != v ? f : 0;
+        }
+    }
+
+    //Dense rows for the shallowest states that fit the budget
+    if (dense_bytes <= 0)
+        dense_bytes = AC_DENSE_BYTES;
+    ac->rowlen = ac->nclasses + 1;
+    k = dense_bytes / ((long) ac->rowlen * sizeof(int));
+    ac->ndense = k < 1 ? 1 : k > t.nstates ? t.nstates : (int) k;
+    if ((long) ac->ndense * ac->rowlen > 0x7fffffff)
+        ac->ndense = 0x7fffffff / ac->rowlen;
+
+    ac->delta      = malloc((long) ac->ndense * ac->rowlen * sizeof(int));
+    ac->fail       = malloc(t.nstates * sizeof(int));
+    ac->edge_start = malloc((t.nstates - ac->ndense + 1) * sizeof(int));
+    ac->edge_cls   = malloc(t.nstates * sizeof(unsigned short));
+    ac->edge_to    = malloc(t.nstates * sizeof(int));
+    ac->out_start  = calloc(t.nstates + 1, sizeof(int));
+    ac->out_pat    = malloc(npats * sizeof(int));
+    ac->report     = malloc(t.nstates * sizeof(int));
+    edges          = malloc(ac->nclasses * sizeof(int));
+    if (!ac->delta || !ac->fail || !ac->edge_start || !ac->edge_cls || !ac->edge_to ||
+        !ac->out_start || !ac->out_pat || !ac->report || !edges)
+        goto done;
+
+    nedges = 0;
+    for (s = 0; s < t.nstates; s++) {
+        u = order[s];
+        ac->fail[s] = new_id[old_fail[u]];
+        if (s < ac->ndense) {
+            //Missing edges resolve through the failure link, whose row is
+            // already complete because it is shallower
+            row = ac->delta + (long) s * ac->rowlen;
+            for (c = 0; c < ac->nclasses; c++)
+                row[1 + c] = s == 0 ? 0 : ac->delta[(long) ac->fail[s] * ac->rowlen + 1 + c];
+            for (e = t.first[u]; e >= 0; e = t.next[e])
+                row[1 + t.cls[e]] = AC_ENCODE(ac, new_id[t.to[e]]);
+            continue;
+        }
+
+        //Sparse state: its edges, sorted by class
+        ac->edge_start[s - ac->ndense] = nedges;
+        for (k = 0, e = t.first[u]; e >= 0; e = t.next[e]) {
+            for (i = k++; i > 0 && t.cls[edges[i-1]] > t.cls[e]; i--)
+                edges[i] = edges[i-1];
+            edges[i] = e;
+        }
+        for (i = 0; i < k; i++) {
+            ac->edge_cls[nedges] = t.cls[edges[i]];
+            ac->edge_to[nedges++] = new_id[t.to[edges[i]]];
+        }
+    }
+    ac->edge_start[t.nstates - ac->ndense] = nedges;
+
+    //Patterns ending at each state, and the chain of states to report
+    for (i = 0; i < npats; i++)
+        ac->out_start[new_id[end_state[i]] + 1]++;
+    for (s = 0; s < t.nstates; s++)
+        ac->out_start[s + 1] += ac->out_start[s];
+    for (i = 0; i < npats; i++)
+        ac->out_pat[i] = -1;
+    for (i = 0; i < npats; i++) {
+        s = new_id[end_state[i]];
+        for (k = ac->out_start[s]; ac->out_pat[k] >= 0; k++)
+            ;
+        ac->out_pat[k] = (int) i;
+    }
+    for (s = 0; s < t.nstates; s++) {
+        ac->report[s] = ac->out_start[s + 1] > ac->out_start[s] ? s :
+                        s == 0 ? -1 : ac->report[ac->fail[s]];
+        if (s < ac->ndense)
+            ac->delta[(long) s * ac->rowlen] = ac->report[s];
+    }
+    ret = 0;
+
+done:
+    free(t.first);
+    free(t.next);
+    free(t.cls);
+    free(t.to);
+    free(end_state);
+    free(order);
+    free(new_id);
+    free(old_fail);
+    free(edges);
+    if (ret < 0)
+        ac_free(ac);
+    return ret;
+}
+
+/******************************************************************************/
+void ac_free(struct ac_automaton *ac)
+{
+    free(ac->lens);
+    free(ac->delta);
+    free(ac->fail);
+    free(ac->edge_start);
+    free(ac->edge_cls);
+    free(ac->edge_to);
+    free(ac->out_start);
+    free(ac->out_pat);
+    free(ac->report);
+    memset(ac, 0, sizeof(*ac));
+}
+
+/******************************************************************************/
+/* Next state, encoded, from the encoded state s on byte class c. A sparse
+   state looks for an edge on c and otherwise follows its failure link, until
+   it reaches a dense state, whose row has the answer. */
+static int sparse_step(const struct ac_automaton *ac, int s, int c)
+{
+    int lo, hi, mid, end;
+
+    for (s = ~s; s >= ac->ndense; s = ac->fail[s]) {
+        lo  = ac->edge_start[s - ac->ndense];
+        end = hi = ac->edge_start[s - ac->ndense + 1];
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (ac->edge_cls[mid] < c)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < end && ac->edge_cls[lo] == c)
+            return AC_ENCODE(ac, ac->edge_to[lo]);
+    }
+    return ac->delta[(long) s * ac->rowlen + 1 + c];
+}
+
+#define AC_NEXT(ac, s, c) ((s) >= 0 ? (ac)->delta[(s) + 1 + (c)] : sparse_step(ac, s, c))
+#define AC_REPORT(ac, s)  ((s) >= 0 ? (ac)->delta[s] : (ac)->report[~(s)])
+
+/* Matches found by one stream of the scan */
+struct ac_stream {
+    long             pos;       /* next offset to scan                   */
+    long             end;       /* offset where the scan stops           */
+    long             limit;     /* matches must start before this        */
+    int              s;         /* encoded state                         */
+    struct ac_match *m;
+    long             count, size;
+};
+
+/* Records the patterns ending at offset i, starting from report state r */
+static void emit(const struct ac_automaton *ac, struct ac_stream *st, int r, long i)
+{
+    long start;
+    int  k;
+
+    for (; r >= 0; r = ac->report[ac->fail[r]]) {
+        for (k = ac->out_start[r]; k < ac->out_start[r + 1]; k++) {
+            start = i - ac->lens[ac->out_pat[k]] + 1;
+            if (start >= st->limit)
+                continue;
+            if (st->count == st->size) {
+                st->size = st->size ? 2 * st->size : 1024;
+                st->m = realloc(st->m, st->size * sizeof(struct ac_match));
+            }
+            st->m[st->count].offset  = start;
+            st->m[st->count].pattern = ac->out_pat[k];
+            st->count++;
+        }
+    }
+}
+
+#ifdef HAVE_X86_AC
+/* Offset of the first byte at or after i that begins a pattern, comparing 32
+   bytes at a time against each of the (at most 8) start bytes */
+__attribute__((target("avx2")))
+static long skip_avx2(const struct ac_automaton *ac, const unsigned char *text, long n, long i)
+{
+    __m256i want[8], block, hit;
+    unsigned int mask;
+    int k;
+
+    for (k = 0; k < ac->nstart; k++)
+        want[k] = _mm256_set1_epi8((char) ac->start_bytes[k]);
+    for (; i + 32 <= n; i += 32) {
+        block = _mm256_loadu_si256((const __m256i *) (text + i));
+        hit = _mm256_cmpeq_epi8(block, want[0]);
+        for (k = 1; k < ac->nstart; k++)
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(block, want[k]));
+        mask = (unsigned int) _mm256_movemask_epi8(hit);
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    while (i < n && !ac->start[text[i]])
+        i++;
+    return i;
+}
+#endif
+
+/* Scans one stream to its end. skip is 0 for no prefilter, 1 for memchr
+   and 2 for the AVX2 compare. */
+static void scan_stream(const struct ac_automaton *ac, const unsigned char *t,
+                        struct ac_stream *st, int skip)
+{
+    const unsigned char *p;
+    long i;
+    int  s = st->s, r;
+
+    for (i = st->pos; i < st->end; i++) {
+        //At the root only a start byte can lead anywhere
+        if (s == 0 && skip && !ac->start[t[i]]) {
+            if (skip == 1) {
+                p = memchr(t + i, ac->start_bytes[0], st->end - i);
+                i = p ? p - t : st->end;
+            }
+#ifdef HAVE_X86_AC
+            else
+                i = skip_avx2(ac, t, st->end, i);
+#endif
+            if (i >= st->end)
+                break;
+        }
+
+        s = AC_NEXT(ac, s, ac->cls[t[i]]);
+        if ((r = AC_REPORT(ac, s)) >= 0)
+            emit(ac, st, r, i);
+    }
+    st->pos = st->end;
+    st->s = s;
+}
+
+/******************************************************************************/
+struct ac_match *ac_scan(const struct ac_automaton *ac, const char *text, long n, long limit,
+                         long *count)
+{
+    const unsigned char *t = (const unsigned char *) text;
+    struct ac_stream st[AC_STREAMS];
+    struct ac_match *matches;
+    long i, len, found;
+    int  j, nstreams = 1, skip = 0;
+    int  s0, s1, s2, s3, r;
+
+    if (limit > n)
+        limit = n;
+
+    //The prefilter pays only when start bytes are rare, so look at a sample
+    len = n < 4096 ? n : 4096;
+    for (i = found = 0; i < len; i++)
+        found += ac->start[t[i]];
+    if (found * 16 <= len) {
+        if (ac->nstart == 1)
+            skip = 1;
+#ifdef HAVE_X86_AC
+        else if (ac->nstart <= 8) {
+            __builtin_cpu_init();
+            skip = __builtin_cpu_supports("avx2") ? 2 : 0;
+        }
+#endif
+    }
+    if (!skip && limit >= AC_STREAMS * 4096)
+        nstreams = AC_STREAMS;
+
+    //Stream j takes the matches starting in its part of [0, limit) and
+    // reads up to maxlen - 1 bytes past it
+    memset(st, 0, sizeof(st));
+    for (j = 0; j < nstreams; j++) {
+        st[j].pos   = limit / nstreams * j;
+        st[j].limit = j == nstreams - 1 ? limit : limit / nstreams * (j + 1);
+        st[j].end   = st[j].limit + ac->maxlen - 1 < n ? st[j].limit + ac->maxlen - 1 : n;
+    }
+
+    if (nstreams == AC_STREAMS) {
+        //Four independent walks, so the table lookups of one overlap the
+        // others' instead of each waiting for the last
+        len = st[0].end - st[0].pos;
+        for (j = 1; j < AC_STREAMS; j++)
+            if (st[j].end - st[j].pos < len)
+                len = st[j].end - st[j].pos;
+        s0 = s1 = s2 = s3 = 0;
+        for (i = 0; i < len; i++) {
+            s0 = AC_NEXT(ac, s0, ac->cls[t[st[0].pos + i]]);
+            s1 = AC_NEXT(ac, s1, ac->cls[t[st[1].pos + i]]);
+            s2 = AC_NEXT(ac, s2, ac->cls[t[st[2].pos + i]]);
+            s3 = AC_NEXT(ac, s3, ac->cls[t[st[3].pos + i]]);
+            if ((r = AC_REPORT(ac, s0)) >= 0)
+                emit(ac, &st[0], r, st[0].pos + i);
+            if ((r = AC_REPORT(ac, s1)) >= 0)
+                emit(ac, &st[1], r, st[1].pos + i);
+            if ((r = AC_REPORT(ac, s2)) >= 0)
+                emit(ac, &st[2], r, st[2].pos + i);
+            if ((r = AC_REPORT(ac, s3)) >= 0)
+                emit(ac, &st[3], r, st[3].pos + i);
+        }
+        st[0].s = s0;
+        st[1].s = s1;
+        st[2].s = s2;
+        st[3].s = s3;
+        for (j = 0; j < AC_STREAMS; j++)
+            st[j].pos += len;
+    }
+    for (j = 0; j < nstreams; j++)
+        scan_stream(ac, t, &st[j], skip);
+
+    //Join the streams in order
+    found = 0;
+    for (j = 0; j < nstreams; j++)
+        found += st[j].count;
+    matches = st[0].m;
+    if (nstreams > 1) {
+        matches = realloc(matches, (found ? found : 1) * sizeof(struct ac_match));
+        for (i = st[0].count, j = 1; j < nstreams; i += st[j].count, j++) {
+            if (st[j].count)
+                memcpy(matches + i, st[j].m, st[j].count * sizeof(struct ac_match));
+            free(st[j].m);
+        }
+    }
+    if (NULL == matches)
+        matches = malloc(sizeof(struct ac_match));
+
+    *count = found;
+    return matches;
+}
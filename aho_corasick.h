@@ -0,0 +1,76 @@
+#ifndef AHO_CORASICK_H
+#define AHO_CORASICK_H
+
+#define AC_DENSE_BYTES  (1 << 20)   /* default budget of the dense table     */
+#define AC_STREAMS      4           /* parts of the text scanned in step     */
+
+/* Multi-pattern automaton. Bytes are first mapped to classes, one per byte
+   that occurs in some pattern plus one for all other bytes, so rows are only
+   as wide as the patterns' alphabet. States are numbered breadth first. The
+   first ndense states, the shallow ones the scan spends nearly all its time
+   in, have a full row of transitions; deeper states keep only their trie
+   edges, sorted by class, and fall back along their failure links. A dense
+   row holds the first state of the state's report chain, then the next
+   state for each class, as the offset of its row when it is dense and as
+   ~state when it is sparse, which saves a multiply per byte. */
+struct ac_automaton {
+    int             npats;
+    long           *lens;       /* length of each pattern                  */
+    long            maxlen;     /* longest pattern                         */
+    unsigned short  cls[256];   /* byte class of each byte                 */
+    int             nclasses;
+    int             nstates;
+    int             ndense;     /* states 0..ndense-1 are dense            */
+    int             rowlen;     /* 1 + nclasses                            */
+    int            *delta;      /* ndense rows of rowlen entries           */
+    int            *fail;       /* failure link of each state              */
+    int            *edge_start; /* sparse states: their edges are          */
+    unsigned short *edge_cls;   /*   edge_start[s-ndense] up to            */
+    int            *edge_to;    /*   edge_start[s-ndense+1] - 1            */
+    int            *out_start;  /* patterns ending at state s are          */
+    int            *out_pat;    /*   out_pat[out_start[s]..out_start[s+1]) */
+    int            *report;     /* first state on s's failure chain with   */
+                                /*   patterns ending at it, or -1          */
+    unsigned char   start[256]; /* bytes that begin some pattern           */
+    int             nstart;
+    unsigned char   start_bytes[8]; /* them, when there are at most 8      */
+};
+
+/* One match: the pattern and the offset of its first byte */
+struct ac_match {
+    long    offset;
+    int     pattern;
+};
+
+/******************************************************************************/
+/** ac_build(ac, pats, lens, npats, dense_bytes)
+ *  Builds the automaton for the npats patterns pats[i] of lens[i] bytes.
+ *  The patterns are not referenced after it returns. As many states as fit in
+ *  dense_bytes (0 for AC_DENSE_BYTES) get dense rows. Returns 0, or -1 if a
+ *  pattern is empty or memory runs out.
+ */
+int ac_build(struct ac_automaton *ac, const char *const *pats, const long *lens, int npats,
+             long dense_bytes);
+
+/******************************************************************************/
+/** ac_free(ac)
+ *  Releases the tables of ac.
+ */
+void ac_free(struct ac_automaton *ac);
+
+/******************************************************************************/
+/** ac_scan(ac, text, n, limit, &count)
+ *  Scans the n bytes at text once and returns every match of every pattern
+ *  that starts before offset limit, in an array of *count entries to be
+ *  freed by the caller. Matches may overlap. When at most 8 bytes begin a
+ *  pattern and they make up under 1/16 of the first 4 KiB of text, the scan
+ *  skips ahead from the root state to the next such byte with memchr or an
+ *  AVX2 compare. Otherwise [0, limit) is split in
+ *  AC_STREAMS parts that are scanned in step, to overlap their table
+ *  lookups; the matches are listed part by part, and by end offset within
+ *  a part.
+ */
+struct ac_match *ac_scan(const struct ac_automaton *ac, const char *text, long n, long limit,
+                         long *count);
+
+#endif
@@ -1,8 +1,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "alloc_matrix.h"
 
+#define HUGE_PAGE_SIZE      (2UL * 1024 * 1024)
+#define PAGE_ALIAS_STRIDE   4096  /* row strides that are a multiple of this
+                                     map every row to the same cache sets   */
+
 /******************************************************************************/
 void alloc_matrix(
         int     nrows,          /* number of rows in matrix                   */
@@ -21,7 +30,7 @@ void alloc_matrix(
 
     //printf("alloc_matrix called with r=%d,c=%d,e=%ld\n",nrows, ncols, element_size);
 
-    total_bytes = nrows * ncols * element_size;
+    total_bytes = (size_t) nrows * ncols * element_size;
 
     /* Step 1: Allocate an array of nrows * ncols * element_size bytes  */
     *matrix_storage = malloc(total_bytes);
@@ -83,3 +92,156 @@ void alloc_matrix(
 
 }
 
+/******************************************************************************/
+/* Round x up to the next multiple of m */
+static size_t round_up(size_t x, size_t m)
+{
+    return (x + m - 1) / m * m;
+}
+
+/******************************************************************************/
+/* Map *len bytes of anonymous, zero-filled memory starting on a huge page
+   boundary. On return *len holds the length actually mapped, which is what
+   must later be passed to munmap(). Returns NULL if the mapping failed. */
+static void *map_storage(size_t *len, int flags)
+{
+    size_t map_len = round_up(*len, HUGE_PAGE_SIZE);
+    char  *raw, *start;
+    size_t head, tail;
+
+#ifdef MAP_HUGETLB
+    if ( flags & ALLOC_HUGETLB ) {
+        start = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if ( MAP_FAILED != start ) {
+            *len = map_len;
+            return start;
+        }
+        /* no huge pages reserved in the pool, so use transparent ones */
+    }
+#endif
+
+    /* Over-map by one huge page and trim both ends, so the kernel can back
+       the region with whole huge pages from the first byte */
+    raw = mmap(NULL, map_len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if ( MAP_FAILED == raw )
+        return NULL;
+
+    start = (char*) round_up((uintptr_t) raw, HUGE_PAGE_SIZE);
+    head  = start - raw;
+    tail  = HUGE_PAGE_SIZE - head;
+    if ( head > 0 )
+        munmap(raw, head);
+    if ( tail > 0 )
+        munmap(start + map_len, tail);
+
+#ifdef MADV_HUGEPAGE
+    madvise(start, map_len, MADV_HUGEPAGE);
+#endif
+    *len = map_len;
+    return start;
+}
+
+/******************************************************************************/
+void alloc_matrix_aligned(
+        int     nrows,          /* number of rows in matrix                   */
+        int     ncols,          /* number of columns in matrix                */
+        size_t  element_size,   /* number of bytes per matrix element         */
+        int     flags,          /* ALLOC_* options                            */
+        size_t *ld,             /* padded row length, in elements             */
+        void  **matrix_storage, /* address of linear storage array for matrix */
+        void ***matrix,         /* address of start of matrix                 */
+        int    *errvalue)       /* return code for error, if any              */
+{
+    int    i;
+    size_t unit;        /* smallest row length that keeps rows aligned and is
+                           a whole number of elements                         */
+    size_t row_bytes;   /* padded length of one row in bytes                  */
+    size_t total_bytes; /* amount of memory to allocate                       */
+    size_t map_len = 0; /* length of the mapping, 0 if storage is from heap   */
+    char  *storage;
+    void **row_ptrs;
+
+    /* Step 1: Choose the padded row length. It must be a multiple of both
+       MATRIX_ALIGNMENT and element_size, i.e. of their lcm. */
+    unit = MATRIX_ALIGNMENT;
+    while ( unit % element_size != 0 )
+        unit += MATRIX_ALIGNMENT;
+
+    row_bytes = round_up((size_t) ncols * element_size, unit);
+    if ( nrows > 1 && row_bytes % PAGE_ALIAS_STRIDE == 0 )
+        row_bytes += unit;
+
+    *ld = row_bytes / element_size;
+    total_bytes = (size_t) nrows * row_bytes;
+
+    /* Step 2: Get the storage, either as a mapping that huge pages can back
+       or as an aligned block from the heap */
+    if ( flags & (ALLOC_HUGEPAGE | ALLOC_HUGETLB) ) {
+        map_len = total_bytes;
+        storage = map_storage(&map_len, flags);
+    }
+    else if ( posix_memalign((void**) &storage, MATRIX_ALIGNMENT,
+                             total_bytes > 0 ? total_bytes : 1) != 0 )
+        storage = NULL;
+
+    if ( NULL == storage ) {
+        *errvalue = MALLOC_ERROR;
+        return;
+    }
+
+    /* Step 3: Zero the storage. Fresh mappings are already zero, so they are
+       only touched here when the caller asked for first-touch placement. */
+    if ( flags & ALLOC_FIRST_TOUCH ) {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static)
+#endif
+        for ( i = 0; i < nrows; i++ )
+            memset(storage + (size_t) i * row_bytes, 0, row_bytes);
+    }
+    else if ( 0 == map_len )
+        memset(storage, 0, total_bytes);
+
+    /* Step 4: Allocate the row pointers. Two hidden slots in front of
+       (*matrix)[0] remember how the storage was obtained so that
+       free_matrix_aligned() can release it. */
+    row_ptrs = malloc((nrows + 2) * sizeof(void*));
+    if ( NULL == row_ptrs ) {
+        if ( map_len > 0 )
+            munmap(storage, map_len);
+        else
+            free(storage);
+        *errvalue = MALLOC_ERROR;
+        return;
+    }
+    row_ptrs[0] = storage;
+    row_ptrs[1] = (void*) (uintptr_t) map_len;
+    row_ptrs += 2;
+
+    for ( i = 0; i < nrows; i++ )
+        row_ptrs[i] = storage + (size_t) i * row_bytes;
+
+    *matrix_storage = storage;
+    *matrix = row_ptrs;
+    *errvalue = SUCCESS;
+}
+
+/******************************************************************************/
+void free_matrix_aligned(
+        void   *matrix_storage, /* linear storage array for matrix            */
+        void  **matrix)         /* row pointer array for matrix               */
+{
+    size_t map_len;
+
+    if ( NULL == matrix )
+        return;
+
+    matrix -= 2;
+    map_len = (size_t) (uintptr_t) matrix[1];
+    if ( map_len > 0 )
+        munmap(matrix_storage, map_len);
+    else
+        free(matrix_storage);
+    free(matrix);
+}
@@ -4,6 +4,15 @@
 #define SUCCESS             0
 #define MALLOC_ERROR        1
 
+/* Option bits for alloc_matrix_aligned()                                     */
+#define ALLOC_DEFAULT       0x0  /* 64-byte aligned heap storage, zeroed      */
+#define ALLOC_HUGEPAGE      0x1  /* anonymous mapping advised for THP         */
+#define ALLOC_HUGETLB       0x2  /* MAP_HUGETLB, falls back to ALLOC_HUGEPAGE */
+#define ALLOC_FIRST_TOUCH   0x4  /* zero rows in parallel (OpenMP) so pages
+                                    land on the NUMA node that touches them   */
+
+#define MATRIX_ALIGNMENT    64   /* row start alignment in bytes              */
+
 /******************************************************************************/
 /** alloc_matrix(r,c,e, &Mstorage, &M, &err)
  *  If &err is SUCCESS, on return it allocated storage for two arrays in
@@ -20,5 +29,35 @@ void alloc_matrix(
         int    *errvalue        /* return code for error, if any              */
         );
 
+/******************************************************************************/
+/** alloc_matrix_aligned(r,c,e, flags, &ld, &Mstorage, &M, &err)
+ *  Like alloc_matrix(), but every row of M starts on a MATRIX_ALIGNMENT byte
+ *  boundary. Rows are padded to a leading dimension of ld elements (ld >= c),
+ *  so M[i][j] is at Mstorage + (i*ld + j)*e. The padding also keeps the row
+ *  stride off multiples of 4096 bytes to avoid cache set aliasing.
+ *  flags selects the backing memory (see ALLOC_* above). The storage is
+ *  always zeroed; with ALLOC_FIRST_TOUCH the zeroing is split by rows over
+ *  the OpenMP threads using a static schedule, so a later loop with the same
+ *  schedule finds its rows on the local NUMA node.
+ *  Storage obtained here must be released with free_matrix_aligned().
+ */
+void alloc_matrix_aligned(
+        int     nrows,          /* number of rows in matrix                   */
+        int     ncols,          /* number of columns in matrix                */
+        size_t  element_size,   /* number of bytes per matrix element         */
+        int     flags,          /* ALLOC_* options                            */
+        size_t *ld,             /* padded row length, in elements             */
+        void  **matrix_storage, /* address of linear storage array for matrix */
+        void ***matrix,         /* address of start of matrix                 */
+        int    *errvalue        /* return code for error, if any              */
+        );
 
-
+/******************************************************************************/
+/** free_matrix_aligned(Mstorage, M)
+ *  Releases both arrays returned by alloc_matrix_aligned(), unmapping or
+ *  freeing the storage according to how it was obtained.
+ */
+void free_matrix_aligned(
+        void   *matrix_storage, /* linear storage array for matrix            */
+        void  **matrix          /* row pointer array for matrix               */
+        );
@@ -4,39 +4,78 @@
 //
 // BUILD INSTRUCTIONS: This program uses the math library. Append '-lm' to the build command
 // This program also uses MPI, use the MPI wrapper to build ('mpicc')
-// $ mpicc -Wall -o <target filename> <source name> -lm
+// $ mpicc -Wall -fopenmp -o <target filename> <source name> -lm
+//
+// RUN INSTRUCTIONS: mpirun -np n <target filename> [-m <mode>] [-k <kernel>] [-t <threads>] <x> <# of partitions>
+// <mode> is cyclic (default) or block, <kernel> is auto, scalar, avx2 or
+// avx512, and <threads> is the number of OpenMP threads per rank; see
+// riemannlog.c
 
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "riemann.c"
+#include "quadrature.c"
 
-double approx_log(int partitions, int trg, int id, int p){
-    int i;
-    double sum, x, dx;
-
-    dx = ((double)trg - 1.0) / (double) partitions;
-    sum = 0.0;
-
-    for (i = id+2; i <= partitions+1; i += p){
-        x = dx * ((double)i - 0.5) + 1;
-        sum += 1/x;
-    }
-
-    return sum*dx;
-
-}
+#define MODE_CYCLIC 0
+#define MODE_BLOCK  1
 
 int main(int argc, char* argv[])
 {
-    if(argc < 2){
+    int opt;
+    int mode = MODE_CYCLIC;
+    int kernel = KERNEL_AUTO;
+    int threads = 1; //threads per rank
+    int t;
+    int provided; //thread support level granted by MPI
+
+    while((opt = getopt(argc, argv, "m:k:t:")) != -1){
+        switch(opt){
+        case 'm':
+            if(strcmp(optarg, "block") == 0)
+                mode = MODE_BLOCK;
+            else if(strcmp(optarg, "cyclic") == 0)
+                mode = MODE_CYCLIC;
+            else {
+                printf("Unknown mode %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'k':
+            for(kernel = KERNEL_AVX512; kernel > KERNEL_AUTO; --kernel)
+                if(strcmp(optarg, midpoint_kernel_name(kernel)) == 0)
+                    break;
+            if(KERNEL_AUTO == kernel && strcmp(optarg, "auto") != 0){
+                printf("Unknown kernel %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 't':
+            threads = atoi(optarg);
+            if(threads < 1){
+                printf("Threads per rank must be at least 1. Exiting.\n");
+                exit(1);
+            }
+            break;
+        default:
+            exit(1);
+        }
+    }
+
+    if(argc - optind < 2){
         printf("Too few arguments. Exiting.");
         exit(1);
     }
     int id; //procedure id
     int p; //num procedures
-    int trg; //value whose log is determined
-    int partitions; //number of partitions
+    double trg; //value whose log is determined
+    long partitions; //number of partitions
     double local_total;
     double total; //final sum of areas
     double log_calc;
@@ -44,13 +83,14 @@ int main(int argc, char* argv[])
     double e_time;
 
     //Initialize MPI
-    MPI_Init(&argc, &argv);
+    //Only the main thread of each rank makes MPI calls
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &id);
     MPI_Comm_size(MPI_COMM_WORLD, &p);
 
-    //Collect the command line variables and convert to int
-    trg = atoi(argv[1]);
-    partitions = atoi(argv[2]);
+    //Collect the command line variables
+    trg = atof(argv[optind]);
+    partitions = strtoll(argv[optind+1], NULL, 10);
 
     //Check if the command line variables meet requirements
     if(id == 0){
@@ -62,12 +102,36 @@ int main(int argc, char* argv[])
         }
     }
 
+    //Warn when the threads cannot run side by side
+    if(id == 0 && threads > 1){
+#ifdef _OPENMP
+        if(omp_get_num_procs() < threads)
+            fprintf(stderr, "Warning: %d threads per rank but only %d cpus bound to each rank\n",
+                    threads, omp_get_num_procs());
+#else
+        fprintf(stderr, "Warning: built without OpenMP, threads of a rank run one after another\n");
+#endif
+    }
+
+    select_midpoint_kernel(kernel);
+
     //Begin timer
     MPI_Barrier(MPI_COMM_WORLD);
     e_time = - MPI_Wtime();
 
-    //Calculate the approximation and collect results from all tasks
-    local_total = approx_log(partitions, trg, id, p);
+    //Calculate the approximation and collect results from all tasks.
+    // Thread t of this rank acts as virtual process id*threads + t of
+    // p*threads, and the thread partial sums are combined before the reduce
+    local_total = 0.0;
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(threads) schedule(static, 1) reduction(+:local_total)
+#endif
+    for(t = 0; t < threads; ++t){
+        if(MODE_BLOCK == mode)
+            local_total += approx_log_block(partitions, trg, id*threads + t, p*threads);
+        else
+            local_total += approx_log_cyclic(partitions, trg, id*threads + t, p*threads);
+    }
 
     MPI_Reduce(&local_total, &total, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
 
@@ -77,9 +141,9 @@ int main(int argc, char* argv[])
 
     //ROOT task will calculate the error and display results
     if(id == 0){
-        log_calc = log((double)trg);
+        log_calc = log(trg);
         error = fabs(total - log_calc);
-        printf("%d \t %.16f \t %.16f \t %f\n", trg, total, error, e_time);
+        printf("%.17g \t %.16f \t %.16f \t %f\n", trg, total, error, e_time);
         fflush(stdout);
     }
 
@@ -1,15 +1,72 @@
+// This program pairs students into rooms so that the pairs get on as well
+// as possible. The matrix file holds, for every two students s and t, how
+// badly they would get on at [s][t]; the matrix is symmetric and only the
+// entries with s < t are read. The cost of an assignment is the sum of its
+// rooms' entries, and it is lowered by simulated annealing with replica
+// exchange (parallel tempering): every rank runs its own chain of swaps of
+// two students, at its own temperature, and after every <moves> swaps
+// neighbouring temperatures are exchanged between the ranks with the
+// Metropolis rule on their costs. Good assignments found by hot chains so
+// sink to the coldest ones, so more ranks give better assignments in the
+// same time. After <seconds> the best assignment found by any rank is
+// reported.
+// By default every chain starts from the same constructed assignment:
+// every student's cheapest roommates are found by the ranks together, the
+// cheapest of those pairings are taken greedily, and swaps with them are
+// made while they lower the cost. With <seconds> 0 that assignment is the
+// answer, in a fraction of the time.
 //
+// BUILD INSTRUCTIONS - mpicc -Wall -O3 -fopenmp -o <object name> <file-name>.c -lm
+//                      mpirun -np <# procs> <object name> [-a <hint>] [-i <start>] [-t <threads>] [-s <seconds>] [-m <moves>] [-T <hot>] [-C <cold>] [-o <output file>] <seed-selection> <matrix file>
 //
-// BUILD INSTRUCTIONS - mpicc -Wall -o <object name> <file-name>.c
-//                      mpirun -np <# procs> <object name> <seed-selection> <matrix file>
+// Every rank maps the matrix file rather than reading it, so the rows point
+// straight into the page cache, which the ranks of a node share; a chain may
+// swap any two students, so each rank needs the whole matrix at hand. The
+// file can be in the original format or in the aligned format written by
+// convert_matrix, of any element type, or the packed upper triangle written
+// by convert_matrix -p, which is a half to an eighth the size of a full
+// matrix of doubles and so keeps more of it in cache. <hint> tells the
+// kernel how the mapping will be used: seq, random, willneed or populate.
+// -a may be given more than once.
+// <start> is greedy (default), for the constructed assignment, or random,
+// for a random pairing drawn by each rank from its own stream.
+// <threads> is the number of OpenMP threads each rank constructs it with
+// (default 1); the assignment is the same whatever the number of ranks and
+// threads.
+// <seconds> is the time spent annealing (default 10; 0 to not anneal).
+// <moves> is the number of swaps each rank tries between exchanges (default
+// 1000000). <hot> and <cold> are the highest and lowest temperatures, which
+// are spread geometrically over the ranks; by default <hot> is the mean cost
+// change of a random swap and <cold> is <hot> / 1000. <seed-selection> 0
+// seeds the chains from the time, anything else repeats the same run; each
+// rank's chain draws from its own stream of the seed (rng.h), which is the
+// same for a rank whatever the number of ranks. The rooms of the best
+// assignment are written to <output file> as lines of <room> <student>
+// <student>; with an odd number of students one of them is left without a
+// room.
 
 
 #include "alloc_matrix.c"
+#include "matrix_file.c"
+#include "sym_matrix.c"
+#include "room_state.c"
+#include "room_build.c"
+#include "rng.c"
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define SAMPLE_MOVES 1000 //random swaps whose mean cost change sets the default hot temperature
+#define PREFETCH_AHEAD 8 //swaps proposed ahead of the one scored, to hide the matrix reads
+#define CANDIDATES 8 //cheapest roommates of each student the construction pairs from
+#define LOCAL_PASSES 1000 //most passes of swaps after the greedy pairing
 
 struct Room {
     int s1;
@@ -17,24 +74,227 @@ struct Room {
     int room_number;
 };
 
+//Convert the name of an access hint into its MAP_HINT_* value
+//params: name, one of seq, random, willneed or populate
+//returns the hint, or -1 if the name is not recognised
+int parseHint(const char *name)
+{
+    if(strcmp(name, "seq") == 0)
+        return MAP_HINT_SEQUENTIAL;
+    if(strcmp(name, "random") == 0)
+        return MAP_HINT_RANDOM;
+    if(strcmp(name, "willneed") == 0)
+        return MAP_HINT_WILLNEED;
+    if(strcmp(name, "populate") == 0)
+        return MAP_HINT_POPULATE;
+    return -1;
+}
+
+//Pairs the students at random
+//params: st, set to a random assignment
+//params: rng, the rank's stream of random numbers
+void randomAssignment(struct room_state *st, const struct sym_matrix *matrix,
+                      struct rng_stream *rng)
+{
+    int n = st->students;
+    int *order = malloc(n * sizeof(int));
+    int i, j, tmp;
+
+    for(i = 0; i < n; ++i)
+        order[i] = i;
+    for(i = n - 1; i > 0; --i){
+        j = rng_below(rng, i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    room_state_pair(st, matrix, order);
+    free(order);
+}
+
+//Picks two students to swap and starts loading the matrix entries the swap
+// would read, so that they are in cache by the time it is scored
+//params: a, b, set to the students
+void proposeSwap(const struct room_state *st, const struct sym_matrix *matrix,
+                 struct rng_stream *rng, int *a, int *b)
+{
+    int s, t;
+
+    *a = rng_below(rng, st->students);
+    *b = rng_below(rng, st->students);
+    if((t = st->partner[*a]) >= 0){
+        s = *b;
+        __builtin_prefetch(s < t ? sym_matrix_ptr(matrix, s, t) : sym_matrix_ptr(matrix, t, s));
+    }
+    if((t = st->partner[*b]) >= 0){
+        s = *a;
+        __builtin_prefetch(s < t ? sym_matrix_ptr(matrix, s, t) : sym_matrix_ptr(matrix, t, s));
+    }
+}
+
+//Runs a chain of the Metropolis algorithm at a fixed temperature
+//params: st, the assignment, changed in place
+//params: temp, the temperature
+//params: moves, the number of swaps tried
+//post: swaps are proposed PREFETCH_AHEAD moves before they are scored.
+// Swaps made in between may change a roommate, which only makes the
+// prefetch miss; the score is always read from the current state
+//returns the number of swaps made
+long anneal(const struct sym_matrix *matrix, struct room_state *st, struct rng_stream *rng,
+            double temp, long moves)
+{
+    int a[PREFETCH_AHEAD], b[PREFETCH_AHEAD];
+    long accepted = 0;
+    int k, x, y;
+    double delta, ca, cb;
+    double limit = 40.0 * temp; //beyond it exp(-delta / temp) is below 2^-32
+
+    for(k = 0; k < PREFETCH_AHEAD; ++k)
+        proposeSwap(st, matrix, rng, &a[k], &b[k]);
+    for(long m = 0; m < moves; ++m){
+        k = m % PREFETCH_AHEAD;
+        x = a[k];
+        y = b[k];
+        proposeSwap(st, matrix, rng, &a[k], &b[k]);
+        if(st->room_of[x] == st->room_of[y])
+            continue;
+        delta = room_swap_delta(st, matrix, x, y, &ca, &cb);
+        if(delta <= 0.0 || (delta < limit && rng_uniform(rng) < exp(-delta / temp))){
+            room_swap(st, x, y, ca, cb, delta);
+            ++accepted;
+        }
+    }
+    return accepted;
+}
+
+//The mean size of the cost change of a random swap, a scale for temperatures
+double meanDelta(const struct sym_matrix *matrix, const struct room_state *st,
+                 struct rng_stream *rng)
+{
+    double sum = 0.0, ca, cb;
+    int a, b, counted = 0;
+
+    for(int k = 0; k < SAMPLE_MOVES; ++k){
+        a = rng_below(rng, st->students);
+        b = rng_below(rng, st->students);
+        if(st->room_of[a] == st->room_of[b])
+            continue;
+        sum += fabs(room_swap_delta(st, matrix, a, b, &ca, &cb));
+        ++counted;
+    }
+    return counted > 0 ? sum / counted : 0.0;
+}
+
+//Proposes exchanges of neighbouring temperatures with the Metropolis rule
+//params: ladder, the p temperatures from coldest to hottest
+//params: costs, the cost of every rank's assignment
+//params: tempOf, the ladder index of every rank's temperature, updated
+//params: phase, 0 to pair temperatures 0-1, 2-3, ..., 1 for 1-2, 3-4, ...
+//params: rng, the stream the exchanges are drawn from
+//returns the number of exchanges made
+int exchangeTemperatures(const double *ladder, const double *costs, int *tempOf, int p, int phase,
+                         struct rng_stream *rng)
+{
+    int *rankAt = malloc(p * sizeof(int));
+    int k, t, r1, r2, made = 0;
+    double x;
+
+    for(k = 0; k < p; ++k)
+        rankAt[tempOf[k]] = k;
+    for(t = phase; t + 1 < p; t += 2){
+        r1 = rankAt[t];
+        r2 = rankAt[t + 1];
+        //Positive when the colder chain holds the costlier assignment
+        x = (1.0 / ladder[t] - 1.0 / ladder[t + 1]) * (costs[r1] - costs[r2]);
+        if(x >= 0.0 || rng_uniform(rng) < exp(x)){
+            tempOf[r1] = t + 1;
+            tempOf[r2] = t;
+            ++made;
+        }
+    }
+    free(rankAt);
+    return made;
+}
+
 int main(int argc, char* argv[])
 {
+    int opt;
+    int hint;
+    int hints = MAP_HINT_NONE;
+    double seconds = 10.0; //annealing time
+    long moves = 1000000; //swaps tried by each rank between exchanges
+    double hot = 0.0, cold = 0.0; //temperatures, 0 for the defaults
+    char *outFile = NULL;
+    int greedy = 1; //construct the starting assignment, else pair at random
+    int threads = 1; //OpenMP threads per rank for the construction
 
-    if(argc < 2){
+    while((opt = getopt(argc, argv, "a:i:t:s:m:T:C:o:")) != -1){
+        switch(opt){
+        case 'a':
+            if((hint = parseHint(optarg)) < 0){
+                printf("Unknown access hint %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            hints |= hint;
+            break;
+        case 'i':
+            if(strcmp(optarg, "greedy") == 0)
+                greedy = 1;
+            else if(strcmp(optarg, "random") == 0)
+                greedy = 0;
+            else {
+                printf("Unknown start %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 't':
+            threads = atoi(optarg);
+            if(threads < 1){
+                printf("Bad thread count %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 's':
+            seconds = atof(optarg);
+            break;
+        case 'm':
+            moves = atol(optarg);
+            break;
+        case 'T':
+            hot = atof(optarg);
+            break;
+        case 'C':
+            cold = atof(optarg);
+            break;
+        case 'o':
+            outFile = optarg;
+            break;
+        default:
+            exit(1);
+        }
+    }
+
+    if(argc - optind < 2){
         printf("Too few arguments. Exiting.");
         exit(1);
     }
+    if(seconds < 0 || moves < 1 || hot < 0 || cold < 0 || (hot > 0 && cold > hot)){
+        printf("Bad time, moves or temperatures. Exiting.\n");
+        exit(1);
+    }
 
     int p;
     int id;
     int rows;
     int cols;
-    FILE *matrix_file;
-    void *mat_storage, **matrix;
-    void *loc_mat_storage, **loc_matrix;
+    int dtype;
+    struct mapped_matrix mm;
+    void **matrix = NULL;
+    struct sym_matrix costs; //the upper triangle read by the chains
     int errval;
     int room_count;
-    double val;
+    double load_time;
+    double max_load_time;
 
 
 
@@ -42,43 +302,217 @@ int main(int argc, char* argv[])
     MPI_Comm_rank(MPI_COMM_WORLD, &id);
     MPI_Comm_size(MPI_COMM_WORLD, &p);
 
-    if(0 == id){
-        matrix_file = fopen(argv[2], "rb");
+    //Warn when the threads cannot run side by side
+    if(0 == id && threads > 1){
+#ifdef _OPENMP
+        if(omp_get_num_procs() < threads)
+            fprintf(stderr, "Warning: %d threads per process but only %d cpus bound to each process\n",
+                    threads, omp_get_num_procs());
+#else
+        fprintf(stderr, "Warning: built without OpenMP, threads of a process run one after another\n");
+#endif
+    }
 
-        if(!matrix_file) {
-            printf("Error opening file. Exiting...");
-            exit(1);
+    //Begin load timer
+    MPI_Barrier(MPI_COMM_WORLD);
+    load_time = - MPI_Wtime();
+
+    if(is_sym_matrix_file(argv[optind+1])){
+        //A packed triangle is mapped in place on every rank
+        map_sym_matrix_file(argv[optind+1], hints, &costs, &errval);
+
+        if(SUCCESS != errval) {
+            printf("Error %d opening file on rank %d. Exiting...", errval, id);
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        rows = cols = costs.n;
+        dtype = costs.dtype;
+    }
+    else {
+        //Map the matrix in place on every rank. The rows point straight
+        // into the page cache, so nothing is copied and the ranks of a node
+        // share one copy
+        map_matrix_file(argv[optind+1], hints, &mm, &matrix, &errval);
 
-        //Collect the row and column size
-        fread(&rows, sizeof(int), 1, matrix_file);
-        fread(&cols, sizeof(int), 1, matrix_file);
-
-        //the number of rooms will be the number of students div by 2
-        room_count = rows / 2;
-        //printf("rows:%i   cols:%i    rc:%i \n", rows, cols, room_count);
-
-        //Initialize the matrix
-        alloc_matrix(rows, cols, sizeof(double), &mat_storage, &matrix, &errval);
-        double temp;
-        for(int i = 0; i < rows; ++i){
-            for(int j = 0; j < cols; ++j){
-                fread(&temp, sizeof(double), 1, matrix_file);
-                ((double **)matrix)[i][j] = temp;
-                //printf("matrix[%i][%i] = %f \n", i, j, ((double **)matrix)[i][j]);
-            }
+        if(SUCCESS != errval) {
+            printf("Error %d opening file on rank %d. Exiting...", errval, id);
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        rows = mm.rows;
+        cols = mm.cols;
+        dtype = mm.dtype;
+        sym_matrix_from_rows(&costs, rows, dtype, mm.ld, mm.storage, &errval);
+    }
+    if(SUCCESS != errval) {
+        printf("Error %d opening file on rank %d. Exiting...", errval, id);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    //Stop load timer. The slowest rank determines the load time
+    load_time += MPI_Wtime();
+    MPI_Reduce(&load_time, &max_load_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if(rows != cols || rows < 2) {
+        if(0 == id)
+            printf("The matrix must be square and at least 2 by 2. Exiting...");
+        MPI_Finalize();
+        exit(1);
+    }
+
+    //the number of rooms will be the number of students div by 2
+    room_count = rows / 2;
+    if(0 == id)
+        printf("load time: %f\n", max_load_time);
+
+    //Establish seed based on user input. If no repeatable, set seed
+    // to time(NULL). Otherwise use a seed of 1. Rank 0 decides the
+    // exchanges from stream 0 of the seed, and every rank's chain draws
+    // from stream id + 1, so no two share numbers
+    unsigned int seed = 1;
+    if(atoi(argv[optind]) == 0)
+        seed = (unsigned int) time(NULL);
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+    struct rng_stream chainRng, exchangeRng;
+    rng_init(&chainRng, seed, (uint64_t) id + 1);
+    rng_init(&exchangeRng, seed, 0);
+
+    struct room_state st, best; //this rank's assignment, and the best it has had
+    double check = 0.0;
+    double *ladder = malloc(p * sizeof(double));
+    double *allCosts = malloc(p * sizeof(double));
+    int *tempOf = malloc((p + 1) * sizeof(int)); //ladder index of each rank, then the stop flag
+    long tried = 0, accepted = 0, exchanges = 0, proposed = 0, swapped = 0;
+    double anneal_time, scale;
 
-        //Establish seed based on user input. If no repeatable, set seed
-        // to time(NULL). Otherwise keep default random() seed of 1.
-        if(dtoi(argv[1]) == 0){
-            srandom(time(NULL))
+    room_state_init(&st, rows, &errval);
+    if(SUCCESS == errval)
+        room_state_init(&best, rows, &errval);
+    if(SUCCESS != errval){
+        printf("Error %d allocating the assignment on rank %d. Exiting...", errval, id);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if(greedy){
+        //Every rank builds the same assignment
+        struct room_candidates rc;
+        double build_time, max_build_time, greedy_cost;
+        long improved = 0;
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        build_time = - MPI_Wtime();
+        room_candidates_build(&rc, &costs, CANDIDATES, threads, MPI_COMM_WORLD, &errval);
+        if(SUCCESS == errval)
+            room_greedy(&st, &costs, &rc, &errval);
+        greedy_cost = st.cost;
+        if(SUCCESS == errval)
+            improved = room_local_search(&st, &costs, &rc, LOCAL_PASSES, threads, &errval);
+        if(SUCCESS != errval){
+            printf("Error %d constructing the assignment on rank %d. Exiting...", errval, id);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        room_candidates_free(&rc);
+        build_time += MPI_Wtime();
+        MPI_Reduce(&build_time, &max_build_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if(0 == id)
+            printf("construct time: %f, greedy cost: %f, after %li swaps: %f\n", max_build_time,
+                   greedy_cost, improved, st.cost);
+    }
+    else
+        randomAssignment(&st, &costs, &chainRng);
+    room_state_copy(&best, &st);
+
+    //Temperatures from cold on rank 0 to hot on rank p-1
+    scale = meanDelta(&costs, &st, &chainRng);
+    MPI_Allreduce(MPI_IN_PLACE, &scale, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    if(hot == 0.0)
+        hot = scale > 0.0 ? scale / p : 1.0;
+    if(cold == 0.0)
+        cold = hot / 1000.0;
+    for(int k = 0; k < p; ++k){
+        ladder[k] = p > 1 ? cold * pow(hot / cold, (double) k / (p - 1)) : cold;
+        tempOf[k] = k;
+    }
+    tempOf[p] = seconds <= 0.0;
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    anneal_time = - MPI_Wtime();
+    while(!tempOf[p]){
+        accepted += anneal(&costs, &st, &chainRng, ladder[tempOf[id]], moves);
+        tried += moves;
+        if(st.cost < best.cost)
+            room_state_copy(&best, &st);
+
+        //Rank 0 decides the exchanges and when to stop, for every rank
+        MPI_Gather(&st.cost, 1, MPI_DOUBLE, allCosts, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        if(0 == id){
+            swapped += exchangeTemperatures(ladder, allCosts, tempOf, p, exchanges % 2,
+                                            &exchangeRng);
+            proposed += (p - exchanges % 2) / 2;
+            tempOf[p] = anneal_time + MPI_Wtime() >= seconds;
+        }
+        ++exchanges;
+        MPI_Bcast(tempOf, p + 1, MPI_INT, 0, MPI_COMM_WORLD);
+    }
+    anneal_time += MPI_Wtime();
+
+    //The rank with the best assignment sends it to rank 0
+    struct { double cost; int rank; } mine = {best.cost, id}, winner;
+    MPI_Allreduce(&mine, &winner, 1, MPI_DOUBLE_INT, MPI_MINLOC, MPI_COMM_WORLD);
+    if(winner.rank != 0){
+        if(winner.rank == id){
+            MPI_Send(best.partner, rows, MPI_INT, 0, 0, MPI_COMM_WORLD);
+            MPI_Send(best.room_of, rows, MPI_INT, 0, 0, MPI_COMM_WORLD);
+        }
+        else if(0 == id){
+            MPI_Recv(best.partner, rows, MPI_INT, winner.rank, 0, MPI_COMM_WORLD,
+                     MPI_STATUS_IGNORE);
+            MPI_Recv(best.room_of, rows, MPI_INT, winner.rank, 0, MPI_COMM_WORLD,
+                     MPI_STATUS_IGNORE);
         }
+    }
+    long totals[2] = {tried, accepted}, allTotals[2];
+    MPI_Reduce(totals, allTotals, 2, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
 
+    if(0 == id){
+        //The rooms of the best assignment, with its cost summed from the matrix
+        struct Room *rooms = malloc(room_count * sizeof(struct Room));
+        for(int s = 0; s < rows; ++s)
+            if(best.partner[s] > s){
+                rooms[best.room_of[s]].s1 = s;
+                rooms[best.room_of[s]].s2 = best.partner[s];
+                rooms[best.room_of[s]].room_number = best.room_of[s];
+                check += room_pair_cost(&costs, s, best.partner[s]);
+            }
 
+        if(seconds > 0.0){
+            printf("anneal time: %f\n", anneal_time);
+            printf("swaps tried: %li (%.3g per second), made: %li\n", allTotals[0],
+                   allTotals[0] / anneal_time, allTotals[1]);
+            printf("temperatures: %g to %g, exchanges: %li of %li proposed\n", cold, hot, swapped,
+                   proposed);
+        }
+        printf("best cost: %f, found by rank %d; check: %f\n", winner.cost, winner.rank, check);
 
+        if(NULL != outFile){
+            FILE *out = fopen(outFile, "w");
+            if(NULL == out)
+                printf("Could not write %s\n", outFile);
+            else {
+                for(int i = 0; i < room_count; ++i)
+                    fprintf(out, "%i %i %i\n", rooms[i].room_number, rooms[i].s1, rooms[i].s2);
+                fclose(out);
+            }
+        }
+        free(rooms);
     }
 
+    free(tempOf);
+    free(allCosts);
+    free(ladder);
+    room_state_free(&best);
+    room_state_free(&st);
+    sym_matrix_free(&costs);
+    if(NULL != matrix)
+        unmap_matrix_file(&mm, matrix);
 
     MPI_Finalize();
 
@@ -0,0 +1,312 @@
+// Scaling benchmark for the block midpoint approximation of ln(x) in
+// riemann.c. For every rank count and partition count it runs warm-up and
+// timed trials on a sub-communicator of that many ranks, timing the compute
+// and the reduce of each rank separately, and prints one record per
+// configuration as CSV or JSON.
+//
+// BUILD INSTRUCTIONS:
+//  $ mpicc -Wall -O2 -o <target filename> bench_riemann.c -lm
+// RUN INSTRUCTIONS:
+//  $ mpirun -np n <target filename> [-s strong|weak|both] [-P <partitions>]
+//        [-R <ranks>] [-w <warm-ups>] [-N <trials>] [-k <kernel>] [-x <value>]
+//        [-F csv|json]
+//
+// <partitions> is a comma separated list, e.g. 1e8,1e9. In strong scaling it
+// is the total partition count; in weak scaling it is the count per rank.
+// <ranks> is a comma separated list of rank counts (default 1, 2, 4, ... up
+// to n, and n). <warm-ups> (default 2) untimed and <trials> (default 10)
+// timed runs are made of each configuration. <kernel> is as in riemannlog:
+// auto, scalar, avx2 or avx512. <value> is the x whose log is approximated
+// (default 10).
+//
+// Each record holds the minimum, median and 95th percentile over the trials
+// of the wall time (the slowest rank's compute plus reduce), and the medians
+// of the slowest, mean and fastest rank's compute time, of the slowest
+// rank's reduce time, and of the imbalance, max/mean - 1 of the compute
+// times.
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include "riemann.c"
+#include "quadrature.c"
+
+#define SCALING_STRONG 1
+#define SCALING_WEAK   2
+
+#define MAX_LIST 64
+
+//Statistics of the timed trials of one configuration
+struct bench_stats {
+    double wall_min, wall_median, wall_p95;
+    double compute_max, compute_mean, compute_min;
+    double reduce_max;
+    double imbalance;
+};
+
+/*Parses a comma separated list of numbers, which may be written as 1e9
+ @return: the number of values stored in list, at most max
+*/
+int parse_list(const char *str, long *list, int max){
+    char *end;
+    int n = 0;
+
+    while(n < max && *str != '\0'){
+        list[n++] = (long) strtod(str, &end);
+        if(end == str)
+            return -1;
+        str = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+int compare_double(const void *a, const void *b){
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+//Nearest rank percentile of sorted values
+double percentile(const double *sorted, int n, double q){
+    int k = (int) ceil(q * n) - 1;
+    return sorted[k < 0 ? 0 : k];
+}
+
+/*Runs one configuration on comm
+ @post: on rank 0 of comm, stats describes the timed trials
+*/
+void run_config(MPI_Comm comm, long partitions, double trg, int warmups, int trials,
+                struct bench_stats *stats){
+    int id, p, k;
+    double local, total;
+    double t0, t1, t2;
+    double times[2]; //compute and reduce time of this rank
+    double sums[2], maxes[2], compute_min;
+    double *wall = NULL, *c_max = NULL, *c_mean = NULL, *c_min = NULL;
+    double *r_max = NULL, *imb = NULL;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+
+    if(id == 0){
+        wall = malloc(6 * trials * sizeof(double));
+        c_max = wall + trials;
+        c_mean = c_max + trials;
+        c_min = c_mean + trials;
+        r_max = c_min + trials;
+        imb = r_max + trials;
+    }
+
+    for(k = -warmups; k < trials; ++k){
+        MPI_Barrier(comm);
+        t0 = MPI_Wtime();
+        local = approx_log_block(partitions, trg, id, p);
+        t1 = MPI_Wtime();
+        MPI_Reduce(&local, &total, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+        t2 = MPI_Wtime();
+
+        //Timing statistics are gathered outside the timed region
+        times[0] = t1 - t0;
+        times[1] = t2 - t1;
+        MPI_Reduce(times, sums, 2, MPI_DOUBLE, MPI_SUM, 0, comm);
+        MPI_Reduce(times, maxes, 2, MPI_DOUBLE, MPI_MAX, 0, comm);
+        MPI_Reduce(times, &compute_min, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+        if(id == 0 && k >= 0){
+            //The root leaves the reduce last, so its t2 - t0 is the wall time
+            wall[k] = t2 - t0;
+            c_max[k] = maxes[0];
+            c_mean[k] = sums[0] / p;
+            c_min[k] = compute_min;
+            r_max[k] = maxes[1];
+            imb[k] = c_mean[k] > 0 ? maxes[0] / c_mean[k] - 1.0 : 0.0;
+        }
+    }
+
+    if(id == 0){
+        qsort(wall, trials, sizeof(double), compare_double);
+        qsort(c_max, trials, sizeof(double), compare_double);
+        qsort(c_mean, trials, sizeof(double), compare_double);
+        qsort(c_min, trials, sizeof(double), compare_double);
+        qsort(r_max, trials, sizeof(double), compare_double);
+        qsort(imb, trials, sizeof(double), compare_double);
+        stats->wall_min = wall[0];
+        stats->wall_median = percentile(wall, trials, 0.5);
+        stats->wall_p95 = percentile(wall, trials, 0.95);
+        stats->compute_max = percentile(c_max, trials, 0.5);
+        stats->compute_mean = percentile(c_mean, trials, 0.5);
+        stats->compute_min = percentile(c_min, trials, 0.5);
+        stats->reduce_max = percentile(r_max, trials, 0.5);
+        stats->imbalance = percentile(imb, trials, 0.5);
+        free(wall);
+    }
+}
+
+void print_record(int json, int first, const char *scaling, int ranks, long partitions,
+                  int kernel, int trials, const struct bench_stats *s){
+    if(json)
+        printf("%s\n  {\"scaling\": \"%s\", \"ranks\": %d, \"partitions\": %ld, "
+               "\"kernel\": \"%s\", \"trials\": %d, \"wall_min\": %.6e, "
+               "\"wall_median\": %.6e, \"wall_p95\": %.6e, \"compute_max\": %.6e, "
+               "\"compute_mean\": %.6e, \"compute_min\": %.6e, \"reduce_max\": %.6e, "
+               "\"imbalance\": %.4f}",
+               first ? "[" : ",", scaling, ranks, partitions, midpoint_kernel_name(kernel),
+               trials, s->wall_min, s->wall_median, s->wall_p95, s->compute_max,
+               s->compute_mean, s->compute_min, s->reduce_max, s->imbalance);
+    else
+        printf("%s,%d,%ld,%s,%d,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.4f\n",
+               scaling, ranks, partitions, midpoint_kernel_name(kernel), trials,
+               s->wall_min, s->wall_median, s->wall_p95, s->compute_max,
+               s->compute_mean, s->compute_min, s->reduce_max, s->imbalance);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    int scaling = SCALING_STRONG;
+    int kernel = KERNEL_AUTO;
+    int warmups = 2;
+    int trials = 10;
+    int json = 0;
+    double trg = 10.0;
+    long part_list[MAX_LIST] = {100000000L};
+    int nparts = 1;
+    long rank_list[MAX_LIST];
+    int nranks = 0;
+
+    while((opt = getopt(argc, argv, "s:P:R:w:N:k:x:F:")) != -1){
+        switch(opt){
+        case 's':
+            if(strcmp(optarg, "strong") == 0)
+                scaling = SCALING_STRONG;
+            else if(strcmp(optarg, "weak") == 0)
+                scaling = SCALING_WEAK;
+            else if(strcmp(optarg, "both") == 0)
+                scaling = SCALING_STRONG | SCALING_WEAK;
+            else {
+                printf("Unknown scaling %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'P':
+            nparts = parse_list(optarg, part_list, MAX_LIST);
+            for(int k = 0; k < nparts; ++k)
+                if(part_list[k] < 1)
+                    nparts = -1;
+            if(nparts < 1){
+                printf("Bad partition list %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'R':
+            nranks = parse_list(optarg, rank_list, MAX_LIST);
+            if(nranks < 1){
+                printf("Bad rank list %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'w':
+            warmups = atoi(optarg);
+            if(warmups < 0){
+                printf("Bad warm-up count %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'N':
+            trials = atoi(optarg);
+            if(trials < 1){
+                printf("Bad trial count %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'k':
+            for(kernel = KERNEL_AVX512; kernel > KERNEL_AUTO; --kernel)
+                if(strcmp(optarg, midpoint_kernel_name(kernel)) == 0)
+                    break;
+            if(KERNEL_AUTO == kernel && strcmp(optarg, "auto") != 0){
+                printf("Unknown kernel %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'x':
+            trg = atof(optarg);
+            if(trg < 1){
+                printf("Bad value %s; x must be at least 1. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'F':
+            if(strcmp(optarg, "json") == 0)
+                json = 1;
+            else if(strcmp(optarg, "csv") == 0)
+                json = 0;
+            else {
+                printf("Unknown format %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        default:
+            exit(1);
+        }
+    }
+
+    int id; //procedure id
+    int p; //num procedures
+    int r, i, s, first = 1;
+    long partitions;
+    MPI_Comm sub;
+    struct bench_stats stats;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &id);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+
+    //Default rank counts: powers of two below p, then p
+    if(nranks == 0){
+        for(r = 1; r < p && nranks < MAX_LIST - 1; r *= 2)
+            rank_list[nranks++] = r;
+        rank_list[nranks++] = p;
+    }
+
+    kernel = select_midpoint_kernel(kernel);
+
+    if(id == 0 && !json)
+        printf("scaling,ranks,partitions,kernel,trials,wall_min,wall_median,wall_p95,"
+               "compute_max,compute_mean,compute_min,reduce_max,imbalance\n");
+
+    for(s = SCALING_STRONG; s <= SCALING_WEAK; s <<= 1){
+        if(!(scaling & s))
+            continue;
+        for(r = 0; r < nranks; ++r){
+            if(rank_list[r] < 1 || rank_list[r] > p){
+                if(id == 0)
+                    fprintf(stderr, "Skipping %ld ranks, only %d available\n", rank_list[r], p);
+                continue;
+            }
+
+            //The first rank_list[r] ranks run the configuration, the rest wait
+            MPI_Comm_split(MPI_COMM_WORLD, id < rank_list[r] ? 0 : MPI_UNDEFINED, id, &sub);
+            for(i = 0; i < nparts; ++i){
+                partitions = SCALING_WEAK == s ? part_list[i] * rank_list[r] : part_list[i];
+                if(MPI_COMM_NULL != sub)
+                    run_config(sub, partitions, trg, warmups, trials, &stats);
+                if(id == 0){
+                    print_record(json, first, SCALING_WEAK == s ? "weak" : "strong",
+                                 (int) rank_list[r], partitions, kernel, trials, &stats);
+                    first = 0;
+                }
+            }
+            if(MPI_COMM_NULL != sub)
+                MPI_Comm_free(&sub);
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+    }
+
+    if(id == 0 && json)
+        printf("%s\n", first ? "[]" : "\n]");
+
+    MPI_Finalize();
+    return 0;
+}
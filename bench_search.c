@@ -0,0 +1,462 @@
+// Benchmark for the text search of search_text_alt.c. For every text and
+// search string given, every matcher and input mode asked for, and every
+// rank count, it runs warm-up and timed trials on a sub-communicator of that
+// many ranks and prints one record per configuration as CSV or JSON, so the
+// records of two builds can be compared line by line. gen_corpus.c makes
+// texts of a chosen size, entropy and match density to run it on.
+//
+// BUILD INSTRUCTIONS:
+//  $ mpicc -Wall -O2 -pthread -o <target filename> bench_search.c -lm
+// RUN INSTRUCTIONS:
+//  $ mpirun -np n <target filename> [-m <matchers>] [-i <inputs>] [-R <ranks>]
+//        [-c <chunk>] [-w <warm-ups>] [-N <trials>] [-F csv|json]
+//        <search string> <text file> [<search string> <text file> ...]
+//
+// <matchers> is a comma separated list of the algorithms of matcher.h
+// (default memchr,horspool,twoway,simd); the record names the one actually
+// used, as simd falls back without AVX2. <inputs> lists the modes of
+// text_io.h (default send,mmap,mpiio,stream,dynamic), and <chunk> is the
+// chunk size of stream and dynamic (default theirs; suffixes k, m and g
+// allowed). <ranks> is a comma separated list of rank counts (default 1, 2,
+// 4, ... up to n, and n). <warm-ups> (default 1) untimed and <trials>
+// (default 5) timed runs are made of each configuration. The page cache is
+// not dropped, so after the warm-ups the text is read from memory; run on
+// texts larger than memory to time the disk.
+//
+// Each trial has every rank read its text, search it and send its matches to
+// rank 0, as search_text_alt does with -r gather, without printing them.
+// Each record holds the median over the trials of:
+//   wall      the time from the start to rank 0 holding every match
+//   read      the slowest rank's time to get its text: reading its section,
+//             or for stream and dynamic the time it waited for chunks
+//   distrib   the slowest less the fastest rank's time to get its section;
+//             with send, the time the sections spend being passed on by the
+//             rank that reads them all
+//   scan      the slowest rank's search time, and scan_mean the mean
+//   collect   the time to move the matches to rank 0
+// and with them the minimum wall time, the matches found, the GB/s per rank
+// of the wall and scan times, and the efficiency of the configuration
+// against the first rank count listed for the same text, matcher and input:
+// wall(r0) * r0 / (wall(r) * r).
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "matcher.c"
+#include "text_io.c"
+#include "search_results.c"
+
+#define MAX_LIST 64
+
+//Statistics of the timed trials of one configuration
+struct bench_stats {
+    double wall_min, wall_median;
+    double read_max, distrib, scan_max, scan_mean, collect;
+    long matches;
+};
+
+/*Parses a comma separated list of numbers
+ @return: the number of values stored in list, at most max, or -1
+*/
+int parse_list(const char *str, long *list, int max){
+    char *end;
+    int n = 0;
+
+    while(n < max && *str != '\0'){
+        list[n++] = (long) strtod(str, &end);
+        if(end == str)
+            return -1;
+        str = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+/*Parses a comma separated list of names with parse, e.g. matcher_parse()
+ @return: the number of values stored in list, at most max, or -1 if a
+          name is unknown
+*/
+int parse_names(char *str, int (*parse)(const char *), int *list, int max){
+    int n = 0;
+
+    for(char *name = strtok(str, ","); NULL != name && n < max; name = strtok(NULL, ",")){
+        list[n] = parse(name);
+        if(list[n++] < 0)
+            return -1;
+    }
+    return n;
+}
+
+/*Parses a size in bytes, which may end in k, m or g
+ @return: the size, or -1 if str is not a positive size
+*/
+long parse_size(const char *str){
+    char *end;
+    long size = strtol(str, &end, 10);
+
+    switch(*end){
+    case 'g': case 'G':
+        size <<= 10;
+        /* fall through */
+    case 'm': case 'M':
+        size <<= 10;
+        /* fall through */
+    case 'k': case 'K':
+        size <<= 10;
+        ++end;
+    }
+    return (end == str || *end != '\0' || size < 1) ? -1 : size;
+}
+
+int compare_double(const void *a, const void *b){
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+//Nearest rank percentile of sorted values
+double percentile(const double *sorted, int n, double q){
+    int k = (int) ceil(q * n) - 1;
+    return sorted[k < 0 ? 0 : k];
+}
+
+/*Adds the matches that start in the first limit of the len bytes at text
+ @post: as searchSection() in search_text_alt.c
+*/
+void scan(const struct matcher *m, const char *text, long len, long limit, long offset,
+          struct match_list *results){
+    long i = 0;
+
+    if(len > limit + m->len - 1)
+        len = limit + m->len - 1;
+    while((i = matcher_next(m, text, len, i)) >= 0){
+        if(match_list_add(results, i + offset, 0) != 0)
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        ++i;
+    }
+}
+
+/*Moves the match lists of every rank of comm to rank 0, as results_collect()
+  does for RESULTS_GATHER, but without printing them
+ @return: the number of matches of all ranks on rank 0
+*/
+long gather_matches(const struct match_list *l, MPI_Comm comm){
+    int id, p, k, bytes = (int) l->len;
+    int *counts = NULL, *displs = NULL;
+    long total = 0;
+    unsigned char *all = NULL;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+    if(id == 0){
+        counts = malloc(p * sizeof(int));
+        displs = malloc(p * sizeof(int));
+    }
+    MPI_Gather(&bytes, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+    if(id == 0){
+        displs[0] = 0;
+        for(k = 1; k < p; ++k)
+            displs[k] = displs[k - 1] + counts[k - 1];
+        all = malloc(displs[p - 1] + counts[p - 1] + 1);
+    }
+    MPI_Gatherv(l->data, bytes, MPI_BYTE, all, counts, displs, MPI_BYTE, 0, comm);
+    MPI_Reduce(&l->count, &total, 1, MPI_LONG, MPI_SUM, 0, comm);
+    free(all);
+    free(displs);
+    free(counts);
+    return total;
+}
+
+/*Reads and searches the text once on comm with the given input mode
+ @post: times holds this rank's read, scan and collect time, and *matches
+        the number of matches on rank 0
+ @return: 0, or -1 on every rank if the text could not be read
+*/
+int run_trial(MPI_Comm comm, const struct matcher *m, const char *path, long n, int input,
+              long chunk, double *times, long *matches){
+    struct text_window local;
+    struct text_stream stream;
+    struct text_queue queue;
+    struct match_list found;
+    const char *text;
+    long len, first, limit;
+    double t0, t1;
+
+    match_list_init(&found, 0, RESULTS_GATHER);
+    times[0] = times[1] = 0.0;
+    if(TEXT_IO_STREAM == input || TEXT_IO_DYNAMIC == input){
+        if(TEXT_IO_STREAM == input ? text_stream_open(&stream, path, n, m->len - 1, chunk, comm)
+                                   : text_queue_open(&queue, path, n, m->len - 1, chunk, comm))
+            return -1;
+        for(;;){
+            t0 = MPI_Wtime();
+            len = TEXT_IO_STREAM == input ? text_stream_next(&stream, &text, &first, &limit)
+                                          : text_queue_next(&queue, &text, &first, &limit);
+            t1 = MPI_Wtime();
+            times[0] += t1 - t0;
+            if(len <= 0)
+                break;
+            scan(m, text, len, limit, first, &found);
+            times[1] += MPI_Wtime() - t1;
+        }
+        if(len < 0)
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        if(TEXT_IO_STREAM == input)
+            text_stream_close(&stream);
+        else
+            text_queue_close(&queue);
+    }
+    else {
+        t0 = MPI_Wtime();
+        if(text_window_read(&local, path, n, m->len - 1, input, comm) != 0)
+            return -1;
+        t1 = MPI_Wtime();
+        scan(m, local.text, local.len, local.owned, local.first, &found);
+        times[0] = t1 - t0;
+        times[1] = MPI_Wtime() - t1;
+        text_window_free(&local);
+    }
+
+    t0 = MPI_Wtime();
+    *matches = gather_matches(&found, comm);
+    times[2] = MPI_Wtime() - t0;
+    match_list_free(&found);
+    return 0;
+}
+
+/*Runs one configuration on comm
+ @post: on rank 0 of comm, stats describes the timed trials
+ @return: 0, or -1 on every rank if the text could not be read
+*/
+int run_config(MPI_Comm comm, const struct matcher *m, const char *path, long n, int input,
+               long chunk, int warmups, int trials, struct bench_stats *stats){
+    int id, p, k;
+    double t0, wall;
+    double times[3]; //read, scan and collect time of this rank
+    double sums[3], maxes[3], read_min;
+    double *w = NULL, *r_max = NULL, *dist = NULL, *s_max = NULL, *s_mean = NULL, *coll = NULL;
+    long matches = 0;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+
+    if(id == 0){
+        w = malloc(6 * trials * sizeof(double));
+        r_max = w + trials;
+        dist = r_max + trials;
+        s_max = dist + trials;
+        s_mean = s_max + trials;
+        coll = s_mean + trials;
+    }
+
+    for(k = -warmups; k < trials; ++k){
+        MPI_Barrier(comm);
+        t0 = MPI_Wtime();
+        if(run_trial(comm, m, path, n, input, chunk, times, &matches) != 0){
+            free(w);
+            return -1;
+        }
+        //The root leaves the gather last, so its time is the wall time
+        wall = MPI_Wtime() - t0;
+
+        //Timing statistics are gathered outside the timed region
+        MPI_Reduce(times, sums, 3, MPI_DOUBLE, MPI_SUM, 0, comm);
+        MPI_Reduce(times, maxes, 3, MPI_DOUBLE, MPI_MAX, 0, comm);
+        MPI_Reduce(times, &read_min, 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+        if(id == 0 && k >= 0){
+            w[k] = wall;
+            r_max[k] = maxes[0];
+            dist[k] = maxes[0] - read_min;
+            s_max[k] = maxes[1];
+            s_mean[k] = sums[1] / p;
+            coll[k] = maxes[2];
+        }
+    }
+
+    if(id == 0){
+        qsort(w, trials, sizeof(double), compare_double);
+        qsort(r_max, trials, sizeof(double), compare_double);
+        qsort(dist, trials, sizeof(double), compare_double);
+        qsort(s_max, trials, sizeof(double), compare_double);
+        qsort(s_mean, trials, sizeof(double), compare_double);
+        qsort(coll, trials, sizeof(double), compare_double);
+        stats->wall_min = w[0];
+        stats->wall_median = percentile(w, trials, 0.5);
+        stats->read_max = percentile(r_max, trials, 0.5);
+        stats->distrib = percentile(dist, trials, 0.5);
+        stats->scan_max = percentile(s_max, trials, 0.5);
+        stats->scan_mean = percentile(s_mean, trials, 0.5);
+        stats->collect = percentile(coll, trials, 0.5);
+        stats->matches = matches;
+        free(w);
+    }
+    return 0;
+}
+
+void print_record(int json, int first, const char *path, long n, long pattern_len, int kind,
+                  int input, int ranks, int trials, const struct bench_stats *s,
+                  double efficiency){
+    double gb = n / 1e9;
+
+    if(json)
+        printf("%s\n  {\"text\": \"%s\", \"bytes\": %ld, \"pattern_len\": %ld, "
+               "\"matcher\": \"%s\", \"input\": \"%s\", \"ranks\": %d, \"trials\": %d, "
+               "\"matches\": %ld, \"wall_min\": %.6e, \"wall_median\": %.6e, "
+               "\"read\": %.6e, \"distrib\": %.6e, \"scan\": %.6e, \"scan_mean\": %.6e, "
+               "\"collect\": %.6e, \"gbps_per_rank\": %.4f, \"scan_gbps_per_rank\": %.4f, "
+               "\"efficiency\": %.4f}",
+               first ? "[" : ",", path, n, pattern_len, matcher_name(kind), text_io_name(input),
+               ranks, trials, s->matches, s->wall_min, s->wall_median, s->read_max, s->distrib,
+               s->scan_max, s->scan_mean, s->collect, gb / s->wall_median / ranks,
+               gb / s->scan_max / ranks, efficiency);
+    else
+        printf("%s,%ld,%ld,%s,%s,%d,%d,%ld,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.4f,%.4f,%.4f\n",
+               path, n, pattern_len, matcher_name(kind), text_io_name(input), ranks, trials,
+               s->matches, s->wall_min, s->wall_median, s->read_max, s->distrib, s->scan_max,
+               s->scan_mean, s->collect, gb / s->wall_median / ranks, gb / s->scan_max / ranks,
+               efficiency);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    int matcher_list[MAX_LIST] = {MATCHER_MEMCHR, MATCHER_HORSPOOL, MATCHER_TWOWAY, MATCHER_SIMD};
+    int nmatchers = 4;
+    int input_list[MAX_LIST] = {TEXT_IO_SEND, TEXT_IO_MMAP, TEXT_IO_MPIIO, TEXT_IO_STREAM,
+                                TEXT_IO_DYNAMIC};
+    int ninputs = 5;
+    long rank_list[MAX_LIST];
+    int nranks = 0;
+    long chunk = 0; //bytes read at once by stream and dynamic, 0 for their default
+    int warmups = 1;
+    int trials = 5;
+    int json = 0;
+
+    while((opt = getopt(argc, argv, "m:i:R:c:w:N:F:")) != -1){
+        switch(opt){
+        case 'm':
+            nmatchers = parse_names(optarg, matcher_parse, matcher_list, MAX_LIST);
+            break;
+        case 'i':
+            ninputs = parse_names(optarg, text_io_parse, input_list, MAX_LIST);
+            break;
+        case 'R':
+            nranks = parse_list(optarg, rank_list, MAX_LIST);
+            if(nranks < 1){
+                printf("Bad rank list %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'c':
+            chunk = parse_size(optarg);
+            break;
+        case 'w':
+            warmups = atoi(optarg);
+            break;
+        case 'N':
+            trials = atoi(optarg);
+            break;
+        case 'F':
+            json = strcmp(optarg, "json") == 0;
+            break;
+        default:
+            exit(1);
+        }
+    }
+    if(nmatchers < 1 || ninputs < 1 || chunk < 0 || trials < 1 || warmups < 0){
+        printf("Bad matchers, inputs, chunk, trials or warm-ups. Exiting.\n");
+        exit(1);
+    }
+    if(argc - optind < 2 || (argc - optind) % 2 != 0){
+        printf("Give search strings and text files in pairs. Exiting.\n");
+        exit(1);
+    }
+
+    int id; //procedure id
+    int p; //num procedures
+    int r, t, j, i, kind, first = 1;
+    long n, pattern_len;
+    double base_cost; //wall time times ranks of the first rank count run
+    char *pattern, *path;
+    struct stat statbuff;
+    struct matcher m;
+    MPI_Comm sub;
+    struct bench_stats stats;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &id);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+
+    //Default rank counts: powers of two below p, then p
+    if(nranks == 0){
+        for(r = 1; r < p && nranks < MAX_LIST - 1; r *= 2)
+            rank_list[nranks++] = r;
+        rank_list[nranks++] = p;
+    }
+
+    if(id == 0 && !json)
+        printf("text,bytes,pattern_len,matcher,input,ranks,trials,matches,wall_min,wall_median,"
+               "read,distrib,scan,scan_mean,collect,gbps_per_rank,scan_gbps_per_rank,efficiency\n");
+
+    for(t = optind; t < argc; t += 2){
+        pattern = argv[t];
+        path = argv[t + 1];
+        pattern_len = (long) strlen(pattern);
+        if(stat(path, &statbuff) == -1 || pattern_len < 1 || pattern_len > statbuff.st_size){
+            if(id == 0)
+                fprintf(stderr, "Skipping %s: cannot stat it, or the search string does not fit\n",
+                        path);
+            continue;
+        }
+        n = (long) statbuff.st_size;
+
+        for(j = 0; j < nmatchers; ++j){
+            kind = matcher_init(&m, pattern, pattern_len, matcher_list[j]);
+            for(i = 0; i < ninputs; ++i){
+                base_cost = 0.0;
+                for(r = 0; r < nranks; ++r){
+                    if(rank_list[r] < 1 || rank_list[r] > p){
+                        if(id == 0)
+                            fprintf(stderr, "Skipping %ld ranks, only %d available\n",
+                                    rank_list[r], p);
+                        continue;
+                    }
+
+                    //The first rank_list[r] ranks run the configuration, the rest wait
+                    MPI_Comm_split(MPI_COMM_WORLD, id < rank_list[r] ? 0 : MPI_UNDEFINED, id, &sub);
+                    int ret = 0;
+                    if(MPI_COMM_NULL != sub){
+                        ret = run_config(sub, &m, path, n, input_list[i], chunk, warmups, trials,
+                                         &stats);
+                        MPI_Comm_free(&sub);
+                    }
+                    MPI_Bcast(&ret, 1, MPI_INT, 0, MPI_COMM_WORLD);
+                    if(ret != 0){
+                        if(id == 0)
+                            fprintf(stderr, "Could not read %s with %s\n", path,
+                                    text_io_name(input_list[i]));
+                        break;
+                    }
+                    if(id == 0){
+                        if(base_cost == 0.0)
+                            base_cost = stats.wall_median * rank_list[r];
+                        print_record(json, first, path, n, pattern_len, kind, input_list[i],
+                                     (int) rank_list[r], trials, &stats,
+                                     base_cost / (stats.wall_median * rank_list[r]));
+                        first = 0;
+                    }
+                    MPI_Barrier(MPI_COMM_WORLD);
+                }
+            }
+        }
+    }
+
+    if(id == 0 && json)
+        printf("%s\n", first ? "[]" : "\n]");
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Builds the q-gram index of a text file that search_text_alt.c -I answers
+// queries from, so that the same text can be searched many times without
+// being read whole each time. Every rank indexes its own section of the text
+// and the index is written with one collective MPI-IO write; see
+// qgram_index.h for what it holds and the layout of the file.
+//
+// BUILD INSTRUCTIONS:
+//  $ mpicc -Wall -O2 -o <target filename> build_index.c
+// RUN INSTRUCTIONS:
+//  $ mpirun -np n <target filename> [-q <q>] [-s <step>] [-b <bits>] <text file> <index file>
+//
+// <q> is the number of bytes in a q-gram, from 1 to 8 (default 4). <step> is
+// the distance between the indexed q-grams (default 4): the index holds about
+// 1 / <step> of the offsets of the text, and serves search strings of at
+// least <q> + <step> - 1 bytes. <bits> is the log2 of the number of buckets
+// the q-grams are hashed into (default 20); more buckets make shorter lists
+// to read per query, at 16 bytes of table each. The text must be visible to
+// every rank, and the index file must be writable by all of them.
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "text_io.c"
+#include "qgram_index.c"
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    int q = QGRAM_Q;
+    int step = QGRAM_STEP;
+    int bits = QGRAM_BITS;
+
+    while((opt = getopt(argc, argv, "q:s:b:")) != -1){
+        switch(opt){
+        case 'q':
+            q = atoi(optarg);
+            break;
+        case 's':
+            step = atoi(optarg);
+            break;
+        case 'b':
+            bits = atoi(optarg);
+            break;
+        default:
+            exit(1);
+        }
+    }
+    if(argc - optind < 2){
+        printf("Too few arguments. Exiting.\n");
+        exit(1);
+    }
+    if(q < 1 || q > 8 || step < 1 || bits < 1 || bits > 30){
+        printf("Bad q, step or bits. Exiting.\n");
+        exit(1);
+    }
+
+    int id; //procedure id
+    char *textFile = argv[optind];
+    char *indexFile = argv[optind + 1];
+    struct stat statbuff;
+    struct qgram_index ix;
+    double e_time;
+
+    if(stat(textFile, &statbuff) == -1){
+        printf("Could not stat the file %s. Exiting\n", textFile);
+        exit(1);
+    }
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &id);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    e_time = - MPI_Wtime();
+    if(qgram_build(textFile, (long) statbuff.st_size, indexFile, q, step, bits, MPI_COMM_WORLD) != 0){
+        if(id == 0)
+            printf("Could not index %s in %s. Exiting\n", textFile, indexFile);
+        MPI_Finalize();
+        exit(1);
+    }
+    e_time += MPI_Wtime();
+
+    if(id == 0){
+        if(qgram_open(&ix, indexFile) != 0){
+            printf("Could not read back %s. Exiting\n", indexFile);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        printf("indexed %li bytes in %f seconds: %li q-grams, %zu bytes of index\n",
+               (long) statbuff.st_size, e_time, (long) ix.header->postings, ix.map_len);
+        qgram_close(&ix);
+    }
+    MPI_Finalize();
+}
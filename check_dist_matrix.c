@@ -0,0 +1,255 @@
+// Checks the distributed matrix layer: a matrix is scattered from rank 0 in
+// every layout, moved into every other layout, and gathered back, and each
+// step must leave every element where the index mapping says it is. The
+// matrix is also read straight from a file in every layout. One CSV line is
+// printed per check; the program exits with 1 if any check fails, so it can
+// gate changes to dist_matrix.c.
+//
+// BUILD INSTRUCTIONS:
+//  $ mpicc -Wall -O2 -o <target filename> check_dist_matrix.c -lm
+// RUN INSTRUCTIONS:
+//  $ mpirun -np n <target filename> [-r <rows>] [-c <cols>] [-m <mb>] [-n <nb>]
+//        [-d <directory>]
+//
+// <rows> and <cols> give the shape of the matrix (default 37 by 29, so that
+// no split comes out even). <mb> and <nb> are the block sizes of the block
+// cyclic layouts (default 3 and 4). <directory> holds the file read by the
+// load checks (default /tmp); it is removed at the end.
+//
+// The layouts checked are
+//   row        - DIST_BLOCK_ROW
+//   col        - DIST_BLOCK_COL
+//   cyclic     - DIST_BLOCK_CYCLIC on the grid MPI_Dims_create chooses
+//   cyclic-1xp - DIST_BLOCK_CYCLIC on a 1 by n grid
+//   cyclic-px1 - DIST_BLOCK_CYCLIC on an n by 1 grid
+// and the checks are
+//   scatter      - every local element is the global one its indices map to
+//   gather       - gathering the scattered matrix gives the original back
+//   redistribute - the same check as scatter, after moving the matrix from
+//                  one layout to another
+//   round-trip   - gathering the moved matrix gives the original back
+//   load         - the same check as scatter, after dist_matrix_load()
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "alloc_matrix.c"
+#include "matrix_file.c"
+#include "mpi_matrix_io.c"
+#include "dist_matrix.c"
+
+#define NLAYOUTS 5
+
+//Extra elements at the end of each row of the whole matrix, so that a wrong
+//row stride shows up
+#define PAD 3
+
+struct layout {
+    const char *name;
+    int         layout;  //DIST_*
+    int         pr;      //process grid rows, 0 to let MPI choose
+    int         pc;      //process grid columns
+};
+
+/*The value stored at (i, j) of the matrix under test
+ @return: a value no other element has
+*/
+double element(int i, int j){
+    return i * 1000.0 + j + 0.25;
+}
+
+/*Compares this rank's part of a distributed matrix with the values written
+ @return: 1 if every rank's part holds its values
+*/
+int part_matches(const struct dist_matrix *dm){
+    int match = 1;
+
+    for(int k = 0; k < dm->row.nlocal; ++k)
+        for(int l = 0; l < dm->col.nlocal; ++l){
+            int i = dist_matrix_global_row(dm, k);
+            int j = dist_matrix_global_col(dm, l);
+            if(((double *) dm->local[k])[l] != element(i, j) ||
+               dist_matrix_local_row(dm, i) != k ||
+               dist_matrix_local_col(dm, j) != l)
+                match = 0;
+        }
+    MPI_Allreduce(MPI_IN_PLACE, &match, 1, MPI_INT, MPI_LAND, dm->comm);
+    return match;
+}
+
+/*Compares a whole matrix with the values written
+ @return: 1 if every element of the rows by cols matrix holds its value
+*/
+int whole_matches(const double *whole, int rows, int cols){
+    for(int i = 0; i < rows; ++i)
+        for(int j = 0; j < cols; ++j)
+            if(whole[(size_t) i * (cols + PAD) + j] != element(i, j))
+                return 0;
+    return 1;
+}
+
+/*Prints the result of a check and counts it
+ @return: the number of failures, updated
+*/
+int report(int id, int p, const char *from, const char *to, const char *check,
+           int match, int *checks, int failures){
+    if(id == 0){
+        ++*checks;
+        printf("%d,%s,%s,%s,%s\n", p, from, to, check, match ? "pass" : "FAIL");
+        fflush(stdout);
+    }
+    return failures + !match;
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    int rows = 37, cols = 29, mb = 3, nb = 4;
+    const char *dir = "/tmp";
+
+    while((opt = getopt(argc, argv, "r:c:m:n:d:")) != -1){
+        switch(opt){
+        case 'r':
+            rows = atoi(optarg);
+            break;
+        case 'c':
+            cols = atoi(optarg);
+            break;
+        case 'm':
+            mb = atoi(optarg);
+            break;
+        case 'n':
+            nb = atoi(optarg);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            exit(1);
+        }
+    }
+    if(rows < 1 || cols < 1 || mb < 1 || nb < 1){
+        printf("Shape and block sizes must be positive. Exiting.\n");
+        exit(1);
+    }
+
+    int id; //procedure id
+    int p; //num procedures
+    int from, to, match;
+    int checks = 0, failures = 0;
+    int errval;
+    char path[4096];
+    double *whole = NULL, *back = NULL;
+    void **rowPtrs = NULL;
+    struct dist_matrix src, dst;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &id);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+
+    struct layout layouts[NLAYOUTS] = {
+        {"row",        DIST_BLOCK_ROW,    0, 0},
+        {"col",        DIST_BLOCK_COL,    0, 0},
+        {"cyclic",     DIST_BLOCK_CYCLIC, 0, 0},
+        {"cyclic-1xp", DIST_BLOCK_CYCLIC, 1, p},
+        {"cyclic-px1", DIST_BLOCK_CYCLIC, p, 1}
+    };
+
+    //The whole matrix lives on rank 0, with padded rows; a file of it is
+    //written for the load checks
+    snprintf(path, sizeof(path), "%s/check_dist_matrix.%d.bin", dir, (int) getpid());
+    MPI_Bcast(path, sizeof(path), MPI_CHAR, 0, MPI_COMM_WORLD);
+    errval = SUCCESS;
+    if(id == 0){
+        whole   = malloc((size_t) rows * (cols + PAD) * sizeof(double));
+        back    = malloc((size_t) rows * (cols + PAD) * sizeof(double));
+        rowPtrs = malloc(rows * sizeof(void *));
+        if(NULL == whole || NULL == back || NULL == rowPtrs)
+            errval = MALLOC_ERROR;
+        else{
+            for(int i = 0; i < rows; ++i){
+                rowPtrs[i] = whole + (size_t) i * (cols + PAD);
+                for(int j = 0; j < cols + PAD; ++j)
+                    whole[(size_t) i * (cols + PAD) + j] = j < cols ? element(i, j) : -1.0;
+            }
+            write_matrix_file(path, rows, cols, MATRIX_DTYPE_FLOAT64, rowPtrs, &errval);
+        }
+    }
+    MPI_Bcast(&errval, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if(SUCCESS != errval){
+        if(id == 0)
+            printf("Error %d writing %s. Exiting...\n", errval, path);
+        MPI_Finalize();
+        exit(1);
+    }
+
+    if(id == 0)
+        printf("ranks,from,to,check,status\n");
+
+    for(from = 0; from < NLAYOUTS; ++from){
+        struct layout *s = &layouts[from];
+
+        dist_matrix_create(MPI_COMM_WORLD, s->layout, rows, cols, MPI_DOUBLE,
+                           s->pr, s->pc, mb, nb, &src, &errval);
+        if(SUCCESS != errval){
+            failures = report(id, p, s->name, "-", "create", 0, &checks, failures);
+            continue;
+        }
+        dist_matrix_scatter(&src, 0, whole, cols + PAD, &errval);
+        match = SUCCESS == errval && part_matches(&src);
+        failures = report(id, p, "root", s->name, "scatter", match, &checks, failures);
+
+        if(id == 0)
+            memset(back, 0, (size_t) rows * (cols + PAD) * sizeof(double));
+        dist_matrix_gather(&src, 0, back, cols + PAD, &errval);
+        match = SUCCESS == errval && (id != 0 || whole_matches(back, rows, cols));
+        MPI_Bcast(&match, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        failures = report(id, p, s->name, "root", "gather", match, &checks, failures);
+
+        for(to = 0; to < NLAYOUTS; ++to){
+            struct layout *d = &layouts[to];
+
+            dist_matrix_create(MPI_COMM_WORLD, d->layout, rows, cols, MPI_DOUBLE,
+                               d->pr, d->pc, mb, nb, &dst, &errval);
+            if(SUCCESS != errval){
+                failures = report(id, p, s->name, d->name, "create", 0, &checks, failures);
+                continue;
+            }
+            dist_matrix_redistribute(&src, &dst, &errval);
+            match = SUCCESS == errval && part_matches(&dst);
+            failures = report(id, p, s->name, d->name, "redistribute", match,
+                              &checks, failures);
+
+            if(id == 0)
+                memset(back, 0, (size_t) rows * (cols + PAD) * sizeof(double));
+            dist_matrix_gather(&dst, 0, back, cols + PAD, &errval);
+            match = SUCCESS == errval && (id != 0 || whole_matches(back, rows, cols));
+            MPI_Bcast(&match, 1, MPI_INT, 0, MPI_COMM_WORLD);
+            failures = report(id, p, s->name, d->name, "round-trip", match,
+                              &checks, failures);
+            dist_matrix_free(&dst);
+        }
+        dist_matrix_free(&src);
+
+        dist_matrix_load(path, MPI_COMM_WORLD, s->layout, s->pr, s->pc, mb, nb,
+                         &src, &errval);
+        match = SUCCESS == errval && part_matches(&src);
+        failures = report(id, p, "file", s->name, "load", match, &checks, failures);
+        if(SUCCESS == errval)
+            dist_matrix_free(&src);
+    }
+
+    if(id == 0){
+        unlink(path);
+        free(rowPtrs);
+        free(back);
+        free(whole);
+        fprintf(stderr, "%d checks, %d failures\n", checks, failures);
+    }
+    MPI_Bcast(&failures, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    MPI_Finalize();
+    return failures > 0;
+}
@@ -0,0 +1,278 @@
+// Checks every parallel variant of the ln(x) approximation against the serial
+// reference in riemann.c and against log(), for each rank count and partition
+// count asked for, and records the throughput of each variant. One CSV line
+// is printed per check; the program exits with 1 if any check fails, so it
+// can gate changes to the kernels.
+//
+// BUILD INSTRUCTIONS:
+//  $ mpicc -Wall -O2 -o <target filename> check_integrators.c -lm
+// RUN INSTRUCTIONS:
+//  $ mpirun -np n <target filename> [-P <partitions>] [-x <values>] [-X <values>]
+//        [-R <ranks>] [-e <tol>] [-q <tol>] [-c <panels>]
+//
+// <partitions> is a comma separated list of partition counts (default
+// 1e3,1e6,1e8; counts up to 1e10 work, though the serial reference then takes
+// a while). <values> lists the x whose log is checked (default 2,10,1000).
+// -X lists large x (default 1e40,1e300), beyond the range of a float, that
+// are checked only with cyclic, block-<kernel> and midpoint against the
+// reference: the vector kernels must not lose them in their single precision
+// estimates, while the other rules cannot get near log(x) on so wide a range.
+// <ranks> lists the rank counts to check on (default every count 1..n).
+//
+// The checks are:
+//   cyclic, block-<kernel>, midpoint - within a relative difference of
+//       <tol> (default 1e-13) plus sqrt(<partitions>) ulps of the reference,
+//       which must itself be within the midpoint rule's truncation bound of
+//       log(x). The ulps allow for the plain sums of the variants against the
+//       compensated sum of the reference; a partition lost or added at either
+//       end changes the result by about 1/<partitions>, far more.
+//   simpson, gauss - within twice their own error estimate of log(x), plus
+//       <tol> relative for rounding; run only up to <panels> (default 1e7)
+//   romberg, adaptive - within <tol> given by -q (default 1e-12) of log(x)
+// Every check also allows 16 ulps of log(x) + 1 for rounding of the result.
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <unistd.h>
+#include "riemann.c"
+#include "quadrature.c"
+
+#define MAX_LIST 64
+
+//Variants that are not quadrature rules; the rules follow as QUAD_* + 2
+#define VARIANT_CYCLIC 0
+#define VARIANT_BLOCK  1
+#define VARIANT_RULE   2
+
+/*Parses a comma separated list of numbers, which may be written as 1e9
+ @return: the number of values stored in list, at most max, or -1
+*/
+int parse_list(const char *str, double *list, int max){
+    char *end;
+    int n = 0;
+
+    while(n < max && *str != '\0'){
+        list[n++] = strtod(str, &end);
+        if(end == str)
+            return -1;
+        str = *end == ',' ? end + 1 : end;
+    }
+    return n;
+}
+
+/*Runs one variant on comm
+ @post: on rank 0 of comm, res holds the summed result, error estimate and
+        evaluations, and the return value is the slowest rank's compute time
+*/
+double run_variant(MPI_Comm comm, int variant, long partitions, double trg, double qtol,
+                   struct quad_result *res){
+    int id, p;
+    double e_time, max_time;
+    double local[3], total[3];
+    struct quad_result part;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+
+    MPI_Barrier(comm);
+    e_time = - MPI_Wtime();
+    if(VARIANT_CYCLIC == variant){
+        local[0] = approx_log_cyclic(partitions, trg, id, p);
+        local[1] = 0.0;
+        local[2] = (double) partitions / p;
+    }
+    else if(VARIANT_BLOCK == variant){
+        local[0] = approx_log_block(partitions, trg, id, p);
+        local[1] = 0.0;
+        local[2] = (double) partitions / p;
+    }
+    else {
+        approx_log_quad(variant - VARIANT_RULE, partitions, qtol, trg, id, p, &part);
+        local[0] = part.value;
+        local[1] = part.error;
+        local[2] = (double) part.evals;
+    }
+    e_time += MPI_Wtime();
+
+    MPI_Reduce(local, total, 3, MPI_DOUBLE, MPI_SUM, 0, comm);
+    MPI_Reduce(&e_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    res->value = total[0];
+    res->error = total[1];
+    res->evals = (long) total[2];
+    return max_time;
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    double part_list[MAX_LIST] = {1e3, 1e6, 1e8};
+    int nparts = 3;
+    double trg_list[2 * MAX_LIST] = {2, 10, 1000};
+    int ntrgs = 3;
+    double big_list[MAX_LIST] = {1e40, 1e300};
+    int nbigs = 2;
+    double rank_list[MAX_LIST];
+    int nranks = 0;
+    double tol = 1e-13; //relative difference allowed from the reference
+    double qtol = 1e-12; //absolute error asked of romberg and adaptive
+    double max_panels = 1e7; //largest panel count for simpson and gauss
+
+    while((opt = getopt(argc, argv, "P:x:X:R:e:q:c:")) != -1){
+        switch(opt){
+        case 'P':
+            nparts = parse_list(optarg, part_list, MAX_LIST);
+            break;
+        case 'x':
+            ntrgs = parse_list(optarg, trg_list, MAX_LIST);
+            break;
+        case 'X':
+            nbigs = parse_list(optarg, big_list, MAX_LIST);
+            break;
+        case 'R':
+            nranks = parse_list(optarg, rank_list, MAX_LIST);
+            break;
+        case 'e':
+            tol = atof(optarg);
+            break;
+        case 'q':
+            qtol = atof(optarg);
+            break;
+        case 'c':
+            max_panels = atof(optarg);
+            break;
+        default:
+            exit(1);
+        }
+    }
+    if(nparts < 1 || ntrgs < 1 || nbigs < 0 || nranks < 0){
+        printf("Bad list of partitions, values or ranks. Exiting.\n");
+        exit(1);
+    }
+
+    int id; //procedure id
+    int p; //num procedures
+    int i, j, r, k, variant, kernel;
+    int checks = 0, failures = 0;
+    int large;
+    long partitions;
+    double trg, ref, ref_time, exact, dx, rounding;
+    double seconds = 0.0, diff, bound, err;
+    const char *name;
+    char label[32];
+    MPI_Comm sub;
+    struct quad_result res;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &id);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+
+    //The large values follow the others in one list
+    for(i = 0; i < nbigs; ++i)
+        trg_list[ntrgs + i] = big_list[i];
+
+    if(nranks == 0)
+        for(r = 1; r <= p && nranks < MAX_LIST; ++r)
+            rank_list[nranks++] = r;
+
+    if(id == 0)
+        printf("ranks,partitions,x,variant,value,error_log,diff_ref,bound,seconds,evals_per_sec,status\n");
+
+    for(i = 0; i < nparts; ++i){
+        partitions = (long) part_list[i];
+        for(j = 0; j < ntrgs + nbigs; ++j){
+            trg = trg_list[j];
+            large = j >= ntrgs;
+            if(partitions < 1 || trg < 1){
+                if(id == 0)
+                    fprintf(stderr, "Skipping %ld partitions of x = %g\n", partitions, trg);
+                continue;
+            }
+            exact = log(trg);
+            rounding = 16 * DBL_EPSILON * (exact + 1);
+
+            //The serial reference, and its distance from log(): the midpoint
+            // error on a panel [a, a+dx] is at most dx^3/24 * 2/a^3, which
+            // sums to at most dx^2/12 * (dx + (1 - 1/x^2)/2)
+            if(id == 0){
+                ref_time = - MPI_Wtime();
+                ref = approx_log_reference(partitions, trg);
+                ref_time += MPI_Wtime();
+                dx = (trg - 1.0) / (double) partitions;
+                err = fabs(ref - exact);
+                bound = dx * dx / 12 * (dx + (1 - 1 / (trg * trg)) / 2) + rounding;
+                ++checks;
+                if(err > bound)
+                    ++failures;
+                printf("1,%ld,%.17g,reference,%.17g,%.3e,0,%.3e,%.6f,%.4e,%s\n",
+                       partitions, trg, ref, err, bound, ref_time, partitions / ref_time,
+                       err > bound ? "FAIL" : "pass");
+            }
+            MPI_Bcast(&ref, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+            for(r = 0; r < nranks; ++r){
+                if(rank_list[r] < 1 || rank_list[r] > p)
+                    continue;
+                MPI_Comm_split(MPI_COMM_WORLD, id < rank_list[r] ? 0 : MPI_UNDEFINED, id, &sub);
+
+                for(variant = VARIANT_CYCLIC;
+                    variant <= VARIANT_RULE + (large ? QUAD_MIDPOINT : QUAD_ADAPTIVE); ++variant){
+                    //The block variant is run once per kernel the CPU has
+                    for(k = KERNEL_SCALAR; k <= (VARIANT_BLOCK == variant ? KERNEL_AVX512 : KERNEL_SCALAR); ++k){
+                        kernel = select_midpoint_kernel(k);
+                        if(kernel != k)
+                            continue;
+                        if((variant == VARIANT_RULE + QUAD_SIMPSON ||
+                            variant == VARIANT_RULE + QUAD_GAUSS_LEGENDRE) && partitions > max_panels)
+                            continue;
+
+                        if(MPI_COMM_NULL != sub)
+                            seconds = run_variant(sub, variant, partitions, trg, qtol, &res);
+                        if(id != 0)
+                            continue;
+
+                        if(VARIANT_CYCLIC == variant)
+                            name = "cyclic";
+                        else if(VARIANT_BLOCK == variant){
+                            snprintf(label, sizeof(label), "block-%s", midpoint_kernel_name(kernel));
+                            name = label;
+                        }
+                        else
+                            name = quad_rule_name(variant - VARIANT_RULE);
+
+                        err = fabs(res.value - exact);
+                        diff = fabs(res.value - ref) / ref;
+                        if(variant <= VARIANT_RULE + QUAD_MIDPOINT)
+                            bound = tol + sqrt((double) partitions) * DBL_EPSILON;
+                        else if(variant <= VARIANT_RULE + QUAD_GAUSS_LEGENDRE)
+                            bound = 2 * res.error + tol * exact + rounding;
+                        else
+                            bound = qtol + rounding;
+                        ++checks;
+                        if((variant <= VARIANT_RULE + QUAD_MIDPOINT ? diff : err) > bound)
+                            ++failures;
+
+                        printf("%d,%ld,%.17g,%s,%.17g,%.3e,%.3e,%.3e,%.6f,%.4e,%s\n",
+                               (int) rank_list[r], partitions, trg, name, res.value, err, diff,
+                               bound, seconds, res.evals / seconds,
+                               (variant <= VARIANT_RULE + QUAD_MIDPOINT ? diff : err) > bound ?
+                               "FAIL" : "pass");
+                        fflush(stdout);
+                    }
+                }
+                if(MPI_COMM_NULL != sub)
+                    MPI_Comm_free(&sub);
+            }
+        }
+    }
+
+    if(id == 0)
+        fprintf(stderr, "%d checks, %d failures\n", checks, failures);
+    MPI_Bcast(&failures, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    MPI_Finalize();
+    return failures > 0;
+}
@@ -0,0 +1,363 @@
+// Checks the matrix file readers against damaged files: a matrix is written
+// in the version 1 format and in the packed symmetric format, copies of it
+// are made with one header field broken or the data cut short, and every
+// reader must refuse each copy with FILE_FORMAT_ERROR rather than map or
+// read past the data. The intact files must read back exactly. One CSV
+// line is printed per check; the program exits with 1 if any check fails,
+// so it can gate changes to the readers.
+//
+// BUILD INSTRUCTIONS:
+//  $ mpicc -Wall -O2 -o <target filename> check_matrix_io.c -lm
+// RUN INSTRUCTIONS:
+//  $ mpirun -np n <target filename> [-d <directory>]
+//
+// <directory> holds the files written for the checks (default /tmp); they
+// are removed at the end.
+//
+// The readers checked are
+//   info  - read_matrix_file_info()
+//   map   - map_matrix_file()
+//   mpiio - read_matrix_row_block(), collective over all the ranks
+//   sym   - map_sym_matrix_file(), on the packed file
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "alloc_matrix.c"
+#include "matrix_file.c"
+#include "sym_matrix.c"
+#include "mpi_matrix_io.c"
+
+#define ROWS 37
+#define COLS 29
+
+//The damaged copies of the file, each with the error every reader must give
+#define CASE_INTACT          0
+#define CASE_OFFSET_PAST_END 1
+#define CASE_OFFSET_IN_HDR   2
+#define CASE_OFFSET_ODD      3
+#define CASE_HUGE_LD         4
+#define CASE_TRUNCATED       5
+#define CASE_LEGACY_SHORT    6
+#define CASE_ALIGN_ZERO      7
+#define CASE_ROW_MISALIGNED  8
+#define NCASES               9
+
+//The cases that apply to the packed file, which has no legacy form and no
+//alignment field: the first six, with CASE_HUGE_LD breaking n instead
+#define NSYMCASES            6
+
+static const char *caseNames[NCASES] = {
+    "intact", "offset-past-end", "offset-in-header", "offset-misaligned",
+    "huge-ld", "truncated", "legacy-truncated", "alignment-zero",
+    "row-misaligned"
+};
+
+static const char *symCaseNames[NSYMCASES] = {
+    "intact", "offset-past-end", "offset-in-header", "offset-misaligned",
+    "huge-n", "truncated"
+};
+
+/*The value stored at (i, j) of the matrix under test
+ @return: a value no other element has
+*/
+double element(int i, int j){
+    return i * 1000.0 + j + 0.25;
+}
+
+/*Writes the copy of the file for one case
+ @pre: good holds the intact file of len bytes
+ @return: 0, or -1 if the copy could not be written
+*/
+int write_case(const char *path, int which, const char *good, size_t len){
+    struct matrix_file_header hdr;
+    char *copy = malloc(len);
+    size_t keep = len;
+    FILE *out;
+    int legacy[2] = {ROWS, COLS};
+    int ok;
+
+    memcpy(copy, good, len);
+    memcpy(&hdr, good, sizeof(hdr));
+    switch(which){
+    case CASE_OFFSET_PAST_END:
+        hdr.data_offset = len + MATRIX_FILE_ALIGN;
+        break;
+    case CASE_OFFSET_IN_HDR:
+        hdr.data_offset = 0;
+        break;
+    case CASE_OFFSET_ODD:
+        hdr.data_offset -= 4;
+        break;
+    case CASE_HUGE_LD:
+        hdr.ld = (uint64_t) 1 << 62;
+        break;
+    case CASE_TRUNCATED:
+        keep = len - sizeof(double);
+        break;
+    case CASE_ALIGN_ZERO:
+        hdr.alignment = 0;
+        break;
+    case CASE_ROW_MISALIGNED:
+        //data_offset is still a multiple of this, the row stride is not
+        hdr.alignment = MATRIX_FILE_ALIGN;
+        break;
+    }
+    memcpy(copy, &hdr, sizeof(hdr));
+
+    out = fopen(path, "wb");
+    if(NULL == out){
+        free(copy);
+        return -1;
+    }
+    if(CASE_LEGACY_SHORT == which)
+        //Original format, one double short of ROWS * COLS
+        ok = fwrite(legacy, sizeof(legacy), 1, out) == 1 &&
+             fwrite(copy + hdr.data_offset, sizeof(double), ROWS * COLS - 1, out) ==
+             ROWS * COLS - 1;
+    else
+        ok = fwrite(copy, 1, keep, out) == keep;
+    ok = fclose(out) == 0 && ok;
+    free(copy);
+    return ok ? 0 : -1;
+}
+
+/*Writes the copy of the packed file for one case
+ @pre: good holds the intact packed file of len bytes
+ @return: 0, or -1 if the copy could not be written
+*/
+int write_sym_case(const char *path, int which, const char *good, size_t len){
+    struct sym_file_header hdr;
+    size_t keep = len;
+    FILE *out;
+    int ok;
+
+    memcpy(&hdr, good, sizeof(hdr));
+    switch(which){
+    case CASE_OFFSET_PAST_END:
+        hdr.data_offset = len + MATRIX_FILE_ALIGN;
+        break;
+    case CASE_OFFSET_IN_HDR:
+        hdr.data_offset = 0;
+        break;
+    case CASE_OFFSET_ODD:
+        hdr.data_offset -= 4;
+        break;
+    case CASE_HUGE_LD:
+        hdr.n = INT_MAX;
+        break;
+    case CASE_TRUNCATED:
+        keep = len - sizeof(double);
+        break;
+    }
+
+    out = fopen(path, "wb");
+    if(NULL == out)
+        return -1;
+    ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1 &&
+         fwrite(good + sizeof(hdr), 1, keep - sizeof(hdr), out) == keep - sizeof(hdr);
+    ok = fclose(out) == 0 && ok;
+    return ok ? 0 : -1;
+}
+
+/*Reads a whole file into memory
+ @return: the contents, to be freed, or NULL if the file could not be read
+*/
+char *read_whole(const char *path, long *len){
+    FILE *in = fopen(path, "rb");
+    char *buf;
+
+    if(NULL == in)
+        return NULL;
+    fseek(in, 0, SEEK_END);
+    *len = ftell(in);
+    rewind(in);
+    buf = malloc(*len);
+    if(NULL != buf && fread(buf, 1, *len, in) != (size_t) *len){
+        free(buf);
+        buf = NULL;
+    }
+    fclose(in);
+    return buf;
+}
+
+/*Compares the rows of a matrix with the values written
+ @return: 1 if rows first .. first+nrows-1 all hold their values
+*/
+int rows_match(void **matrix, int first, int nrows){
+    for(int i = 0; i < nrows; ++i)
+        for(int j = 0; j < COLS; ++j)
+            if(((double *) matrix[i])[j] != element(first + i, j))
+                return 0;
+    return 1;
+}
+
+/*Compares the upper triangle of a packed ROWS by ROWS matrix with the
+  values written
+ @return: 1 if every element (i, j), i <= j, holds its value
+*/
+int triangle_match(const struct sym_matrix *sm){
+    if(sm->n != ROWS)
+        return 0;
+    for(int i = 0; i < ROWS; ++i)
+        for(int j = i; j < ROWS; ++j)
+            if(sym_matrix_get(sm, i, j) != element(i, j))
+                return 0;
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    const char *dir = "/tmp";
+
+    while((opt = getopt(argc, argv, "d:")) != -1){
+        switch(opt){
+        case 'd':
+            dir = optarg;
+            break;
+        default:
+            exit(1);
+        }
+    }
+
+    int id; //procedure id
+    int p; //num procedures
+    int which, want, got, match;
+    int checks = 0, failures = 0;
+    int errval;
+    char goodPath[4096], symPath[4096], path[4096];
+    char *good = NULL, *symGood = NULL;
+    long len = 0, symLen = 0;
+    void *storage = NULL;
+    void **matrix = NULL;
+    struct matrix_file_info info;
+    struct mapped_matrix mm;
+    struct matrix_block blk;
+    struct sym_matrix sm;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &id);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+
+    snprintf(goodPath, sizeof(goodPath), "%s/check_matrix_io.%d.good", dir, (int) getpid());
+    snprintf(symPath, sizeof(symPath), "%s/check_matrix_io.%d.sym", dir, (int) getpid());
+    snprintf(path, sizeof(path), "%s/check_matrix_io.%d.case", dir, (int) getpid());
+    MPI_Bcast(goodPath, sizeof(goodPath), MPI_CHAR, 0, MPI_COMM_WORLD);
+    MPI_Bcast(path, sizeof(path), MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    //The intact files, kept in memory to make the damaged copies from: the
+    //ROWS by COLS matrix, and the packed file of its first ROWS columns
+    if(id == 0){
+        alloc_matrix(ROWS, ROWS, sizeof(double), &storage, &matrix, &errval);
+        if(SUCCESS == errval){
+            for(int i = 0; i < ROWS; ++i)
+                for(int j = 0; j < ROWS; ++j)
+                    ((double *) matrix[i])[j] = element(i, j);
+            write_sym_matrix_file(symPath, ROWS, MATRIX_DTYPE_FLOAT64, matrix,
+                                  MATRIX_DTYPE_FLOAT64, &errval);
+        }
+        if(SUCCESS == errval)
+            write_matrix_file(goodPath, ROWS, COLS, MATRIX_DTYPE_FLOAT64, matrix, &errval);
+        if(SUCCESS == errval){
+            good = read_whole(goodPath, &len);
+            symGood = read_whole(symPath, &symLen);
+            if(NULL == good || NULL == symGood)
+                errval = FILE_OPEN_ERROR;
+        }
+        free(matrix);
+        free(storage);
+    }
+    MPI_Bcast(&errval, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if(SUCCESS != errval){
+        if(id == 0)
+            printf("Error %d writing %s. Exiting...\n", errval, goodPath);
+        MPI_Finalize();
+        exit(1);
+    }
+
+    if(id == 0)
+        printf("ranks,case,reader,want,got,status\n");
+
+    for(which = 0; which < NCASES; ++which){
+        want = CASE_INTACT == which ? SUCCESS : FILE_FORMAT_ERROR;
+        if(id == 0)
+            errval = write_case(path, which, good, len);
+        MPI_Bcast(&errval, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if(errval != 0){
+            if(id == 0)
+                printf("Could not write %s. Exiting...\n", path);
+            MPI_Finalize();
+            exit(1);
+        }
+
+        if(id == 0){
+            read_matrix_file_info(path, &info, &got);
+            match = got == want && (SUCCESS != got ||
+                                    (info.rows == ROWS && info.cols == COLS));
+            ++checks;
+            failures += !match;
+            printf("%d,%s,info,%d,%d,%s\n", p, caseNames[which], want, got,
+                   match ? "pass" : "FAIL");
+
+            map_matrix_file(path, MAP_HINT_NONE, &mm, &matrix, &got);
+            match = got == want && (SUCCESS != got || rows_match(matrix, 0, ROWS));
+            if(SUCCESS == got)
+                unmap_matrix_file(&mm, matrix);
+            ++checks;
+            failures += !match;
+            printf("%d,%s,map,%d,%d,%s\n", p, caseNames[which], want, got,
+                   match ? "pass" : "FAIL");
+        }
+
+        //Every rank must get the same error, and its own rows when intact
+        read_matrix_row_block(path, MPI_COMM_WORLD, 0, &blk, &matrix, &got);
+        match = got == want && (SUCCESS != got ||
+                                rows_match(matrix, blk.first_row, blk.nrows));
+        if(SUCCESS == got)
+            free_matrix_block(&blk, matrix);
+        MPI_Allreduce(MPI_IN_PLACE, &match, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+        if(id == 0){
+            ++checks;
+            failures += !match;
+            printf("%d,%s,mpiio,%d,%d,%s\n", p, caseNames[which], want, got,
+                   match ? "pass" : "FAIL");
+            fflush(stdout);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    //The packed file has only the one reader, on rank 0
+    for(which = 0; id == 0 && which < NSYMCASES; ++which){
+        want = CASE_INTACT == which ? SUCCESS : FILE_FORMAT_ERROR;
+        if(write_sym_case(path, which, symGood, symLen) != 0){
+            printf("Could not write %s.\n", path);
+            ++checks;
+            ++failures;
+            continue;
+        }
+        map_sym_matrix_file(path, MAP_HINT_NONE, &sm, &got);
+        match = got == want && (SUCCESS != got || triangle_match(&sm));
+        if(SUCCESS == got)
+            sym_matrix_free(&sm);
+        ++checks;
+        failures += !match;
+        printf("%d,%s,sym,%d,%d,%s\n", p, symCaseNames[which], want, got,
+               match ? "pass" : "FAIL");
+    }
+
+    if(id == 0){
+        unlink(path);
+        unlink(goodPath);
+        unlink(symPath);
+        free(good);
+        free(symGood);
+        fprintf(stderr, "%d checks, %d failures\n", checks, failures);
+    }
+    MPI_Bcast(&failures, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    MPI_Finalize();
+    return failures > 0;
+}
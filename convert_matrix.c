@@ -0,0 +1,81 @@
+// Converts a binary matrix file in the original format (int rows, int cols,
+// then rows*cols doubles) to the versioned, aligned format of matrix_file.h
+// so that programs can map it and use it in place.
+// With -p, writes instead only the upper triangle of the (square, symmetric)
+// matrix, packed as in sym_matrix.h, with elements of the type given:
+// float64, float32 or int16 (quantized between the least and greatest value).
+//
+// BUILD INSTRUCTIONS - gcc -Wall -o <object name> convert_matrix.c -lm
+//                      <object name> [-p float64|float32|int16]
+//                                    <input matrix file> <output matrix file>
+
+
+#include "matrix_file.c"
+#include "sym_matrix.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int main(int argc, char* argv[])
+{
+    int packed = 0;
+    int c;
+
+    while((c = getopt(argc, argv, "p:")) != -1){
+        switch(c){
+            case 'p':
+                if(strcmp(optarg, "float64") == 0)
+                    packed = MATRIX_DTYPE_FLOAT64;
+                else if(strcmp(optarg, "float32") == 0)
+                    packed = MATRIX_DTYPE_FLOAT32;
+                else if(strcmp(optarg, "int16") == 0)
+                    packed = MATRIX_DTYPE_INT16;
+                else{
+                    printf("Unknown element type %s. Exiting.\n", optarg);
+                    exit(1);
+                }
+                break;
+            default:
+                exit(1);
+        }
+    }
+    if(argc - optind < 2){
+        printf("Too few arguments. Exiting.\n");
+        exit(1);
+    }
+
+    const char *inName = argv[optind], *outName = argv[optind + 1];
+    struct mapped_matrix in;
+    void **matrix;
+    int errval;
+
+    map_matrix_file(inName, MAP_HINT_SEQUENTIAL, &in, &matrix, &errval);
+    if(SUCCESS != errval){
+        printf("Error %d reading %s. Exiting...\n", errval, inName);
+        exit(1);
+    }
+
+    if(packed){
+        if(in.rows != in.cols){
+            printf("%s is %d x %d; only a square matrix can be packed. Exiting...\n",
+                   inName, in.rows, in.cols);
+            exit(1);
+        }
+        write_sym_matrix_file(outName, in.rows, in.dtype, matrix, packed, &errval);
+    }
+    else
+        write_matrix_file(outName, in.rows, in.cols, in.dtype, matrix, &errval);
+    if(SUCCESS != errval){
+        printf("Error %d writing %s. Exiting...\n", errval, outName);
+        exit(1);
+    }
+
+    if(packed)
+        printf("%s: upper triangle of %d x %d, %zu bytes per element\n", outName, in.rows, in.cols,
+               matrix_dtype_size(packed));
+    else
+        printf("%s: %d x %d, %zu bytes per element\n", outName, in.rows, in.cols, in.element_size);
+    unmap_matrix_file(&in, matrix);
+    return 0;
+}
@@ -0,0 +1,502 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "dist_matrix.h"
+
+/******************************************************************************/
+/* First global index of process iproc in a plain block split */
+static int axis_first(const struct dist_axis *a, int iproc)
+{
+    return (long) iproc * a->n / a->nprocs;
+}
+
+/******************************************************************************/
+/* Number of indices owned by process iproc */
+static int axis_count(const struct dist_axis *a, int iproc)
+{
+    if ( a->nb > 0 )
+        return block_cyclic_count(a->n, a->nb, iproc, a->nprocs);
+    return axis_first(a, iproc + 1) - axis_first(a, iproc);
+}
+
+/******************************************************************************/
+/* Global index of the k-th index owned by process iproc */
+static int axis_global(const struct dist_axis *a, int iproc, int k)
+{
+    if ( a->nb > 0 )
+        return block_cyclic_global(k, a->nb, iproc, a->nprocs);
+    return axis_first(a, iproc) + k;
+}
+
+/******************************************************************************/
+/* Process that owns global index i */
+static int axis_owner(const struct dist_axis *a, int i)
+{
+    if ( a->nb > 0 )
+        return (i / a->nb) % a->nprocs;
+    return ((long) a->nprocs * (i + 1) - 1) / a->n;
+}
+
+/******************************************************************************/
+/* Position of global index i among the indices of the process owning it */
+static int axis_local(const struct dist_axis *a, int i)
+{
+    if ( a->nb > 0 )
+        return (i / (a->nb * a->nprocs)) * a->nb + i % a->nb;
+    return i - axis_first(a, axis_owner(a, i));
+}
+
+/******************************************************************************/
+/* Global indices owned by process iproc, in increasing order */
+static int *axis_indices(const struct dist_axis *a, int iproc, int *count)
+{
+    int  k;
+    int *idx;
+
+    *count = axis_count(a, iproc);
+    idx = malloc((*count > 0 ? *count : 1) * sizeof(int));
+    for ( k = 0; k < *count; k++ )
+        idx[k] = axis_global(a, iproc, k);
+    return idx;
+}
+
+/******************************************************************************/
+/* Fill in everything about dm except its storage */
+static void setup_layout(
+        MPI_Comm            comm,
+        int                 layout,
+        int                 nrows,
+        int                 ncols,
+        MPI_Datatype        etype,
+        int                 pr,
+        int                 pc,
+        int                 mb,
+        int                 nb,
+        struct dist_matrix *dm,
+        int                *errvalue)
+{
+    int id, p;
+    int dims[2];
+    int type_size;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+    memset(dm, 0, sizeof(*dm));
+
+    switch ( layout ) {
+        case DIST_BLOCK_ROW:
+            pr = p;  pc = 1;  mb = nb = 0;
+            break;
+        case DIST_BLOCK_COL:
+            pr = 1;  pc = p;  mb = nb = 0;
+            break;
+        case DIST_BLOCK_CYCLIC:
+            if ( 0 == pr && 0 == pc ) {
+                dims[0] = dims[1] = 0;
+                MPI_Dims_create(p, 2, dims);
+                pr = dims[0];
+                pc = dims[1];
+            }
+            if ( pr * pc != p || mb < 1 || nb < 1 ) {
+                *errvalue = LAYOUT_ERROR;
+                return;
+            }
+            break;
+        default:
+            *errvalue = LAYOUT_ERROR;
+            return;
+    }
+
+    MPI_Type_size(etype, &type_size);
+    dm->comm         = comm;
+    dm->layout       = layout;
+    dm->etype        = etype;
+    dm->element_size = type_size;
+
+    dm->row.n       = nrows;
+    dm->row.nprocs  = pr;
+    dm->row.iproc   = id / pc;
+    dm->row.nb      = mb;
+    dm->row.nlocal  = axis_count(&dm->row, dm->row.iproc);
+
+    dm->col.n       = ncols;
+    dm->col.nprocs  = pc;
+    dm->col.iproc   = id % pc;
+    dm->col.nb      = nb;
+    dm->col.nlocal  = axis_count(&dm->col, dm->col.iproc);
+
+    *errvalue = SUCCESS;
+}
+
+/******************************************************************************/
+void dist_matrix_create(
+        MPI_Comm            comm,      /* ranks that share the matrix         */
+        int                 layout,    /* DIST_*                              */
+        int                 nrows,     /* rows in the whole matrix            */
+        int                 ncols,     /* columns in the whole matrix         */
+        MPI_Datatype        etype,     /* type of one element                 */
+        int                 pr,        /* process grid rows                   */
+        int                 pc,        /* process grid columns                */
+        int                 mb,        /* rows per block                      */
+        int                 nb,        /* columns per block                   */
+        struct dist_matrix *dm,        /* the distributed matrix              */
+        int                *errvalue)  /* return code for error, if any       */
+{
+    int local_err;
+
+    setup_layout(comm, layout, nrows, ncols, etype, pr, pc, mb, nb, dm, errvalue);
+    if ( SUCCESS != *errvalue )
+        return;
+
+    /* first-touch zeroing puts each rank's pages on its own NUMA node */
+    alloc_matrix_aligned(dm->row.nlocal, dm->col.nlocal, dm->element_size,
+                         ALLOC_FIRST_TOUCH, &dm->ld, &dm->storage, &dm->local,
+                         &local_err);
+    MPI_Allreduce(&local_err, errvalue, 1, MPI_INT, MPI_MAX, comm);
+    if ( SUCCESS != *errvalue && SUCCESS == local_err )
+        dist_matrix_free(dm);
+}
+
+/******************************************************************************/
+void dist_matrix_load(
+        const char         *path,      /* matrix file to read                 */
+        MPI_Comm            comm,      /* ranks that share the matrix         */
+        int                 layout,    /* DIST_*                              */
+        int                 pr,        /* process grid rows                   */
+        int                 pc,        /* process grid columns                */
+        int                 mb,        /* rows per block                      */
+        int                 nb,        /* columns per block                   */
+        struct dist_matrix *dm,        /* the distributed matrix              */
+        int                *errvalue)  /* return code for error, if any       */
+{
+    struct matrix_file_info info;
+    struct matrix_block     blk;
+    int   nr, nc;
+    int  *rows, *cols;
+
+    share_matrix_file_info(path, comm, &info, errvalue);
+    if ( SUCCESS != *errvalue )
+        return;
+
+    setup_layout(comm, layout, info.rows, info.cols, matrix_mpi_type(info.dtype),
+                 pr, pc, mb, nb, dm, errvalue);
+    if ( SUCCESS != *errvalue )
+        return;
+
+    rows = axis_indices(&dm->row, dm->row.iproc, &nr);
+    cols = axis_indices(&dm->col, dm->col.iproc, &nc);
+    read_matrix_subset(path, comm, nr, rows, nc, cols, &blk, &dm->local, errvalue);
+    free(rows);
+    free(cols);
+
+    if ( SUCCESS == *errvalue ) {
+        dm->storage = blk.storage;
+        dm->ld      = blk.ld;
+    }
+}
+
+/******************************************************************************/
+void dist_matrix_free(struct dist_matrix *dm)
+{
+    free_matrix_aligned(dm->storage, dm->local);
+    dm->storage = NULL;
+    dm->local   = NULL;
+}
+
+/******************************************************************************/
+int dist_matrix_global_row(const struct dist_matrix *dm, int k)
+{
+    return axis_global(&dm->row, dm->row.iproc, k);
+}
+
+int dist_matrix_global_col(const struct dist_matrix *dm, int k)
+{
+    return axis_global(&dm->col, dm->col.iproc, k);
+}
+
+int dist_matrix_local_row(const struct dist_matrix *dm, int i)
+{
+    if ( axis_owner(&dm->row, i) != dm->row.iproc )
+        return -1;
+    return axis_local(&dm->row, i);
+}
+
+int dist_matrix_local_col(const struct dist_matrix *dm, int j)
+{
+    if ( axis_owner(&dm->col, j) != dm->col.iproc )
+        return -1;
+    return axis_local(&dm->col, j);
+}
+
+int dist_matrix_owner(const struct dist_matrix *dm, int i, int j)
+{
+    return axis_owner(&dm->row, i) * dm->col.nprocs + axis_owner(&dm->col, j);
+}
+
+/******************************************************************************/
+/* Datatype for the part of rank r inside a whole matrix with row stride ld */
+static void rank_part_type(
+        const struct dist_matrix *dm,
+        int                       r,
+        size_t                    ld,
+        MPI_Datatype             *newtype)
+{
+    int  nr, nc;
+    int *rows = axis_indices(&dm->row, r / dm->col.nprocs, &nr);
+    int *cols = axis_indices(&dm->col, r % dm->col.nprocs, &nc);
+
+    make_subset_type(nr, rows, nc, cols, (MPI_Aint) (ld * dm->element_size),
+                     dm->etype, newtype);
+    free(rows);
+    free(cols);
+}
+
+/******************************************************************************/
+/* Block row and block column layouts need only one datatype on each side,
+   for one row or one column, so they map directly onto the v-collectives.
+   Sets *whole_type (for the whole matrix) and *part_type (for the local
+   part) and fills counts and displs, in units of those types. */
+static void block_types(
+        const struct dist_matrix *dm,
+        size_t                    ld,
+        MPI_Datatype             *whole_type,
+        MPI_Datatype             *part_type,
+        int                      *counts,
+        int                      *displs)
+{
+    const struct dist_axis *a = DIST_BLOCK_ROW == dm->layout ? &dm->row : &dm->col;
+    MPI_Datatype  t;
+    int           r;
+
+    if ( DIST_BLOCK_ROW == dm->layout ) {
+        /* one row, stretched to the row stride of each side */
+        MPI_Type_contiguous(dm->col.n, dm->etype, &t);
+        MPI_Type_create_resized(t, 0, ld * dm->element_size, whole_type);
+        MPI_Type_free(&t);
+        MPI_Type_contiguous(dm->col.n, dm->etype, &t);
+        MPI_Type_create_resized(t, 0, dm->ld * dm->element_size, part_type);
+        MPI_Type_free(&t);
+    }
+    else {
+        /* one column, shrunk to one element so columns can be interleaved */
+        MPI_Type_vector(dm->row.n, 1, ld, dm->etype, &t);
+        MPI_Type_create_resized(t, 0, dm->element_size, whole_type);
+        MPI_Type_free(&t);
+        MPI_Type_vector(dm->row.n, 1, dm->ld, dm->etype, &t);
+        MPI_Type_create_resized(t, 0, dm->element_size, part_type);
+        MPI_Type_free(&t);
+    }
+    MPI_Type_commit(whole_type);
+    MPI_Type_commit(part_type);
+
+    for ( r = 0; r < a->nprocs; r++ ) {
+        counts[r] = axis_count(a, r);
+        displs[r] = axis_first(a, r);
+    }
+}
+
+/******************************************************************************/
+/* Move data between the whole matrix on root and the parts on every rank
+   with MPI_Alltoallw, for layouts where each rank's part needs its own
+   datatype on the root. to_root selects gather instead of scatter. */
+static void root_exchange(
+        const struct dist_matrix *dm,
+        int                       root,
+        void                     *whole,
+        size_t                    ld,
+        int                       to_root)
+{
+    int           id, p, r;
+    int          *ones, *zeros;
+    MPI_Datatype *whole_types, *part_types;
+    MPI_Datatype  empty, part;
+
+    MPI_Comm_rank(dm->comm, &id);
+    MPI_Comm_size(dm->comm, &p);
+
+    ones        = malloc(p * sizeof(int));
+    zeros       = calloc(p, sizeof(int));
+    whole_types = malloc(p * sizeof(MPI_Datatype));
+    part_types  = malloc(p * sizeof(MPI_Datatype));
+
+    MPI_Type_contiguous(0, dm->etype, &empty);
+    MPI_Type_commit(&empty);
+    MPI_Type_vector(dm->row.nlocal, dm->col.nlocal, dm->ld, dm->etype, &part);
+    MPI_Type_commit(&part);
+
+    for ( r = 0; r < p; r++ ) {
+        ones[r] = 1;
+        part_types[r] = r == root ? part : empty;
+        if ( id == root )
+            rank_part_type(dm, r, ld, &whole_types[r]);
+        else
+            whole_types[r] = empty;
+    }
+
+    if ( to_root )
+        MPI_Alltoallw(dm->storage, ones, zeros, part_types,
+                      whole, ones, zeros, whole_types, dm->comm);
+    else
+        MPI_Alltoallw(whole, ones, zeros, whole_types,
+                      dm->storage, ones, zeros, part_types, dm->comm);
+
+    if ( id == root )
+        for ( r = 0; r < p; r++ )
+            MPI_Type_free(&whole_types[r]);
+    MPI_Type_free(&part);
+    MPI_Type_free(&empty);
+    free(part_types);
+    free(whole_types);
+    free(zeros);
+    free(ones);
+}
+
+/******************************************************************************/
+void dist_matrix_scatter(
+        struct dist_matrix *dm,        /* the distributed matrix              */
+        int                 root,      /* rank holding the whole matrix       */
+        const void         *matrix_storage, /* whole matrix, on root only     */
+        size_t              ld,        /* row stride of the whole matrix      */
+        int                *errvalue)  /* return code for error, if any       */
+{
+    int           p;
+    int          *counts, *displs;
+    MPI_Datatype  whole_type, part_type;
+
+    if ( DIST_BLOCK_CYCLIC == dm->layout ) {
+        root_exchange(dm, root, (void*) matrix_storage, ld, 0);
+        *errvalue = SUCCESS;
+        return;
+    }
+
+    MPI_Comm_size(dm->comm, &p);
+    counts = malloc(p * sizeof(int));
+    displs = malloc(p * sizeof(int));
+    block_types(dm, ld, &whole_type, &part_type, counts, displs);
+
+    MPI_Scatterv(matrix_storage, counts, displs, whole_type,
+                 dm->storage, DIST_BLOCK_ROW == dm->layout ? dm->row.nlocal
+                                                           : dm->col.nlocal,
+                 part_type, root, dm->comm);
+
+    MPI_Type_free(&whole_type);
+    MPI_Type_free(&part_type);
+    free(displs);
+    free(counts);
+    *errvalue = SUCCESS;
+}
+
+/******************************************************************************/
+void dist_matrix_gather(
+        const struct dist_matrix *dm,  /* the distributed matrix              */
+        int                 root,      /* rank to hold the whole matrix       */
+        void               *matrix_storage, /* whole matrix, on root only     */
+        size_t              ld,        /* row stride of the whole matrix      */
+        int                *errvalue)  /* return code for error, if any       */
+{
+    int           p;
+    int          *counts, *displs;
+    MPI_Datatype  whole_type, part_type;
+
+    if ( DIST_BLOCK_CYCLIC == dm->layout ) {
+        root_exchange(dm, root, matrix_storage, ld, 1);
+        *errvalue = SUCCESS;
+        return;
+    }
+
+    MPI_Comm_size(dm->comm, &p);
+    counts = malloc(p * sizeof(int));
+    displs = malloc(p * sizeof(int));
+    block_types(dm, ld, &whole_type, &part_type, counts, displs);
+
+    MPI_Gatherv(dm->storage, DIST_BLOCK_ROW == dm->layout ? dm->row.nlocal
+                                                          : dm->col.nlocal,
+                part_type, matrix_storage, counts, displs, whole_type,
+                root, dm->comm);
+
+    MPI_Type_free(&whole_type);
+    MPI_Type_free(&part_type);
+    free(displs);
+    free(counts);
+    *errvalue = SUCCESS;
+}
+
+/******************************************************************************/
+/* Local indices along axis 'mine' whose global index is owned by process
+   iproc along axis 'theirs'. Returns how many there are. */
+static int common_indices(
+        const struct dist_axis *mine,
+        const struct dist_axis *theirs,
+        int                     iproc,
+        int                    *idx)
+{
+    int k, count = 0;
+
+    for ( k = 0; k < mine->nlocal; k++ )
+        if ( axis_owner(theirs, axis_global(mine, mine->iproc, k)) == iproc )
+            idx[count++] = k;
+    return count;
+}
+
+/******************************************************************************/
+void dist_matrix_redistribute(
+        const struct dist_matrix *src, /* matrix in its current layout        */
+        struct dist_matrix       *dst, /* matrix in the wanted layout         */
+        int                      *errvalue) /* return code for error, if any  */
+{
+    int           p, r;
+    int           nr, nc;
+    int          *ones, *zeros;
+    int          *rows, *cols;
+    MPI_Datatype *send_types, *recv_types;
+
+    if ( src->row.n != dst->row.n || src->col.n != dst->col.n ||
+         src->element_size != dst->element_size ) {
+        *errvalue = LAYOUT_ERROR;
+        return;
+    }
+
+    MPI_Comm_size(src->comm, &p);
+    ones       = malloc(p * sizeof(int));
+    zeros      = calloc(p, sizeof(int));
+    send_types = malloc(p * sizeof(MPI_Datatype));
+    recv_types = malloc(p * sizeof(MPI_Datatype));
+    rows = malloc((src->row.nlocal + dst->row.nlocal + 1) * sizeof(int));
+    cols = malloc((src->col.nlocal + dst->col.nlocal + 1) * sizeof(int));
+
+    /* Every layout gives a rank the cross product of a set of rows and a set
+       of columns, and keeps both sets in increasing global order. So what
+       rank r needs from this rank is again a set of rows times a set of
+       columns, and both sides list it in the same order. */
+    for ( r = 0; r < p; r++ ) {
+        ones[r] = 1;
+
+        nr = common_indices(&src->row, &dst->row, r / dst->col.nprocs, rows);
+        nc = common_indices(&src->col, &dst->col, r % dst->col.nprocs, cols);
+        make_subset_type(nr, rows, nc, cols,
+                         (MPI_Aint) (src->ld * src->element_size),
+                         src->etype, &send_types[r]);
+
+        nr = common_indices(&dst->row, &src->row, r / src->col.nprocs, rows);
+        nc = common_indices(&dst->col, &src->col, r % src->col.nprocs, cols);
+        make_subset_type(nr, rows, nc, cols,
+                         (MPI_Aint) (dst->ld * dst->element_size),
+                         dst->etype, &recv_types[r]);
+    }
+
+    MPI_Alltoallw(src->storage, ones, zeros, send_types,
+                  dst->storage, ones, zeros, recv_types, src->comm);
+
+    for ( r = 0; r < p; r++ ) {
+        MPI_Type_free(&send_types[r]);
+        MPI_Type_free(&recv_types[r]);
+    }
+    free(cols);
+    free(rows);
+    free(recv_types);
+    free(send_types);
+    free(zeros);
+    free(ones);
+    *errvalue = SUCCESS;
+}
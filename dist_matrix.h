@@ -0,0 +1,139 @@
+#ifndef DIST_MATRIX_H
+#define DIST_MATRIX_H
+
+#include <mpi.h>
+#include "alloc_matrix.h"
+#include "mpi_matrix_io.h"
+
+/* Layouts of a matrix spread over the ranks of a communicator. The ranks
+   form a pr by pc grid in row-major order: rank r is at grid row r / pc and
+   grid column r % pc. check_dist_matrix.c checks every layout and every
+   move between two of them. */
+#define DIST_BLOCK_ROW      0   /* p by 1 grid, rank id owns rows
+                                   floor(id*n/p) .. floor((id+1)*n/p) - 1    */
+#define DIST_BLOCK_COL      1   /* 1 by p grid, the same split of columns    */
+#define DIST_BLOCK_CYCLIC   2   /* pr by pc grid, mb by nb blocks dealt out
+                                   in turn along both dimensions             */
+
+/* How the indices of one dimension are split over one dimension of the
+   process grid */
+struct dist_axis {
+    int     n;              /* global number of indices                     */
+    int     nprocs;         /* processes along this dimension               */
+    int     iproc;          /* this process's coordinate along it           */
+    int     nb;             /* block size, 0 for a plain block split        */
+    int     nlocal;         /* indices owned by this process                */
+};
+
+struct dist_matrix {
+    MPI_Comm         comm;
+    int              layout;        /* DIST_*                               */
+    MPI_Datatype     etype;         /* type of one element                  */
+    size_t           element_size;  /* bytes per element                    */
+    struct dist_axis row;           /* split of the rows                    */
+    struct dist_axis col;           /* split of the columns                 */
+    size_t           ld;            /* padded local row length, in elements */
+    void            *storage;       /* linear storage of the local part     */
+    void           **local;         /* local[k][l] is global element
+                                       (global_row(k), global_col(l))       */
+};
+
+/******************************************************************************/
+/** dist_matrix_create(comm, layout, r, c, etype, pr, pc, mb, nb, &dm, &err)
+ *  Collective over comm. Sets up dm as an r by c matrix of etype elements
+ *  in the given layout and allocates this rank's zeroed, aligned part.
+ *  pr, pc, mb and nb are only used by DIST_BLOCK_CYCLIC; pass 0 for pr and
+ *  pc to let MPI_Dims_create choose the grid.
+ */
+void dist_matrix_create(
+        MPI_Comm            comm,      /* ranks that share the matrix         */
+        int                 layout,    /* DIST_*                              */
+        int                 nrows,     /* rows in the whole matrix            */
+        int                 ncols,     /* columns in the whole matrix         */
+        MPI_Datatype        etype,     /* type of one element                 */
+        int                 pr,        /* process grid rows                   */
+        int                 pc,        /* process grid columns                */
+        int                 mb,        /* rows per block                      */
+        int                 nb,        /* columns per block                   */
+        struct dist_matrix *dm,        /* the distributed matrix              */
+        int                *errvalue   /* return code for error, if any       */
+        );
+
+/******************************************************************************/
+/** dist_matrix_load(path, comm, layout, pr, pc, mb, nb, &dm, &err)
+ *  Like dist_matrix_create(), with the shape and element type taken from
+ *  the matrix file at path, whose elements are read straight into each
+ *  rank's part with one collective MPI-IO read.
+ */
+void dist_matrix_load(
+        const char         *path,      /* matrix file to read                 */
+        MPI_Comm            comm,      /* ranks that share the matrix         */
+        int                 layout,    /* DIST_*                              */
+        int                 pr,        /* process grid rows                   */
+        int                 pc,        /* process grid columns                */
+        int                 mb,        /* rows per block                      */
+        int                 nb,        /* columns per block                   */
+        struct dist_matrix *dm,        /* the distributed matrix              */
+        int                *errvalue   /* return code for error, if any       */
+        );
+
+/******************************************************************************/
+/** dist_matrix_free(&dm)
+ *  Releases this rank's part of the matrix.
+ */
+void dist_matrix_free(struct dist_matrix *dm);
+
+/******************************************************************************/
+/** Index mapping. The global_* functions map a local index of this rank to
+ *  a global one. The local_* functions map a global index to a local one,
+ *  or return -1 if this rank does not own it. dist_matrix_owner() returns
+ *  the rank that owns global element (i, j).
+ */
+int dist_matrix_global_row(const struct dist_matrix *dm, int k);
+int dist_matrix_global_col(const struct dist_matrix *dm, int k);
+int dist_matrix_local_row(const struct dist_matrix *dm, int i);
+int dist_matrix_local_col(const struct dist_matrix *dm, int j);
+int dist_matrix_owner(const struct dist_matrix *dm, int i, int j);
+
+/******************************************************************************/
+/** dist_matrix_scatter(&dm, root, Mstorage, ld, &err)
+ *  Collective over dm.comm. Sends every rank its part of the whole matrix
+ *  held at Mstorage on root, whose rows are ld elements apart. Elements go
+ *  straight from the root's storage into the local storage through derived
+ *  datatypes; nothing is packed. Mstorage is ignored on other ranks.
+ */
+void dist_matrix_scatter(
+        struct dist_matrix *dm,        /* the distributed matrix              */
+        int                 root,      /* rank holding the whole matrix       */
+        const void         *matrix_storage, /* whole matrix, on root only     */
+        size_t              ld,        /* row stride of the whole matrix      */
+        int                *errvalue   /* return code for error, if any       */
+        );
+
+/******************************************************************************/
+/** dist_matrix_gather(&dm, root, Mstorage, ld, &err)
+ *  The inverse of dist_matrix_scatter(): collects every rank's part into
+ *  the whole matrix at Mstorage on root.
+ */
+void dist_matrix_gather(
+        const struct dist_matrix *dm,  /* the distributed matrix              */
+        int                 root,      /* rank to hold the whole matrix       */
+        void               *matrix_storage, /* whole matrix, on root only     */
+        size_t              ld,        /* row stride of the whole matrix      */
+        int                *errvalue   /* return code for error, if any       */
+        );
+
+/******************************************************************************/
+/** dist_matrix_redistribute(&src, &dst, &err)
+ *  Collective over src.comm. Copies the elements of src into dst, which must
+ *  have the same shape, element type and communicator but may have any
+ *  layout. Every pair of ranks exchanges exactly the elements they have in
+ *  common in one MPI_Alltoallw().
+ */
+void dist_matrix_redistribute(
+        const struct dist_matrix *src, /* matrix in its current layout        */
+        struct dist_matrix       *dst, /* matrix in the wanted layout         */
+        int                      *errvalue /* return code for error, if any   */
+        );
+
+#endif
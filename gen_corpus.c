@@ -0,0 +1,219 @@
+// Writes a synthetic text for benchmarking the search programs, the same for
+// the same arguments on every machine. The bytes are drawn from an alphabet
+// of the first <alphabet> symbols of
+//   abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789
+// followed by the other printable characters and then the remaining bytes,
+// with the k-th symbol drawn with weight 1 / (k + 1)^<skew>. A pattern may
+// be planted <density> times in every MiB, at random offsets, to give a
+// known number of matches.
+//
+// BUILD INSTRUCTIONS - gcc -Wall -O2 -o <object name> gen_corpus.c -lm
+//                      <object name> [-n <size>] [-a <alphabet>] [-z <skew>] [-p <pattern>] [-d <density>] [-S <seed>] <output file>
+//
+// <size> is the size of the text in bytes (default 100m; suffixes k, m and g
+// allowed). <alphabet> is from 1 to 256 (default 62). <skew> is 0 (default)
+// for uniform bytes, of log2(<alphabet>) bits of entropy each; larger values
+// lower the entropy, as in natural text. <density> is the number of copies of
+// <pattern> planted per MiB (default 0). <seed> picks another text of the
+// same kind (default 1). One CSV line describing the text is printed:
+//   bytes,alphabet,skew,entropy_bits,pattern,planted
+//
+// Some texts worth comparing:
+//   -a 4                     DNA-like, short shifts for Horspool
+//   -a 62 -p needle -d 1000  many matches, to weigh the collection of results
+//   -a 1                     aaaa...a, the worst case of the naive and
+//                            Horspool matchers for the pattern aaab
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+
+#define BLOCK (1L << 20) //bytes generated and written at once; the density is per block
+#define TABLE_BITS 16 //log2 of the entries of the table that maps random bits to symbols
+
+static const char *firstSymbols =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+    " !\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~\n";
+
+//SplitMix64, a small generator that passes BigCrush, so that a seed gives
+// the same text everywhere
+//params: state, advanced by one step
+//returns 64 random bits
+uint64_t nextRandom(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+//Lists the 256 byte values in the order the alphabet takes them
+//params: order, set to the byte values
+void symbolOrder(unsigned char *order) {
+    int used[256] = {0};
+    int k = 0;
+
+    for(const char *s = firstSymbols; *s != '\0'; ++s){
+        order[k++] = (unsigned char) *s;
+        used[(unsigned char) *s] = 1;
+    }
+    for(int c = 0; c < 256; ++c)
+        if(!used[c])
+            order[k++] = (unsigned char) c;
+}
+
+//Fills a table mapping TABLE_BITS random bits to symbols in proportion to
+// their weights, so that drawing a byte is one lookup
+//params: table, 2^TABLE_BITS entries
+//params: order, the symbols in alphabet order
+//params: alphabet, the number of symbols used
+//params: skew, the exponent of the weights
+//returns the entropy of the symbols as drawn from the table, in bits
+double fillTable(unsigned char *table, const unsigned char *order, int alphabet, double skew) {
+    double weights[256], sum = 0.0, entropy = 0.0, q;
+    long size = 1L << TABLE_BITS, at = 0, end;
+
+    for(int k = 0; k < alphabet; ++k)
+        sum += weights[k] = pow(k + 1, -skew);
+    for(int k = 0; k < alphabet; ++k){
+        //Every symbol keeps at least one entry; the last takes the rest
+        end = k == alphabet - 1 ? size : at + (long) (weights[k] / sum * size + 0.5);
+        if(end <= at)
+            end = at + 1;
+        if(end > size - (alphabet - 1 - k))
+            end = size - (alphabet - 1 - k);
+        q = (double) (end - at) / size;
+        entropy -= q * log2(q);
+        while(at < end)
+            table[at++] = order[k];
+    }
+    return entropy;
+}
+
+//Parses a size in bytes, which may end in k, m or g
+//returns the size, or -1 if str is not a positive size
+long parseSize(const char *str) {
+    char *end;
+    long size = strtol(str, &end, 10);
+
+    switch(*end){
+    case 'g': case 'G':
+        size <<= 10;
+        /* fall through */
+    case 'm': case 'M':
+        size <<= 10;
+        /* fall through */
+    case 'k': case 'K':
+        size <<= 10;
+        ++end;
+    }
+    return (end == str || *end != '\0' || size < 1) ? -1 : size;
+}
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    long n = 100L << 20; //bytes of text
+    int alphabet = 62;
+    double skew = 0.0;
+    char *pattern = NULL;
+    long density = 0; //copies of pattern per block
+    uint64_t seed = 1;
+
+    while((opt = getopt(argc, argv, "n:a:z:p:d:S:")) != -1){
+        switch(opt){
+        case 'n':
+            n = parseSize(optarg);
+            break;
+        case 'a':
+            alphabet = atoi(optarg);
+            break;
+        case 'z':
+            skew = atof(optarg);
+            break;
+        case 'p':
+            pattern = optarg;
+            break;
+        case 'd':
+            density = atol(optarg);
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            exit(1);
+        }
+    }
+    if(argc - optind < 1){
+        printf("Too few arguments. Exiting.\n");
+        exit(1);
+    }
+    if(n < 1 || alphabet < 1 || alphabet > 256 || skew < 0 || density < 0){
+        printf("Bad size, alphabet, skew or density. Exiting.\n");
+        exit(1);
+    }
+    long patternLen = NULL == pattern ? 0 : (long) strlen(pattern);
+    if(density > 0 && (patternLen < 1 || patternLen > BLOCK)){
+        printf("A pattern of 1 byte to 1 MiB is needed to plant. Exiting.\n");
+        exit(1);
+    }
+
+    FILE *out = fopen(argv[optind], "wb");
+    if(NULL == out){
+        printf("Could not create %s. Exiting\n", argv[optind]);
+        exit(1);
+    }
+
+    unsigned char order[256];
+    unsigned char *table = malloc(1L << TABLE_BITS);
+    unsigned char *block = malloc(BLOCK);
+    uint64_t state = seed, bits;
+    long planted = 0, len, at;
+    double entropy;
+
+    symbolOrder(order);
+    entropy = fillTable(table, order, alphabet, skew);
+
+    for(long done = 0; done < n; done += len){
+        len = n - done < BLOCK ? n - done : BLOCK;
+
+        //Four symbols from each 64 random bits
+        for(at = 0; at + 4 <= len; at += 4){
+            bits = nextRandom(&state);
+            block[at]     = table[bits & 0xffff];
+            block[at + 1] = table[(bits >> 16) & 0xffff];
+            block[at + 2] = table[(bits >> 32) & 0xffff];
+            block[at + 3] = table[bits >> 48];
+        }
+        for(bits = nextRandom(&state); at < len; ++at, bits >>= 16)
+            block[at] = table[bits & 0xffff];
+
+        //Copies may overlap each other, but never the end of the block
+        if(len >= patternLen)
+            for(long k = 0; k < density; ++k){
+                memcpy(block + nextRandom(&state) % (len - patternLen + 1), pattern, patternLen);
+                ++planted;
+            }
+
+        if(fwrite(block, 1, len, out) != (size_t) len){
+            printf("Could not write %s. Exiting\n", argv[optind]);
+            exit(1);
+        }
+    }
+    if(fclose(out) != 0){
+        printf("Could not write %s. Exiting\n", argv[optind]);
+        exit(1);
+    }
+
+    printf("bytes,alphabet,skew,entropy_bits,pattern,planted\n");
+    printf("%ld,%d,%g,%.4f,%s,%ld\n", n, alphabet, skew, entropy, NULL == pattern ? "" : pattern,
+           planted);
+
+    free(block);
+    free(table);
+    return 0;
+}
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matcher.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_X86_MATCHER
+#include <immintrin.h>
+#endif
+
+#define BYTESET_BITS   (8 * sizeof(unsigned long))
+#define IN_BYTESET(s, c) ((s)[(c) / BYTESET_BITS] >> ((c) % BYTESET_BITS) & 1)
+
+static const char *matcher_names[] = {
+    "auto", "memchr", "horspool", "twoway", "simd"
+};
+
+/******************************************************************************/
+/* memchr for the first byte, which libc vectorizes, then memcmp the rest */
+static long next_memchr(const struct matcher *m, const unsigned char *text, long n, long from)
+{
+    const unsigned char *p = text + from, *end = text + n - m->len + 1;
+
+    while (p < end && (p = memchr(p, m->pat[0], end - p)) != NULL) {
+        if (memcmp(p + 1, m->pat + 1, m->len - 1) == 0)
+            return p - text;
+        p++;
+    }
+    return -1;
+}
+
+/******************************************************************************/
+/* Horspool: compare the window from its last byte and shift by how far the
+   last byte of the window is from its last occurrence in pat[0..len-2] */
+static long next_horspool(const struct matcher *m, const unsigned char *text, long n, long from)
+{
+    const unsigned char *pat = m->pat;
+    long last = m->len - 1;
+    long i;
+
+    for (i = from; i + last < n; i += m->shift[text[i + last]]) {
+        if (text[i + last] == pat[last] && memcmp(text + i, pat, last) == 0)
+            return i;
+    }
+    return -1;
+}
+
+/******************************************************************************/
+/* Two-Way, after the memmem of musl libc. The pattern is split at the
+   critical position; the right part is compared first, left to right, and a
+   mismatch at k shifts the window by k - crit. After the right part matches,
+   the left part is compared right to left, and a full match or a mismatch
+   there shifts by the period. For a periodic pattern the prefix that the
+   shift leaves aligned is remembered and not compared again, which bounds
+   the comparisons by 2n. A last byte that is not in the pattern, or that
+   occurs earlier in it, gives a Horspool-like shift first. */
+static long next_twoway(const struct matcher *m, const unsigned char *text, long n, long from)
+{
+    const unsigned char *pat = m->pat;
+    long len = m->len, crit = m->crit;
+    long i = from, k, mem = 0;
+    unsigned char c;
+
+    while (i + len <= n) {
+        c = text[i + len - 1];
+        if (!IN_BYTESET(m->byteset, c)) {
+            i += len;
+            mem = 0;
+            continue;
+        }
+        k = len - m->shift[c];
+        if (k) {
+            if (k < mem)
+                k = mem;
+            i += k;
+            mem = 0;
+            continue;
+        }
+
+        //Compare the right part
+        for (k = crit + 1 > mem ? crit + 1 : mem; k < len && pat[k] == text[i + k]; k++)
+            ;
+        if (k < len) {
+            i += k - crit;
+            mem = 0;
+            continue;
+        }
+
+        //Compare the left part
+        for (k = crit + 1; k > mem && pat[k - 1] == text[i + k - 1]; k--)
+            ;
+        if (k <= mem)
+            return i;
+        i += m->period;
+        mem = m->memory;
+    }
+    return -1;
+}
+
+/* Computes the maximal suffix of pat for one byte order (greater != 0 for
+   the reversed one). Returns its start minus one, and its period in *period. */
+static long maximal_suffix(const unsigned char *pat, long len, int greater, long *period)
+{
+    long ip = -1, jp = 0, k = 1, p = 1;
+    unsigned char a, b;
+
+    while (jp + k < len) {
+        a = pat[ip + k];
+        b = pat[jp + k];
+        if (a == b) {
+            if (k == p) {
+                jp += p;
+                k = 1;
+            }
+            else
+                k++;
+        }
+        else if (greater ? a < b : a > b) {
+            jp += k;
+            k = 1;
+            p = jp - ip;
+        }
+        else {
+            ip = jp++;
+            k = p = 1;
+        }
+    }
+    *period = p;
+    return ip;
+}
+
+static void init_twoway(struct matcher *m)
+{
+    long ms, ms2, p, p2;
+
+    ms  = maximal_suffix(m->pat, m->len, 0, &p);
+    ms2 = maximal_suffix(m->pat, m->len, 1, &p2);
+    if (ms2 > ms) {
+        ms = ms2;
+        p  = p2;
+    }
+    m->crit = ms;
+
+    //Periodic pattern: after a match, shift by the period and remember the
+    // len - period bytes that stay aligned
+    if (memcmp(m->pat, m->pat + p, ms + 1) == 0) {
+        m->period = p;
+        m->memory = m->len - p;
+    }
+    else {
+        m->period = (ms > m->len - ms - 1 ? ms : m->len - ms - 1) + 1;
+        m->memory = 0;
+    }
+}
+
+#ifdef HAVE_X86_MATCHER
+/******************************************************************************/
+/* AVX2: compare 32 windows at once on their first and last bytes and memcmp
+   only the windows where both match. The bytes in between are rarely
+   reached in text where the pattern's end bytes are not both common. */
+__attribute__((target("avx2")))
+static long next_simd(const struct matcher *m, const unsigned char *text, long n, long from)
+{
+    const unsigned char *pat = m->pat;
+    long last = m->len - 1;
+    const __m256i first_b = _mm256_set1_epi8((char) pat[0]);
+    const __m256i last_b  = _mm256_set1_epi8((char) pat[last]);
+    __m256i block_first, block_last;
+    unsigned int mask;
+    long i, j;
+
+    for (i = from; i + last + 32 <= n; i += 32) {
+        block_first = _mm256_loadu_si256((const __m256i *) (text + i));
+        block_last  = _mm256_loadu_si256((const __m256i *) (text + i + last));
+        mask = (unsigned int) _mm256_movemask_epi8(
+                   _mm256_and_si256(_mm256_cmpeq_epi8(block_first, first_b),
+                                    _mm256_cmpeq_epi8(block_last, last_b)));
+        while (mask) {
+            j = i + __builtin_ctz(mask);
+            if (memcmp(text + j + 1, pat + 1, last > 1 ? last - 1 : 0) == 0)
+                return j;
+            mask &= mask - 1;
+        }
+    }
+
+    //Fewer than 32 windows left
+    return i + last < n ? next_memchr(m, text, n, i) : -1;
+}
+#endif
+
+/******************************************************************************/
+int matcher_init(struct matcher *m, const char *pat, long len, int kind)
+{
+    const unsigned char *p = (const unsigned char *) pat;
+    int  distinct = 0;
+    long i;
+
+    if (len < 1)
+        return -1;
+
+    m->pat = p;
+    m->len = len;
+    memset(m->byteset, 0, sizeof(m->byteset));
+    for (i = 0; i < len; i++) {
+        if (!IN_BYTESET(m->byteset, p[i]))
+            distinct++;
+        m->byteset[p[i] / BYTESET_BITS] |= 1UL << (p[i] % BYTESET_BITS);
+    }
+    init_twoway(m);
+
+#ifdef HAVE_X86_MATCHER
+    __builtin_cpu_init();
+    if (MATCHER_SIMD == kind && !__builtin_cpu_supports("avx2"))
+        kind = MATCHER_AUTO;
+#else
+    if (MATCHER_SIMD == kind)
+        kind = MATCHER_AUTO;
+#endif
+    if (MATCHER_AUTO == kind) {
+        //The filter and Horspool verify candidates with memcmp, which costs
+        // up to len per window when the text looks like a repetitive pattern
+        if (len == 1)
+            kind = MATCHER_MEMCHR;
+        else if ((distinct <= 2 || m->memory > 0) && len > 16)
+            kind = MATCHER_TWOWAY;
+#ifdef HAVE_X86_MATCHER
+        else if (__builtin_cpu_supports("avx2"))
+            kind = MATCHER_SIMD;
+#endif
+        else if (distinct <= 2 || m->memory > 0)
+            kind = MATCHER_TWOWAY;
+        else
+            kind = MATCHER_HORSPOOL;
+    }
+    m->kind = kind;
+
+    switch (kind) {
+    case MATCHER_HORSPOOL:
+        for (i = 0; i < 256; i++)
+            m->shift[i] = len;
+        for (i = 0; i < len - 1; i++)
+            m->shift[p[i]] = len - 1 - i;
+        m->next = next_horspool;
+        break;
+    case MATCHER_TWOWAY:
+        for (i = 0; i < len; i++)
+            m->shift[p[i]] = i + 1;
+        m->next = next_twoway;
+        break;
+#ifdef HAVE_X86_MATCHER
+    case MATCHER_SIMD:
+        m->next = next_simd;
+        break;
+#endif
+    default:
+        m->kind = MATCHER_MEMCHR;
+        m->next = next_memchr;
+    }
+    return m->kind;
+}
+
+/******************************************************************************/
+const char *matcher_name(int kind)
+{
+    if (kind < MATCHER_AUTO || kind > MATCHER_SIMD)
+        return "unknown";
+    return matcher_names[kind];
+}
+
+int matcher_parse(const char *name)
+{
+    int kind;
+
+    for (kind = MATCHER_AUTO; kind <= MATCHER_SIMD; kind++)
+        if (strcmp(name, matcher_names[kind]) == 0)
+            return kind;
+    return -1;
+}
+
+/******************************************************************************/
+long matcher_next(const struct matcher *m, const char *text, long n, long from)
+{
+    if (from < 0)
+        from = 0;
+    if (n - from < m->len)
+        return -1;
+    return m->next(m, (const unsigned char *) text, n, from);
+}
+
+/******************************************************************************/
+long matcher_count(const struct matcher *m, const char *text, long n)
+{
+    long count = 0, i = 0;
+
+    while ((i = matcher_next(m, text, n, i)) >= 0) {
+        count++;
+        i++;
+    }
+    return count;
+}
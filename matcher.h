@@ -0,0 +1,61 @@
+#ifndef MATCHER_H
+#define MATCHER_H
+
+/* Single pattern search algorithms, selectable for testing and benchmarking */
+#define MATCHER_AUTO      0   /* chosen from the pattern, see matcher_init()  */
+#define MATCHER_MEMCHR    1   /* memchr for the first byte, then memcmp       */
+#define MATCHER_HORSPOOL  2   /* Boyer-Moore-Horspool bad character shifts    */
+#define MATCHER_TWOWAY    3   /* Crochemore-Perrin Two-Way, linear worst case */
+#define MATCHER_SIMD      4   /* AVX2 first/last byte filter, then memcmp     */
+
+struct matcher {
+    int                  kind;      /* MATCHER_* actually used               */
+    const unsigned char *pat;       /* the pattern, owned by the caller      */
+    long                 len;       /* its length in bytes                   */
+    long                 shift[256];/* Horspool: shift for the last byte;
+                                       Two-Way: 1 + last index of each byte  */
+    unsigned long        byteset[256 / (8 * sizeof(unsigned long))];
+    long                 crit;      /* Two-Way critical position             */
+    long                 period;    /* Two-Way shift after a full match      */
+    long                 memory;    /* Two-Way prefix remembered after it    */
+    long (*next)(const struct matcher *, const unsigned char *, long, long);
+};
+
+/******************************************************************************/
+/** matcher_init(m, pat, len, kind)
+ *  Prepares m to search for the len bytes at pat, which must stay valid
+ *  while m is used. MATCHER_AUTO picks memchr for a single byte and Two-Way
+ *  for patterns longer than 16 bytes that have one or two distinct bytes or
+ *  are periodic, where the others can degrade to O(n*len). Otherwise it
+ *  picks the AVX2 filter when the CPU supports it, and else Two-Way for
+ *  such patterns and Horspool for the rest. Asking for MATCHER_SIMD on a
+ *  CPU without AVX2 falls back the same way. Returns the MATCHER_* value
+ *  selected, or -1 if len < 1.
+ */
+int matcher_init(struct matcher *m, const char *pat, long len, int kind);
+
+/******************************************************************************/
+/** matcher_name(kind) / matcher_parse(name)
+ *  Convert between MATCHER_* values and the names auto, memchr, horspool,
+ *  twoway and simd. matcher_parse() returns -1 for unknown names.
+ */
+const char *matcher_name(int kind);
+int matcher_parse(const char *name);
+
+/******************************************************************************/
+/** matcher_next(m, text, n, from)
+ *  Returns the offset of the first match in the n bytes at text that starts
+ *  at or after from, or -1 if there is none. The text need not be
+ *  terminated, and nothing past text[n-1] is read. Calling it again with
+ *  from one past the last match finds overlapping matches too.
+ */
+long matcher_next(const struct matcher *m, const char *text, long n, long from);
+
+/******************************************************************************/
+/** matcher_count(m, text, n)
+ *  Returns the number of (possibly overlapping) matches in the n bytes at
+ *  text.
+ */
+long matcher_count(const struct matcher *m, const char *text, long n);
+
+#endif
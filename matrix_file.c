@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "matrix_file.h"
+
+/******************************************************************************/
+int matrix_host_endian(void)
+{
+    uint16_t probe = 1;
+
+    return *(uint8_t*) &probe ? MATRIX_ENDIAN_LITTLE : MATRIX_ENDIAN_BIG;
+}
+
+/******************************************************************************/
+size_t matrix_dtype_size(int dtype)
+{
+    switch ( dtype ) {
+        case MATRIX_DTYPE_FLOAT64:  return sizeof(double);
+        case MATRIX_DTYPE_FLOAT32:  return sizeof(float);
+        case MATRIX_DTYPE_INT16:    return sizeof(int16_t);
+        default:                    return 0;
+    }
+}
+
+/******************************************************************************/
+/* Row stride in elements for a row of ncols elements that keeps every row
+   on a MATRIX_ALIGNMENT boundary */
+static size_t file_row_ld(int ncols, size_t element_size)
+{
+    size_t unit = MATRIX_ALIGNMENT;
+    size_t bytes;
+
+    while ( unit % element_size != 0 )
+        unit += MATRIX_ALIGNMENT;
+    bytes = ((size_t) ncols * element_size + unit - 1) / unit * unit;
+
+    return bytes / element_size;
+}
+
+/******************************************************************************/
+/* Fill in info from the header of the open file fd of size file_size */
+static void read_info_fd(
+        int                      fd,
+        size_t                   file_size,
+        struct matrix_file_info *info,
+        int                     *errvalue)
+{
+    struct matrix_file_header hdr;
+    int    legacy_dims[2];
+
+    memset(info, 0, sizeof(*info));
+    info->file_size = file_size;
+    if ( file_size < sizeof(legacy_dims) ) {
+        *errvalue = FILE_FORMAT_ERROR;
+        return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    if ( file_size >= sizeof(hdr) &&
+         pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr) )
+        hdr.magic = 0;
+
+    if ( MATRIX_FILE_MAGIC == hdr.magic ) {
+        /* The data must start past the header, inside the file and on an
+           element boundary, or the rows would be misaligned or out of it.
+           The alignment promised to SIMD callers must be a power of two
+           that divides data_offset and the row stride in bytes; since it
+           divides 2^64, the stride may wrap in the product and still be
+           checked. */
+        if ( hdr.version != MATRIX_FILE_VERSION ||
+             0 == matrix_dtype_size(hdr.dtype) ||
+             hdr.rows > INT_MAX || hdr.cols > INT_MAX || hdr.ld < hdr.cols ||
+             hdr.data_offset < sizeof(hdr) || hdr.data_offset > file_size ||
+             hdr.data_offset % matrix_dtype_size(hdr.dtype) != 0 ||
+             0 == hdr.alignment || (hdr.alignment & (hdr.alignment - 1)) != 0 ||
+             hdr.data_offset % hdr.alignment != 0 ||
+             hdr.ld * matrix_dtype_size(hdr.dtype) % hdr.alignment != 0 ) {
+            *errvalue = FILE_FORMAT_ERROR;
+            return;
+        }
+        if ( hdr.endian != matrix_host_endian() ) {
+            *errvalue = FILE_ENDIAN_ERROR;
+            return;
+        }
+        info->rows        = (int) hdr.rows;
+        info->cols        = (int) hdr.cols;
+        info->ld          = hdr.ld;
+        info->dtype       = hdr.dtype;
+        info->data_offset = hdr.data_offset;
+    }
+    else if ( __builtin_bswap32(MATRIX_FILE_MAGIC) == hdr.magic ) {
+        *errvalue = FILE_ENDIAN_ERROR;
+        return;
+    }
+    else {
+        /* Original format: two ints followed by the doubles, row by row */
+        if ( pread(fd, legacy_dims, sizeof(legacy_dims), 0)
+                != (ssize_t) sizeof(legacy_dims) ||
+             legacy_dims[0] < 0 || legacy_dims[1] < 0 ) {
+            *errvalue = FILE_FORMAT_ERROR;
+            return;
+        }
+        info->rows        = legacy_dims[0];
+        info->cols        = legacy_dims[1];
+        info->ld          = legacy_dims[1];
+        info->dtype       = MATRIX_DTYPE_FLOAT64;
+        info->data_offset = sizeof(legacy_dims);
+    }
+    info->element_size = matrix_dtype_size(info->dtype);
+
+    /* rows*ld elements must fit after data_offset; divided, not multiplied,
+       so that a huge ld in a damaged header cannot overflow */
+    if ( info->data_offset > file_size ||
+         ( info->rows > 0 &&
+           info->ld > (file_size - info->data_offset) / info->element_size / info->rows ) ) {
+        *errvalue = FILE_FORMAT_ERROR;
+        return;
+    }
+    *errvalue = SUCCESS;
+}
+
+/******************************************************************************/
+void read_matrix_file_info(
+        const char              *path,     /* matrix file to inspect         */
+        struct matrix_file_info *info,     /* shape and placement of data    */
+        int                     *errvalue) /* return code for error, if any  */
+{
+    int    fd;
+    struct stat st;
+
+    fd = open(path, O_RDONLY);
+    if ( fd < 0 ) {
+        *errvalue = FILE_OPEN_ERROR;
+        return;
+    }
+    if ( fstat(fd, &st) != 0 )
+        *errvalue = FILE_OPEN_ERROR;
+    else
+        read_info_fd(fd, st.st_size, info, errvalue);
+    close(fd);
+}
+
+/******************************************************************************/
+void map_matrix_file(
+        const char            *path,     /* matrix file to map               */
+        int                    hints,    /* MAP_HINT_* options               */
+        struct mapped_matrix  *mm,       /* description of the mapping       */
+        void                ***matrix,   /* address of start of matrix       */
+        int                   *errvalue) /* return code for error, if any    */
+{
+    int    fd;
+    int    i;
+    int    map_flags = MAP_SHARED;
+    struct stat st;
+    struct matrix_file_info info;
+    char  *row;
+
+    memset(mm, 0, sizeof(*mm));
+    *matrix = NULL;
+
+    fd = open(path, O_RDONLY);
+    if ( fd < 0 ) {
+        *errvalue = FILE_OPEN_ERROR;
+        return;
+    }
+    if ( fstat(fd, &st) != 0 ) {
+        close(fd);
+        *errvalue = FILE_OPEN_ERROR;
+        return;
+    }
+
+    /* Step 1: Work out the shape and placement of the data from the header */
+    read_info_fd(fd, st.st_size, &info, errvalue);
+    if ( SUCCESS != *errvalue ) {
+        close(fd);
+        return;
+    }
+    mm->rows         = info.rows;
+    mm->cols         = info.cols;
+    mm->ld           = info.ld;
+    mm->dtype        = info.dtype;
+    mm->element_size = info.element_size;
+
+    /* Step 2: Map the whole file. The mapping keeps the file referenced,
+       so the descriptor is not needed afterwards. */
+#ifdef MAP_POPULATE
+    if ( hints & MAP_HINT_POPULATE )
+        map_flags |= MAP_POPULATE;
+#endif
+    mm->map_len = st.st_size;
+    mm->map = mmap(NULL, mm->map_len, PROT_READ, map_flags, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == mm->map ) {
+        mm->map = NULL;
+        *errvalue = MMAP_ERROR;
+        return;
+    }
+
+    if ( hints & MAP_HINT_SEQUENTIAL )
+        madvise(mm->map, mm->map_len, MADV_SEQUENTIAL);
+    if ( hints & MAP_HINT_RANDOM )
+        madvise(mm->map, mm->map_len, MADV_RANDOM);
+    if ( hints & MAP_HINT_WILLNEED )
+        madvise(mm->map, mm->map_len, MADV_WILLNEED);
+
+    mm->storage = (char*) mm->map + info.data_offset;
+
+    /* Step 3: Build the row pointers into the mapping */
+    *matrix = malloc((mm->rows > 0 ? mm->rows : 1) * sizeof(void*));
+    if ( NULL == *matrix ) {
+        munmap(mm->map, mm->map_len);
+        mm->map = NULL;
+        *errvalue = MALLOC_ERROR;
+        return;
+    }
+
+    row = mm->storage;
+    for ( i = 0; i < mm->rows; i++ ) {
+        (*matrix)[i] = row;
+        row += mm->ld * mm->element_size;
+    }
+    *errvalue = SUCCESS;
+}
+
+/******************************************************************************/
+void unmap_matrix_file(
+        struct mapped_matrix  *mm,       /* description of the mapping       */
+        void                 **matrix)   /* row pointer array                */
+{
+    if ( NULL != mm->map )
+        munmap(mm->map, mm->map_len);
+    free(matrix);
+    mm->map = NULL;
+}
+
+/******************************************************************************/
+void write_matrix_file(
+        const char  *path,      /* file to create                             */
+        int          nrows,     /* number of rows in matrix                   */
+        int          ncols,     /* number of columns in matrix                */
+        int          dtype,     /* MATRIX_DTYPE_* of the elements of M        */
+        void       **matrix,    /* row pointer array                          */
+        int         *errvalue)  /* return code for error, if any              */
+{
+    struct matrix_file_header hdr;
+    FILE   *out;
+    size_t  element_size = matrix_dtype_size(dtype);
+    size_t  row_bytes, pad_bytes;
+    char   *zeros;
+    int     i;
+    int     ok;
+
+    if ( 0 == element_size ) {
+        *errvalue = FILE_FORMAT_ERROR;
+        return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic       = MATRIX_FILE_MAGIC;
+    hdr.version     = MATRIX_FILE_VERSION;
+    hdr.dtype       = dtype;
+    hdr.endian      = matrix_host_endian();
+    hdr.alignment   = MATRIX_ALIGNMENT;
+    hdr.rows        = nrows;
+    hdr.cols        = ncols;
+    hdr.ld          = file_row_ld(ncols, element_size);
+    hdr.data_offset = MATRIX_FILE_ALIGN;
+
+    row_bytes = (size_t) ncols * element_size;
+    pad_bytes = hdr.ld * element_size - row_bytes;
+
+    /* one zero buffer serves both the header padding and the row padding */
+    zeros = calloc(MATRIX_FILE_ALIGN, 1);
+    out = fopen(path, "wb");
+    if ( NULL == out || NULL == zeros ) {
+        if ( NULL != out )
+            fclose(out);
+        free(zeros);
+        *errvalue = NULL == out ? FILE_OPEN_ERROR : MALLOC_ERROR;
+        return;
+    }
+
+    ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1 &&
+         fwrite(zeros, MATRIX_FILE_ALIGN - sizeof(hdr), 1, out) == 1;
+    for ( i = 0; ok && i < nrows; i++ ) {
+        ok = fwrite(matrix[i], 1, row_bytes, out) == row_bytes;
+        if ( ok && pad_bytes > 0 )
+            ok = fwrite(zeros, 1, pad_bytes, out) == pad_bytes;
+    }
+
+    if ( fclose(out) != 0 )
+        ok = 0;
+    free(zeros);
+    *errvalue = ok ? SUCCESS : FILE_OPEN_ERROR;
+}
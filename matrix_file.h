@@ -0,0 +1,138 @@
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "alloc_matrix.h"
+
+#define FILE_OPEN_ERROR     2
+#define FILE_FORMAT_ERROR   3
+#define FILE_ENDIAN_ERROR   4
+#define MMAP_ERROR          5
+
+/* Binary matrix file, version 1. All fields are in the byte order named by
+   'endian'; a reader on a host of the other order cannot map it in place.
+   Row i starts at byte data_offset + i*ld*element_size. data_offset and the
+   row stride are multiples of 'alignment', a power of two, so a mapping of
+   the file can be used directly by SIMD kernels; the readers refuse a file
+   that breaks this. Files without the magic number are read as
+   the original format: int rows, int cols, then rows*cols doubles. */
+#define MATRIX_FILE_MAGIC   0x54414d50u /* "PMAT" read as little endian */
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_FILE_ALIGN   4096        /* alignment of data_offset       */
+
+#define MATRIX_DTYPE_FLOAT64    1
+#define MATRIX_DTYPE_FLOAT32    2
+#define MATRIX_DTYPE_INT16      3
+
+#define MATRIX_ENDIAN_LITTLE    1
+#define MATRIX_ENDIAN_BIG       2
+
+struct matrix_file_header {
+    uint32_t magic;         /* MATRIX_FILE_MAGIC                            */
+    uint16_t version;       /* MATRIX_FILE_VERSION                          */
+    uint8_t  dtype;         /* MATRIX_DTYPE_*                               */
+    uint8_t  endian;        /* MATRIX_ENDIAN_* of the writer                */
+    uint32_t alignment;     /* alignment of data and rows, in bytes         */
+    uint32_t reserved;
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t ld;            /* row stride, in elements                      */
+    uint64_t data_offset;   /* byte offset of row 0 from start of file      */
+    uint8_t  pad[16];       /* header is 64 bytes                           */
+};
+
+/* Access hints for map_matrix_file()                                         */
+#define MAP_HINT_NONE       0x0
+#define MAP_HINT_SEQUENTIAL 0x1  /* madvise(MADV_SEQUENTIAL)                  */
+#define MAP_HINT_RANDOM     0x2  /* madvise(MADV_RANDOM)                      */
+#define MAP_HINT_WILLNEED   0x4  /* start readahead of the whole matrix       */
+#define MAP_HINT_POPULATE   0x8  /* prefault every page at map time           */
+
+struct mapped_matrix {
+    void   *map;            /* start of the mapping                         */
+    size_t  map_len;        /* length of the mapping in bytes               */
+    int     rows;
+    int     cols;
+    size_t  ld;             /* row stride, in elements                      */
+    int     dtype;          /* MATRIX_DTYPE_*                               */
+    size_t  element_size;   /* bytes per element                            */
+    void   *storage;        /* address of element [0][0] in the mapping     */
+};
+
+/* Shape and placement of the data in a matrix file, either format */
+struct matrix_file_info {
+    int     rows;
+    int     cols;
+    size_t  ld;             /* row stride in the file, in elements          */
+    int     dtype;          /* MATRIX_DTYPE_*                               */
+    size_t  element_size;   /* bytes per element                            */
+    size_t  data_offset;    /* byte offset of row 0 from start of file      */
+    size_t  file_size;      /* size of the whole file in bytes              */
+};
+
+/******************************************************************************/
+/** matrix_dtype_size(dtype)
+ *  Returns the element size in bytes of a MATRIX_DTYPE_* value, or 0 if the
+ *  value is unknown.
+ */
+size_t matrix_dtype_size(int dtype);
+
+/******************************************************************************/
+/** matrix_host_endian()
+ *  Returns the byte order of this host as a MATRIX_ENDIAN_* value.
+ */
+int matrix_host_endian(void);
+
+/******************************************************************************/
+/** read_matrix_file_info(path, &info, &err)
+ *  If &err is SUCCESS, on return info describes the matrix stored in the
+ *  file at path, which may be in either format. Only the header is read.
+ */
+void read_matrix_file_info(
+        const char              *path,     /* matrix file to inspect         */
+        struct matrix_file_info *info,     /* shape and placement of data    */
+        int                     *errvalue  /* return code for error, if any  */
+        );
+
+/******************************************************************************/
+/** map_matrix_file(path, hints, &mm, &M, &err)
+ *  If &err is SUCCESS, on return the file at path is mapped read-only and M
+ *  is a row pointer array, like the one alloc_matrix() builds, whose rows
+ *  point straight into the mapping: M[i][j] is the element in row i and
+ *  column j and no data has been copied. mm describes the mapping. hints is
+ *  an OR of MAP_HINT_* values. Release with unmap_matrix_file().
+ */
+void map_matrix_file(
+        const char            *path,     /* matrix file to map               */
+        int                    hints,    /* MAP_HINT_* options               */
+        struct mapped_matrix  *mm,       /* description of the mapping       */
+        void                ***matrix,   /* address of start of matrix       */
+        int                   *errvalue  /* return code for error, if any    */
+        );
+
+/******************************************************************************/
+/** unmap_matrix_file(&mm, M)
+ *  Releases the mapping and row pointer array returned by map_matrix_file().
+ */
+void unmap_matrix_file(
+        struct mapped_matrix  *mm,       /* description of the mapping       */
+        void                 **matrix    /* row pointer array                */
+        );
+
+/******************************************************************************/
+/** write_matrix_file(path, r, c, dtype, M, &err)
+ *  Writes the r by c matrix M, whose elements are of type dtype, to path in
+ *  the version 1 format with rows padded to MATRIX_ALIGNMENT bytes.
+ */
+void write_matrix_file(
+        const char  *path,      /* file to create                             */
+        int          nrows,     /* number of rows in matrix                   */
+        int          ncols,     /* number of columns in matrix                */
+        int          dtype,     /* MATRIX_DTYPE_* of the elements of M        */
+        void       **matrix,    /* row pointer array                          */
+        int         *errvalue   /* return code for error, if any              */
+        );
+
+#endif
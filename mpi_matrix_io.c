@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "mpi_matrix_io.h"
+
+/******************************************************************************/
+MPI_Datatype matrix_mpi_type(int dtype)
+{
+    switch ( dtype ) {
+        case MATRIX_DTYPE_FLOAT64:  return MPI_DOUBLE;
+        case MATRIX_DTYPE_FLOAT32:  return MPI_FLOAT;
+        case MATRIX_DTYPE_INT16:    return MPI_SHORT;
+        default:                    return MPI_DATATYPE_NULL;
+    }
+}
+
+/******************************************************************************/
+int block_cyclic_count(int n, int nb, int iproc, int nprocs)
+{
+    int nblocks = n / nb;                   /* number of whole blocks         */
+    int count   = (nblocks / nprocs) * nb;  /* whole rounds of blocks         */
+    int extra   = nblocks % nprocs;         /* processes with one more block  */
+
+    if ( iproc < extra )
+        count += nb;
+    else if ( iproc == extra )
+        count += n % nb;                    /* the last, partial block        */
+    return count;
+}
+
+/******************************************************************************/
+int block_cyclic_global(int k, int nb, int iproc, int nprocs)
+{
+    return ((k / nb) * nprocs + iproc) * nb + k % nb;
+}
+
+/******************************************************************************/
+void make_subset_type(
+        int           nr,        /* number of selected rows                  */
+        const int    *rows,      /* selected row indices                     */
+        int           nc,        /* number of selected columns               */
+        const int    *cols,      /* selected column indices                  */
+        MPI_Aint      row_bytes, /* distance between rows in bytes           */
+        MPI_Datatype  etype,     /* type of one element                      */
+        MPI_Datatype *newtype)   /* committed type, free with MPI_Type_free  */
+{
+    int          i, j;
+    int          nruns = 0;
+    int         *run_len, *run_start;
+    MPI_Aint    *row_displ;
+    MPI_Datatype row_type;
+
+    if ( 0 == nr || 0 == nc ) {
+        MPI_Type_contiguous(0, etype, newtype);
+        MPI_Type_commit(newtype);
+        return;
+    }
+
+    /* Step 1: One row's worth of selected columns, as runs of neighbours */
+    run_len   = malloc(nc * sizeof(int));
+    run_start = malloc(nc * sizeof(int));
+    for ( j = 0; j < nc; j++ ) {
+        if ( j > 0 && cols[j] == cols[j-1] + 1 )
+            run_len[nruns-1]++;
+        else {
+            run_start[nruns] = cols[j];
+            run_len[nruns]   = 1;
+            nruns++;
+        }
+    }
+    MPI_Type_indexed(nruns, run_len, run_start, etype, &row_type);
+
+    /* Step 2: Place a copy of it at the start of every selected row */
+    row_displ = malloc(nr * sizeof(MPI_Aint));
+    for ( i = 0; i < nr; i++ )
+        row_displ[i] = (MPI_Aint) rows[i] * row_bytes;
+    MPI_Type_create_hindexed_block(nr, 1, row_displ, row_type, newtype);
+    MPI_Type_commit(newtype);
+
+    MPI_Type_free(&row_type);
+    free(row_displ);
+    free(run_start);
+    free(run_len);
+}
+
+/******************************************************************************/
+void share_matrix_file_info(
+        const char              *path,     /* matrix file to inspect         */
+        MPI_Comm                 comm,     /* ranks that need the info       */
+        struct matrix_file_info *info,     /* shape and placement of data    */
+        int                     *errvalue) /* return code for error, if any  */
+{
+    int id;
+
+    MPI_Comm_rank(comm, &id);
+    if ( 0 == id )
+        read_matrix_file_info(path, info, errvalue);
+    MPI_Bcast(errvalue, 1, MPI_INT, 0, comm);
+    MPI_Bcast(info, sizeof(*info), MPI_BYTE, 0, comm);
+}
+
+/******************************************************************************/
+/* Collective read of the subset rows x cols of a file described by info */
+static void read_subset(
+        const char                    *path,
+        MPI_Comm                       comm,
+        const struct matrix_file_info *info,
+        int                            nr,
+        const int                     *rows,
+        int                            nc,
+        const int                     *cols,
+        struct matrix_block           *blk,
+        void                        ***matrix,
+        int                           *errvalue)
+{
+    MPI_File     fh;
+    MPI_Datatype etype, file_type, mem_type;
+    int          local_err, rc;
+
+    memset(blk, 0, sizeof(*blk));
+    blk->rows         = info->rows;
+    blk->cols         = info->cols;
+    blk->dtype        = info->dtype;
+    blk->element_size = info->element_size;
+    blk->nrows        = nr;
+    blk->ncols        = nc;
+    etype = matrix_mpi_type(info->dtype);
+
+    /* Step 1: Allocate the local matrix. Every rank must get its storage
+       before any of them starts the collective read. */
+    alloc_matrix_aligned(nr, nc, info->element_size, ALLOC_DEFAULT, &blk->ld,
+                         &blk->storage, matrix, &local_err);
+    MPI_Allreduce(&local_err, errvalue, 1, MPI_INT, MPI_MAX, comm);
+    if ( SUCCESS != *errvalue ) {
+        if ( SUCCESS == local_err )
+            free_matrix_aligned(blk->storage, *matrix);
+        *matrix = NULL;
+        return;
+    }
+
+    rc = MPI_File_open(comm, (char*) path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh);
+    if ( MPI_SUCCESS != rc ) {
+        free_matrix_aligned(blk->storage, *matrix);
+        *matrix = NULL;
+        *errvalue = FILE_OPEN_ERROR;
+        return;
+    }
+
+    /* Step 2: The file view exposes only this rank's elements, so a single
+       collective call reads them all and lets MPI-IO merge the requests of
+       all ranks into large contiguous accesses */
+    make_subset_type(nr, rows, nc, cols, (MPI_Aint) (info->ld * info->element_size),
+                     etype, &file_type);
+    MPI_Type_vector(nr, nc, blk->ld, etype, &mem_type);
+    MPI_Type_commit(&mem_type);
+
+    MPI_File_set_view(fh, (MPI_Offset) info->data_offset, etype, file_type,
+                      "native", MPI_INFO_NULL);
+    rc = MPI_File_read_at_all(fh, 0, blk->storage, 1, mem_type, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+
+    MPI_Type_free(&mem_type);
+    MPI_Type_free(&file_type);
+
+    local_err = MPI_SUCCESS == rc ? SUCCESS : MPI_IO_ERROR;
+    MPI_Allreduce(&local_err, errvalue, 1, MPI_INT, MPI_MAX, comm);
+    if ( SUCCESS != *errvalue ) {
+        free_matrix_aligned(blk->storage, *matrix);
+        *matrix = NULL;
+    }
+}
+
+/******************************************************************************/
+/* Fill idx with the n consecutive integers starting at first */
+static int *index_range(int first, int n)
+{
+    int  i;
+    int *idx = malloc((n > 0 ? n : 1) * sizeof(int));
+
+    for ( i = 0; i < n; i++ )
+        idx[i] = first + i;
+    return idx;
+}
+
+/******************************************************************************/
+void read_matrix_subset(
+        const char           *path,     /* matrix file to read               */
+        MPI_Comm              comm,     /* ranks that share the read         */
+        int                   nr,       /* number of rows this rank reads    */
+        const int            *rows,     /* increasing global row indices     */
+        int                   nc,       /* number of columns this rank reads */
+        const int            *cols,     /* increasing global column indices  */
+        struct matrix_block  *blk,      /* description of the local part     */
+        void               ***matrix,   /* address of start of local matrix  */
+        int                  *errvalue) /* return code for error, if any     */
+{
+    struct matrix_file_info info;
+
+    *matrix = NULL;
+    share_matrix_file_info(path, comm, &info, errvalue);
+    if ( SUCCESS != *errvalue )
+        return;
+    read_subset(path, comm, &info, nr, rows, nc, cols, blk, matrix, errvalue);
+}
+
+/******************************************************************************/
+void read_matrix_row_block(
+        const char           *path,     /* matrix file to read               */
+        MPI_Comm              comm,     /* ranks that share the matrix       */
+        int                   halo,     /* ghost rows wanted on each side    */
+        struct matrix_block  *blk,      /* description of the local part     */
+        void               ***matrix,   /* address of start of local matrix  */
+        int                  *errvalue) /* return code for error, if any     */
+{
+    struct matrix_file_info info;
+    int    id, p;
+    int    first, last;     /* owned rows                                    */
+    int    lo, hi;          /* rows held, ghost rows included                */
+    int   *rows, *cols;
+
+    *matrix = NULL;
+    share_matrix_file_info(path, comm, &info, errvalue);
+    if ( SUCCESS != *errvalue )
+        return;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+
+    first = (long) id * info.rows / p;
+    last  = (long) (id + 1) * info.rows / p - 1;
+    if ( last < first ) {
+        /* more ranks than rows: this rank holds nothing, not even ghosts */
+        lo = first;
+        hi = first - 1;
+    }
+    else {
+        lo = first - halo > 0 ? first - halo : 0;
+        hi = last + halo < info.rows - 1 ? last + halo : info.rows - 1;
+    }
+
+    rows = index_range(lo, hi - lo + 1);
+    cols = index_range(0, info.cols);
+    read_subset(path, comm, &info, hi - lo + 1, rows, info.cols, cols,
+                blk, matrix, errvalue);
+    free(rows);
+    free(cols);
+
+    if ( SUCCESS == *errvalue ) {
+        blk->first_row  = lo;
+        blk->halo_above = last < first ? 0 : first - lo;
+        blk->halo_below = last < first ? 0 : hi - last;
+    }
+}
+
+/******************************************************************************/
+void read_matrix_block_cyclic(
+        const char           *path,     /* matrix file to read               */
+        MPI_Comm              comm,     /* ranks that share the matrix       */
+        int                   pr,       /* process grid rows                 */
+        int                   pc,       /* process grid columns              */
+        int                   mb,       /* rows per block                    */
+        int                   nb,       /* columns per block                 */
+        struct matrix_block  *blk,      /* description of the local part     */
+        void               ***matrix,   /* address of start of local matrix  */
+        int                  *errvalue) /* return code for error, if any     */
+{
+    struct matrix_file_info info;
+    int    id, p;
+    int    dims[2] = { pr, pc };
+    int    myrow, mycol;
+    int    nr, nc, k;
+    int   *rows, *cols;
+
+    *matrix = NULL;
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+
+    if ( 0 == pr && 0 == pc )
+        MPI_Dims_create(p, 2, dims);
+    if ( dims[0] * dims[1] != p || mb < 1 || nb < 1 ) {
+        *errvalue = LAYOUT_ERROR;
+        return;
+    }
+    pr = dims[0];
+    pc = dims[1];
+    myrow = id / pc;
+    mycol = id % pc;
+
+    share_matrix_file_info(path, comm, &info, errvalue);
+    if ( SUCCESS != *errvalue )
+        return;
+
+    nr = block_cyclic_count(info.rows, mb, myrow, pr);
+    nc = block_cyclic_count(info.cols, nb, mycol, pc);
+    rows = malloc((nr > 0 ? nr : 1) * sizeof(int));
+    cols = malloc((nc > 0 ? nc : 1) * sizeof(int));
+    for ( k = 0; k < nr; k++ )
+        rows[k] = block_cyclic_global(k, mb, myrow, pr);
+    for ( k = 0; k < nc; k++ )
+        cols[k] = block_cyclic_global(k, nb, mycol, pc);
+
+    read_subset(path, comm, &info, nr, rows, nc, cols, blk, matrix, errvalue);
+    free(rows);
+    free(cols);
+}
+
+/******************************************************************************/
+void free_matrix_block(
+        struct matrix_block  *blk,      /* description of the local part     */
+        void                **matrix)   /* row pointer array                 */
+{
+    free_matrix_aligned(blk->storage, matrix);
+    blk->storage = NULL;
+}
@@ -0,0 +1,140 @@
+#ifndef MPI_MATRIX_IO_H
+#define MPI_MATRIX_IO_H
+
+#include <mpi.h>
+#include "alloc_matrix.h"
+#include "matrix_file.h"
+
+#define MPI_IO_ERROR        6
+#define LAYOUT_ERROR        7
+
+/* The part of a matrix file held by one rank. The local elements form an
+   nrows by ncols matrix whose rows are ld elements apart in storage. */
+struct matrix_block {
+    int     rows;           /* rows in the whole matrix                     */
+    int     cols;           /* columns in the whole matrix                  */
+    int     dtype;          /* MATRIX_DTYPE_* of the elements               */
+    size_t  element_size;   /* bytes per element                            */
+    int     nrows;          /* rows held locally, ghost rows included       */
+    int     ncols;          /* columns held locally                         */
+    int     first_row;      /* global row of local row 0 (row blocks only)  */
+    int     halo_above;     /* ghost rows held above the owned rows         */
+    int     halo_below;     /* ghost rows held below the owned rows         */
+    size_t  ld;             /* padded local row length, in elements         */
+    void   *storage;        /* linear storage of the local elements         */
+};
+
+/******************************************************************************/
+/** matrix_mpi_type(dtype)
+ *  Returns the MPI datatype of a MATRIX_DTYPE_* value, or MPI_DATATYPE_NULL.
+ */
+MPI_Datatype matrix_mpi_type(int dtype);
+
+/******************************************************************************/
+/** block_cyclic_count(n, nb, iproc, nprocs)
+ *  Returns how many of the indices 0..n-1 are owned by process iproc when
+ *  they are dealt out in blocks of nb to nprocs processes in turn.
+ */
+int block_cyclic_count(int n, int nb, int iproc, int nprocs);
+
+/******************************************************************************/
+/** block_cyclic_global(k, nb, iproc, nprocs)
+ *  Returns the global index of the k-th index owned by process iproc in the
+ *  block-cyclic distribution described above.
+ */
+int block_cyclic_global(int k, int nb, int iproc, int nprocs);
+
+/******************************************************************************/
+/** share_matrix_file_info(path, comm, &info, &err)
+ *  Collective over comm. Rank 0 reads the header of the matrix file and
+ *  every rank receives the same info and error code.
+ */
+void share_matrix_file_info(
+        const char              *path,     /* matrix file to inspect         */
+        MPI_Comm                 comm,     /* ranks that need the info       */
+        struct matrix_file_info *info,     /* shape and placement of data    */
+        int                     *errvalue  /* return code for error, if any  */
+        );
+
+/******************************************************************************/
+/** make_subset_type(nr, rows, nc, cols, row_bytes, etype, &newtype)
+ *  Creates and commits a datatype that selects the elements at (rows[i],
+ *  cols[j]) from a row-major array whose rows are row_bytes apart, in row
+ *  then column order. rows and cols must be increasing. Runs of consecutive
+ *  columns are described as single blocks so the type stays small.
+ */
+void make_subset_type(
+        int           nr,        /* number of selected rows                  */
+        const int    *rows,      /* selected row indices                     */
+        int           nc,        /* number of selected columns               */
+        const int    *cols,      /* selected column indices                  */
+        MPI_Aint      row_bytes, /* distance between rows in bytes           */
+        MPI_Datatype  etype,     /* type of one element                      */
+        MPI_Datatype *newtype    /* committed type, free with MPI_Type_free  */
+        );
+
+/******************************************************************************/
+/** read_matrix_subset(path, comm, nr, rows, nc, cols, &blk, &M, &err)
+ *  Collective over comm. Each rank reads the elements of the matrix file at
+ *  (rows[i], cols[j]) into a new aligned nr by nc local matrix M, through a
+ *  file view and one MPI_File_read_at_all(). Ranks may ask for different,
+ *  even empty, subsets. Release with free_matrix_block().
+ */
+void read_matrix_subset(
+        const char           *path,     /* matrix file to read               */
+        MPI_Comm              comm,     /* ranks that share the read         */
+        int                   nr,       /* number of rows this rank reads    */
+        const int            *rows,     /* increasing global row indices     */
+        int                   nc,       /* number of columns this rank reads */
+        const int            *cols,     /* increasing global column indices  */
+        struct matrix_block  *blk,      /* description of the local part     */
+        void               ***matrix,   /* address of start of local matrix  */
+        int                  *errvalue  /* return code for error, if any     */
+        );
+
+/******************************************************************************/
+/** read_matrix_row_block(path, comm, halo, &blk, &M, &err)
+ *  Collective over comm. Rank id of p reads rows floor(id*n/p) up to
+ *  floor((id+1)*n/p) - 1 of the n row matrix, plus up to halo ghost rows on
+ *  each side. M[0] is global row blk.first_row; the owned rows start at
+ *  M[blk.halo_above].
+ */
+void read_matrix_row_block(
+        const char           *path,     /* matrix file to read               */
+        MPI_Comm              comm,     /* ranks that share the matrix       */
+        int                   halo,     /* ghost rows wanted on each side    */
+        struct matrix_block  *blk,      /* description of the local part     */
+        void               ***matrix,   /* address of start of local matrix  */
+        int                  *errvalue  /* return code for error, if any     */
+        );
+
+/******************************************************************************/
+/** read_matrix_block_cyclic(path, comm, pr, pc, mb, nb, &blk, &M, &err)
+ *  Collective over comm. The ranks form a pr by pc grid in row-major order
+ *  (pass 0 for both to let MPI_Dims_create choose) and each reads its tile
+ *  of the 2D block-cyclic distribution with mb by nb blocks. Local row k is
+ *  global row block_cyclic_global(k, mb, myrow, pr), and likewise for
+ *  columns.
+ */
+void read_matrix_block_cyclic(
+        const char           *path,     /* matrix file to read               */
+        MPI_Comm              comm,     /* ranks that share the matrix       */
+        int                   pr,       /* process grid rows                 */
+        int                   pc,       /* process grid columns              */
+        int                   mb,       /* rows per block                    */
+        int                   nb,       /* columns per block                 */
+        struct matrix_block  *blk,      /* description of the local part     */
+        void               ***matrix,   /* address of start of local matrix  */
+        int                  *errvalue  /* return code for error, if any     */
+        );
+
+/******************************************************************************/
+/** free_matrix_block(&blk, M)
+ *  Releases the local matrix read by one of the functions above.
+ */
+void free_matrix_block(
+        struct matrix_block  *blk,      /* description of the local part     */
+        void                **matrix    /* row pointer array                 */
+        );
+
+#endif
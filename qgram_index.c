@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mpi.h>
+#include "qgram_index.h"
+#include "text_io.h"
+
+/******************************************************************************/
+unsigned long qgram_hash(const unsigned char *s, int q, int bits)
+{
+    uint64_t v = 0;
+
+    memcpy(&v, s, q);
+    return (unsigned long) ((v * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+static int varint_length(uint64_t v)
+{
+    int len = 1;
+
+    while (v >= 0x80) {
+        v >>= 7;
+        len++;
+    }
+    return len;
+}
+
+/******************************************************************************/
+/* Three passes over the rank's part of the text, which hash its q-grams:
+   the first finds the last offset of each bucket, so that an exclusive scan
+   gives each rank the offset its part of each list follows; the second
+   sizes the parts, and the third encodes them, in bucket order. */
+int qgram_build(const char *text_path, long n, const char *index_path, int q, int step,
+                int bits, MPI_Comm comm)
+{
+    struct text_window w;
+    struct qgram_header header;
+    MPI_File fh;
+    MPI_Datatype pieces;
+    long nb = 1L << bits, b, pos, start, end, local_bytes = 0, npieces = 0;
+    int64_t *last, *prev, *bytes, *before, *total, *counts, *at;
+    int *lens;
+    MPI_Aint *displs;
+    unsigned char *buffer;
+    uint64_t v;
+    int id, ret = 0, err;
+
+    if (q < 1 || q > 8 || step < 1 || bits < 1 || bits > 30)
+        return -1;
+    MPI_Comm_rank(comm, &id);
+    if (text_window_read(&w, text_path, n, q - 1, TEXT_IO_MMAP, comm) != 0)
+        return -1;
+
+    last   = malloc(nb * sizeof(int64_t));
+    prev   = malloc(nb * sizeof(int64_t));
+    bytes  = calloc(nb, sizeof(int64_t));
+    before = calloc(nb, sizeof(int64_t));
+    total  = malloc((nb + 1) * sizeof(int64_t));
+    counts = calloc(nb, sizeof(int64_t));
+    at     = malloc(nb * sizeof(int64_t));
+
+    //The indexed offsets of this part
+    start = (w.first + step - 1) / step * step;
+    end   = w.first + w.owned < n - q + 1 ? w.first + w.owned : n - q + 1;
+
+    for (b = 0; b < nb; b++)
+        last[b] = -1;
+    for (pos = start; pos < end; pos += step) {
+        b = qgram_hash((const unsigned char *) w.text + pos - w.first, q, bits);
+        last[b] = pos;
+        counts[b]++;
+    }
+    MPI_Exscan(last, prev, nb, MPI_INT64_T, MPI_MAX, comm);
+    for (b = 0; b < nb; b++)
+        if (0 == id || prev[b] < 0)
+            prev[b] = 0;
+    memcpy(at, prev, nb * sizeof(int64_t));
+
+    for (pos = start; pos < end; pos += step) {
+        b = qgram_hash((const unsigned char *) w.text + pos - w.first, q, bits);
+        bytes[b] += varint_length(pos - at[b]);
+        at[b] = pos;
+    }
+
+    //Where each part goes: after the parts of the lower ranks in its bucket
+    MPI_Exscan(bytes, before, nb, MPI_INT64_T, MPI_SUM, comm);
+    if (0 == id)
+        memset(before, 0, nb * sizeof(int64_t));
+    MPI_Allreduce(bytes, total + 1, nb, MPI_INT64_T, MPI_SUM, comm);
+    MPI_Allreduce(MPI_IN_PLACE, counts, nb, MPI_INT64_T, MPI_SUM, comm);
+    total[0] = 0;
+    for (b = 0; b < nb; b++)
+        total[b + 1] += total[b];
+
+    lens   = malloc(nb * sizeof(int));
+    displs = malloc(nb * sizeof(MPI_Aint));
+    for (b = 0; b < nb; b++) {
+        at[b] = local_bytes;
+        if (bytes[b] > 0) {
+            if (bytes[b] > INT_MAX)
+                ret = -1;
+            lens[npieces]   = (int) bytes[b];
+            displs[npieces] = (MPI_Aint) (total[b] + before[b]);
+            npieces++;
+        }
+        local_bytes += bytes[b];
+    }
+    if (local_bytes > INT_MAX)
+        ret = -1;
+    buffer = malloc(local_bytes > 0 ? local_bytes : 1);
+    if (NULL == buffer)
+        ret = -1;
+    MPI_Allreduce(&ret, &err, 1, MPI_INT, MPI_MIN, comm);
+    if (err < 0)
+        goto done;
+
+    for (pos = start; pos < end; pos += step) {
+        b = qgram_hash((const unsigned char *) w.text + pos - w.first, q, bits);
+        for (v = pos - prev[b]; v >= 0x80; v >>= 7)
+            buffer[at[b]++] = (unsigned char) (v | 0x80);
+        buffer[at[b]++] = (unsigned char) v;
+        prev[b] = pos;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, QGRAM_MAGIC, 8);
+    header.q           = q;
+    header.step        = step;
+    header.bits        = bits;
+    header.text_size   = n;
+    header.data_offset = sizeof(header) + (2 * nb + 1) * sizeof(uint64_t);
+    header.postings    = 0;
+    for (b = 0; b < nb; b++)
+        header.postings += counts[b];
+
+    ret = MPI_File_open(comm, (char *) index_path, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                        MPI_INFO_NULL, &fh) == MPI_SUCCESS ? 0 : -1;
+    MPI_Allreduce(&ret, &err, 1, MPI_INT, MPI_MIN, comm);
+    if (err < 0)
+        goto done;
+    MPI_File_set_size(fh, header.data_offset + total[nb]);
+
+    //Rank 0 writes the tables, then every rank its parts of the lists. The
+    //tables are counted in elements: from bits = 28 up their bytes overflow
+    //an int, while their 2^bits + 1 elements do not
+    if (0 == id) {
+        if (MPI_File_write_at(fh, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS ||
+            MPI_File_write_at(fh, sizeof(header), total, (int) (nb + 1), MPI_INT64_T,
+                              MPI_STATUS_IGNORE) != MPI_SUCCESS ||
+            MPI_File_write_at(fh, sizeof(header) + (nb + 1) * sizeof(int64_t), counts,
+                              (int) nb, MPI_INT64_T, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+            ret = -1;
+    }
+    MPI_Type_create_hindexed((int) npieces, lens, displs, MPI_BYTE, &pieces);
+    MPI_Type_commit(&pieces);
+    MPI_File_set_view(fh, (MPI_Offset) header.data_offset, MPI_BYTE, pieces, "native",
+                      MPI_INFO_NULL);
+    if (MPI_File_write_at_all(fh, 0, buffer, (int) local_bytes, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+        ret = -1;
+    MPI_File_close(&fh);
+    MPI_Type_free(&pieces);
+    MPI_Allreduce(&ret, &err, 1, MPI_INT, MPI_MIN, comm);
+
+done:
+    free(buffer);
+    free(displs);
+    free(lens);
+    free(at);
+    free(counts);
+    free(total);
+    free(before);
+    free(bytes);
+    free(prev);
+    free(last);
+    text_window_free(&w);
+    return err;
+}
+
+/******************************************************************************/
+int qgram_open(struct qgram_index *ix, const char *path)
+{
+    struct stat st;
+    const struct qgram_header *h;
+    long nb;
+    int fd;
+
+    memset(ix, 0, sizeof(*ix));
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(*h)) {
+        close(fd);
+        return -1;
+    }
+    ix->map_len = st.st_size;
+    ix->map = mmap(NULL, ix->map_len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == ix->map) {
+        ix->map = NULL;
+        return -1;
+    }
+
+    h = ix->map;
+    nb = h->bits >= 1 && h->bits <= 30 ? 1L << h->bits : 0;
+    if (memcmp(h->magic, QGRAM_MAGIC, 8) != 0 || nb == 0 || h->q < 1 || h->q > 8 || h->step < 1 ||
+        h->data_offset != (int64_t) (sizeof(*h) + (2 * nb + 1) * sizeof(uint64_t)) ||
+        (size_t) h->data_offset > ix->map_len) {
+        qgram_close(ix);
+        return -1;
+    }
+    ix->header       = h;
+    ix->bucket_start = (const uint64_t *) (h + 1);
+    ix->count        = ix->bucket_start + nb + 1;
+    ix->data         = (const unsigned char *) ix->map + h->data_offset;
+    if (h->data_offset + ix->bucket_start[nb] > ix->map_len) {
+        qgram_close(ix);
+        return -1;
+    }
+    madvise(ix->map, ix->map_len, MADV_RANDOM);
+    return 0;
+}
+
+void qgram_close(struct qgram_index *ix)
+{
+    if (NULL != ix->map)
+        munmap(ix->map, ix->map_len);
+    memset(ix, 0, sizeof(*ix));
+}
+
+/******************************************************************************/
+static int compare_offsets(const void *a, const void *b)
+{
+    long x = *(const long *) a, y = *(const long *) b;
+
+    return (x > y) - (x < y);
+}
+
+long *qgram_query(const struct qgram_index *ix, const char *pat, long len, const char *text,
+                  long first, long text_len, long limit, long *count)
+{
+    const unsigned char *p = (const unsigned char *) pat;
+    int q = (int) ix->header->q, bits = (int) ix->header->bits;
+    long step = ix->header->step, size = 1024, found = 0;
+    long j, o, best, t;
+    unsigned long b, best_b;
+    uint64_t i, end, pos, v;
+    int shift;
+    long *matches;
+
+    *count = 0;
+    if (len < q + step - 1)
+        return NULL;
+    matches = malloc(size * sizeof(long));
+
+    //An occurrence at t has its q-gram at offset j of pat indexed when
+    // t + j is a multiple of step, which is so for one j below step
+    for (j = 0; j < step; j++) {
+        best = j;
+        best_b = qgram_hash(p + j, q, bits);
+        for (o = j + step; o + q <= len; o += step) {
+            b = qgram_hash(p + o, q, bits);
+            if (ix->count[b] < ix->count[best_b]) {
+                best   = o;
+                best_b = b;
+            }
+        }
+
+        pos = 0;
+        end = ix->bucket_start[best_b + 1];
+        for (i = ix->bucket_start[best_b]; i < end; ) {
+            v = 0;
+            shift = 0;
+            do {
+                v |= (uint64_t) (ix->data[i] & 0x7f) << shift;
+                shift += 7;
+            } while (ix->data[i++] & 0x80);
+            pos += v;
+
+            t = (long) pos - best;
+            if (t < first)
+                continue;
+            if (t >= first + limit)
+                break;
+            if (t - first + len <= text_len && memcmp(text + (t - first), pat, len) == 0) {
+                if (found == size) {
+                    size *= 2;
+                    matches = realloc(matches, size * sizeof(long));
+                }
+                matches[found++] = t;
+            }
+        }
+    }
+
+    qsort(matches, found, sizeof(long), compare_offsets);
+    *count = found;
+    return matches;
+}
@@ -0,0 +1,83 @@
+#ifndef QGRAM_INDEX_H
+#define QGRAM_INDEX_H
+
+#include <stdint.h>
+#include <mpi.h>
+
+#define QGRAM_MAGIC   "QGRAMIX1"
+#define QGRAM_Q       4     /* default bytes per q-gram, at most 8          */
+#define QGRAM_STEP    4     /* default distance between indexed q-grams     */
+#define QGRAM_BITS    20    /* default log2 of the number of buckets        */
+
+/* An inverted index of the q-grams of a text file. The q-grams that start
+   at the multiples of step are hashed into 2^bits buckets, and each bucket
+   lists the offsets they start at in increasing order, as varints of the
+   distance from the previous offset (from 0 for the first one). A pattern
+   of at least q + step - 1 bytes then has, for each occurrence, one of its
+   first step q-grams at an indexed offset, so the lists of those q-grams
+   hold every occurrence.
+
+   The file is the header, then bucket_start[2^bits + 1] and
+   count[2^bits] as uint64_t, then the lists; bucket b's list is the bytes
+   from bucket_start[b] to bucket_start[b+1] after data_offset. It is used
+   where it lies by mapping it. */
+struct qgram_header {
+    char        magic[8];       /* QGRAM_MAGIC                              */
+    int64_t     q;
+    int64_t     step;
+    int64_t     bits;
+    int64_t     text_size;      /* bytes in the indexed text                */
+    int64_t     data_offset;    /* where the lists start in the file        */
+    int64_t     postings;       /* offsets listed in all buckets            */
+};
+
+/* An index file mapped for queries */
+struct qgram_index {
+    const struct qgram_header *header;
+    const uint64_t            *bucket_start;
+    const uint64_t            *count;   /* offsets listed in each bucket    */
+    const unsigned char       *data;
+    void                      *map;
+    size_t                     map_len;
+};
+
+/******************************************************************************/
+/** qgram_hash(s, q, bits)
+ *  Returns the bucket of the q bytes at s.
+ */
+unsigned long qgram_hash(const unsigned char *s, int q, int bits);
+
+/******************************************************************************/
+/** qgram_build(text_path, n, index_path, q, step, bits, comm)
+ *  Collective over comm. Builds the index of the n byte file text_path in
+ *  index_path. Each rank indexes its part of the text, as text_window_read()
+ *  gives it, and the parts are written into each bucket's list in rank
+ *  order with one collective MPI-IO write. Returns 0 on every rank, or -1
+ *  on every rank if any of them failed.
+ */
+int qgram_build(const char *text_path, long n, const char *index_path, int q, int step,
+                int bits, MPI_Comm comm);
+
+/******************************************************************************/
+/** qgram_open(ix, path) / qgram_close(ix)
+ *  Map an index file for queries, and unmap it. qgram_open() returns 0, or
+ *  -1 if the file cannot be mapped or is not an index.
+ */
+int qgram_open(struct qgram_index *ix, const char *path);
+void qgram_close(struct qgram_index *ix);
+
+/******************************************************************************/
+/** qgram_query(ix, pat, len, text, first, text_len, limit, &count)
+ *  Finds the matches of the len byte pattern pat that start in [first,
+ *  first + limit) of the indexed text, given the text_len bytes of the text
+ *  from offset first to check the candidates the index yields against.
+ *  For each of the first step q-grams of pat it reads the shortest list
+ *  among the q-grams of pat at the same offset modulo step. Returns the
+ *  offsets of the matches in increasing order, in an array of *count
+ *  entries to be freed by the caller, or NULL if pat is shorter than
+ *  q + step - 1 bytes, which the index cannot serve.
+ */
+long *qgram_query(const struct qgram_index *ix, const char *pat, long len, const char *text,
+                  long first, long text_len, long limit, long *count);
+
+#endif
@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "quadrature.h"
+
+/* Kronrod abscissae on [-1,1] (positive half, decreasing). The 7-point
+   Gauss nodes are xgk[1], xgk[3], xgk[5] and xgk[7] = 0. */
+static const double xgk[8] = {
+    0.991455371120812639206854697526329,
+    0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926,
+    0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013,
+    0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245,
+    0.000000000000000000000000000000000
+};
+
+/* Weights of the 15-point Kronrod rule, matching xgk */
+static const double wgk[8] = {
+    0.022935322010529224963732008058970,
+    0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518,
+    0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550,
+    0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649,
+    0.209482141084727828012999174891714
+};
+
+/* Weights of the 7-point Gauss rule, for xgk[1], xgk[3], xgk[5], 0 */
+static const double wg[4] = {
+    0.129484966168869693270611432679082,
+    0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975,
+    0.417959183673469387755102040816327
+};
+
+static const char *rule_names[] = {
+    "midpoint", "simpson", "gauss", "romberg", "adaptive"
+};
+
+/******************************************************************************/
+const char *quad_rule_name(int rule)
+{
+    if (rule < QUAD_MIDPOINT || rule > QUAD_ADAPTIVE)
+        return "unknown";
+    return rule_names[rule];
+}
+
+int quad_rule_parse(const char *name)
+{
+    int rule;
+
+    for (rule = QUAD_MIDPOINT; rule <= QUAD_ADAPTIVE; rule++)
+        if (strcmp(name, rule_names[rule]) == 0)
+            return rule;
+    return -1;
+}
+
+/******************************************************************************/
+/* One composite rule on n panels of [a,b]. Node positions are computed from
+   the panel index rather than accumulated, so they do not drift. */
+static double composite_sum(
+        int          rule,
+        integrand_fn f,
+        void        *ctx,
+        double       a,
+        double       b,
+        long         n,
+        long        *evals)
+{
+    double h = (b - a) / (double) n;
+    double sum = 0.0, inner = 0.0, mids = 0.0;
+    double c, r;
+    long   k;
+    int    j;
+
+    switch (rule) {
+    case QUAD_MIDPOINT:
+        for (k = 0; k < n; k++)
+            sum += f(a + h * ((double) k + 0.5), ctx);
+        *evals += n;
+        return sum * h;
+
+    case QUAD_SIMPSON:
+        for (k = 1; k < n; k++)
+            inner += f(a + h * (double) k, ctx);
+        for (k = 0; k < n; k++)
+            mids += f(a + h * ((double) k + 0.5), ctx);
+        *evals += 2 * n + 1;
+        return h / 6.0 * (f(a, ctx) + f(b, ctx) + 2.0 * inner + 4.0 * mids);
+
+    default:    /* QUAD_GAUSS_LEGENDRE */
+        r = h / 2.0;
+        for (k = 0; k < n; k++) {
+            c = a + h * ((double) k + 0.5);
+            sum += wg[3] * f(c, ctx);
+            for (j = 0; j < 3; j++)
+                sum += wg[j] * (f(c - r * xgk[2*j+1], ctx) + f(c + r * xgk[2*j+1], ctx));
+        }
+        *evals += 7 * n;
+        return sum * r;
+    }
+}
+
+/******************************************************************************/
+void quad_composite(
+        int                 rule,   /* QUAD_MIDPOINT, _SIMPSON or _GAUSS_LEGENDRE */
+        integrand_fn        f,      /* function to integrate                 */
+        void               *ctx,    /* passed through to f                   */
+        double              a,      /* lower limit                           */
+        double              b,      /* upper limit                           */
+        long                n,      /* number of panels                      */
+        struct quad_result *res)    /* result, error estimate and cost       */
+{
+    int    order = QUAD_MIDPOINT == rule ? 2 : QUAD_SIMPSON == rule ? 4 : 14;
+    double coarse, ratio;
+
+    res->value = res->error = 0.0;
+    res->evals = 0;
+    if (n < 1)
+        return;
+
+    res->value = composite_sum(rule, f, ctx, a, b, n, &res->evals);
+
+    /* Richardson: with panels ratio times wider the error grows by about
+       ratio^order, so the difference of the two is (ratio^order - 1) times
+       the error of the finer sum */
+    if (n < 2) {
+        res->error = fabs(res->value);
+        return;
+    }
+    coarse = composite_sum(rule, f, ctx, a, b, n / 2, &res->evals);
+    ratio  = (double) n / (double) (n / 2);
+    res->error = fabs(res->value - coarse);
+
+    /* Gauss-Legendre reaches its order only on panels much narrower than
+       the scale of f, so the difference itself is kept as its estimate */
+    if (QUAD_GAUSS_LEGENDRE != rule)
+        res->error /= pow(ratio, order) - 1.0;
+}
+
+/******************************************************************************/
+void quad_romberg(
+        integrand_fn        f,
+        void               *ctx,
+        double              a,
+        double              b,
+        double              tol,    /* wanted absolute error                 */
+        struct quad_result *res)
+{
+    double prev[QUAD_MAX_LEVELS + 1], cur[QUAD_MAX_LEVELS + 1];
+    double h, sum, scale;
+    long   i, npts;
+    int    j, k;
+
+    prev[0] = (b - a) / 2.0 * (f(a, ctx) + f(b, ctx));
+    res->evals = 2;
+    res->value = prev[0];
+    res->error = fabs(prev[0]);
+
+    for (k = 1; k <= QUAD_MAX_LEVELS; k++) {
+        /* trapezoid sum with half the step reuses all the previous points */
+        npts = 1L << (k - 1);
+        h = (b - a) / (double) (2 * npts);
+        sum = 0.0;
+        for (i = 1; i <= npts; i++)
+            sum += f(a + h * (double) (2 * i - 1), ctx);
+        res->evals += npts;
+        cur[0] = prev[0] / 2.0 + h * sum;
+
+        /* extrapolate away the h^2, h^4, ... error terms */
+        scale = 1.0;
+        for (j = 1; j <= k; j++) {
+            scale *= 4.0;
+            cur[j] = cur[j-1] + (cur[j-1] - prev[j-1]) / (scale - 1.0);
+        }
+
+        res->value = cur[k];
+        res->error = fabs(cur[k] - prev[k-1]);
+        if (k >= 3 && res->error <= tol)
+            break;
+        memcpy(prev, cur, (k + 1) * sizeof(double));
+    }
+}
+
+/******************************************************************************/
+struct quad_interval {
+    double a, b;
+    double value;
+    double error;
+    double absval;      /* integral of |f|, for the roundoff floor           */
+};
+
+/* 15-point Gauss-Kronrod rule on [a,b], as QUADPACK's qk15 */
+static void gauss_kronrod(
+        integrand_fn          f,
+        void                 *ctx,
+        struct quad_interval *iv)
+{
+    double centr  = (iv->a + iv->b) / 2.0;
+    double hlgth  = (iv->b - iv->a) / 2.0;
+    double dhlgth = fabs(hlgth);
+    double fc, fv1[7], fv2[7];
+    double resg, resk, reskh, resabs, resasc, abserr, absc;
+    int    j;
+
+    fc     = f(centr, ctx);
+    resg   = fc * wg[3];
+    resk   = fc * wgk[7];
+    resabs = fabs(resk);
+
+    for (j = 0; j < 7; j++) {
+        absc   = hlgth * xgk[j];
+        fv1[j] = f(centr - absc, ctx);
+        fv2[j] = f(centr + absc, ctx);
+        resk   += wgk[j] * (fv1[j] + fv2[j]);
+        resabs += wgk[j] * (fabs(fv1[j]) + fabs(fv2[j]));
+        if (j % 2 == 1)
+            resg += wg[j/2] * (fv1[j] + fv2[j]);
+    }
+
+    reskh  = resk / 2.0;
+    resasc = wgk[7] * fabs(fc - reskh);
+    for (j = 0; j < 7; j++)
+        resasc += wgk[j] * (fabs(fv1[j] - reskh) + fabs(fv2[j] - reskh));
+
+    iv->value = resk * hlgth;
+    resabs *= dhlgth;
+    iv->absval = resabs;
+    resasc *= dhlgth;
+    abserr = fabs((resk - resg) * hlgth);
+    if (resasc != 0.0 && abserr != 0.0)
+        abserr = resasc * fmin(1.0, pow(200.0 * abserr / resasc, 1.5));
+    if (resabs > DBL_MIN / (50.0 * DBL_EPSILON))
+        abserr = fmax(50.0 * DBL_EPSILON * resabs, abserr);
+    iv->error = abserr;
+}
+
+/* Max-heap on error, so the worst interval is always heap[0] */
+static void heap_push(struct quad_interval *heap, int *n, struct quad_interval iv)
+{
+    int i = (*n)++;
+
+    while (i > 0 && heap[(i-1)/2].error < iv.error) {
+        heap[i] = heap[(i-1)/2];
+        i = (i-1)/2;
+    }
+    heap[i] = iv;
+}
+
+static struct quad_interval heap_pop(struct quad_interval *heap, int *n)
+{
+    struct quad_interval top = heap[0], last = heap[--(*n)];
+    int i = 0, child;
+
+    while ((child = 2*i + 1) < *n) {
+        if (child + 1 < *n && heap[child+1].error > heap[child].error)
+            child++;
+        if (heap[child].error <= last.error)
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+/******************************************************************************/
+void quad_adaptive(
+        integrand_fn        f,
+        void               *ctx,
+        double              a,
+        double              b,
+        double              tol,    /* wanted absolute error                 */
+        struct quad_result *res)
+{
+    struct quad_interval *heap;
+    struct quad_interval  iv, left, right;
+    double total_err;
+    double mid;
+    int    n = 0;
+    int    i;
+
+    heap = malloc(QUAD_MAX_INTERVALS * sizeof(struct quad_interval));
+
+    iv.a = a;
+    iv.b = b;
+    gauss_kronrod(f, ctx, &iv);
+    res->evals = 15;
+    heap_push(heap, &n, iv);
+    total_err = iv.error;
+
+    while (total_err > tol && n + 1 < QUAD_MAX_INTERVALS) {
+        iv  = heap_pop(heap, &n);
+        mid = (iv.a + iv.b) / 2.0;
+        if (mid <= iv.a || mid >= iv.b ||
+            iv.error <= 50.0 * DBL_EPSILON * iv.absval) {
+            /* cannot bisect further in double precision, or the worst
+               estimate is already down to roundoff, which halves would
+               only share between them */
+            heap_push(heap, &n, iv);
+            break;
+        }
+
+        left.a  = iv.a;  left.b  = mid;
+        right.a = mid;   right.b = iv.b;
+        gauss_kronrod(f, ctx, &left);
+        gauss_kronrod(f, ctx, &right);
+        res->evals += 30;
+
+        total_err += left.error + right.error - iv.error;
+        heap_push(heap, &n, left);
+        heap_push(heap, &n, right);
+    }
+
+    /* sum afresh so the running updates leave no drift in the result */
+    res->value = res->error = 0.0;
+    for (i = 0; i < n; i++) {
+        res->value += heap[i].value;
+        res->error += heap[i].error;
+    }
+    free(heap);
+}
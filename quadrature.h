@@ -0,0 +1,82 @@
+#ifndef QUADRATURE_H
+#define QUADRATURE_H
+
+/* Integration rules. The composite rules apply the same rule on each of n
+   equal panels; QUAD_ROMBERG and QUAD_ADAPTIVE refine until they meet an
+   error tolerance instead. */
+#define QUAD_MIDPOINT       0   /* 1 point per panel, error O(h^2)          */
+#define QUAD_SIMPSON        1   /* 3 points per panel (ends shared), O(h^4) */
+#define QUAD_GAUSS_LEGENDRE 2   /* 7 Gauss points per panel, O(h^14)        */
+#define QUAD_ROMBERG        3   /* Richardson extrapolated trapezoid sums   */
+#define QUAD_ADAPTIVE       4   /* adaptive Gauss-Kronrod 7/15 bisection    */
+
+#define QUAD_MAX_INTERVALS  100000  /* limit on adaptive subintervals       */
+#define QUAD_MAX_LEVELS     30      /* limit on Romberg halvings            */
+
+typedef double (*integrand_fn)(double x, void *ctx);
+
+struct quad_result {
+    double  value;      /* the approximation of the integral                */
+    double  error;      /* estimate of its absolute error                   */
+    long    evals;      /* number of integrand evaluations used             */
+};
+
+/******************************************************************************/
+/** quad_rule_name(rule) / quad_rule_parse(name)
+ *  Convert between QUAD_* values and the names midpoint, simpson, gauss,
+ *  romberg and adaptive. quad_rule_parse() returns -1 for unknown names.
+ */
+const char *quad_rule_name(int rule);
+int quad_rule_parse(const char *name);
+
+/******************************************************************************/
+/** quad_composite(rule, f, ctx, a, b, n, &res)
+ *  Integrates f over [a,b] with a composite QUAD_MIDPOINT, QUAD_SIMPSON or
+ *  QUAD_GAUSS_LEGENDRE rule on n panels. The error is estimated by
+ *  comparison with the same rule on n/2 panels, whose evaluations are
+ *  included in res.evals: by Richardson extrapolation for the midpoint and
+ *  Simpson rules, and as the plain difference for Gauss-Legendre.
+ */
+void quad_composite(
+        int                 rule,   /* QUAD_MIDPOINT, _SIMPSON or _GAUSS_LEGENDRE */
+        integrand_fn        f,      /* function to integrate                 */
+        void               *ctx,    /* passed through to f                   */
+        double              a,      /* lower limit                           */
+        double              b,      /* upper limit                           */
+        long                n,      /* number of panels                      */
+        struct quad_result *res     /* result, error estimate and cost       */
+        );
+
+/******************************************************************************/
+/** quad_romberg(f, ctx, a, b, tol, &res)
+ *  Integrates f over [a,b] by Romberg extrapolation, halving the step until
+ *  successive diagonal entries agree to within tol or QUAD_MAX_LEVELS is
+ *  reached.
+ */
+void quad_romberg(
+        integrand_fn        f,
+        void               *ctx,
+        double              a,
+        double              b,
+        double              tol,    /* wanted absolute error                 */
+        struct quad_result *res
+        );
+
+/******************************************************************************/
+/** quad_adaptive(f, ctx, a, b, tol, &res)
+ *  Integrates f over [a,b] with the 15-point Gauss-Kronrod rule, always
+ *  bisecting the subinterval with the largest error estimate, until the
+ *  estimates add up to at most tol, the worst of them is down to roundoff,
+ *  or QUAD_MAX_INTERVALS is reached. Error estimates follow QUADPACK's
+ *  scaling of |K15 - G7|.
+ */
+void quad_adaptive(
+        integrand_fn        f,
+        void               *ctx,
+        double              a,
+        double              b,
+        double              tol,    /* wanted absolute error                 */
+        struct quad_result *res
+        );
+
+#endif
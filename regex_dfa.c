@@ -0,0 +1,715 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regex_dfa.h"
+
+/* Nodes of the parse tree. A repeat {m,n} refers to its operand m times
+   or more rather than copying it, so the tree is a DAG. */
+#define RX_SET    0   /* one byte of a set; a is the set                  */
+#define RX_CAT    1   /* a then b                                         */
+#define RX_ALT    2   /* a or b                                           */
+#define RX_STAR   3   /* a, any number of times                           */
+#define RX_PLUS   4   /* a, at least once                                 */
+#define RX_QUEST  5   /* a, at most once                                  */
+#define RX_EMPTY  6   /* the empty string                                 */
+
+/* States of the NFA */
+#define NFA_SET    0  /* reads a byte of set arg, then goes to out1       */
+#define NFA_SPLIT  1  /* goes to out1 and out2 without reading            */
+#define NFA_MATCH  2
+
+#define SET_HAS(set, c)  ((set)[(c) >> 3] >> ((c) & 7) & 1)
+#define SET_ADD(set, c)  ((set)[(c) >> 3] |= (unsigned char) (1 << ((c) & 7)))
+
+struct rx_node {
+    int type, a, b;
+};
+
+struct rx_parser {
+    const unsigned char *p;         /* next byte of the pattern         */
+    struct rx_node      *nodes;
+    int                  nnodes, cap;
+    unsigned char      (*sets)[32]; /* byte sets, as bitmaps            */
+    int                  nsets;
+    char                *err;
+    int                  errlen;
+};
+
+struct rx_nfa {
+    int *type, *arg, *out1, *out2;
+    int  n;
+};
+
+static int fail(struct rx_parser *ps, const char *msg)
+{
+    if (ps->err[0] == '\0')
+        snprintf(ps->err, ps->errlen, "%s", msg);
+    return -1;
+}
+
+static int new_node(struct rx_parser *ps, int type, int a, int b)
+{
+    struct rx_node *grown;
+
+    if (a < 0 || b < 0)
+        return -1;
+    if (ps->nnodes == ps->cap) {
+        if (ps->cap >= REGEX_MAX_NODES)
+            return fail(ps, "pattern too large");
+        grown = realloc(ps->nodes, 2 * ps->cap * sizeof(*grown));
+        if (NULL == grown)
+            return fail(ps, "out of memory");
+        ps->nodes = grown;
+        ps->cap *= 2;
+    }
+    ps->nodes[ps->nnodes].type = type;
+    ps->nodes[ps->nnodes].a    = a;
+    ps->nodes[ps->nnodes].b    = b;
+    return ps->nnodes++;
+}
+
+/* Every set is started by at least one byte of the pattern, so the sets
+   array, sized by the pattern length, does not overflow */
+static int new_set(struct rx_parser *ps)
+{
+    memset(ps->sets[ps->nsets], 0, 32);
+    return ps->nsets++;
+}
+
+/******************************************************************************/
+/* Adds the bytes of the escape \c to set */
+static void escape_set(unsigned char *set, int c)
+{
+    unsigned char class[32] = {0};
+    int b, negate = c == 'D' || c == 'W' || c == 'S';
+
+    switch (c) {
+    case 'd': case 'D':
+        for (b = '0'; b <= '9'; b++)
+            SET_ADD(class, b);
+        break;
+    case 'w': case 'W':
+        for (b = 0; b < 256; b++)
+            if ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9') || b == '_')
+                SET_ADD(class, b);
+        break;
+    case 's': case 'S':
+        SET_ADD(class, ' ');
+        for (b = '\t'; b <= '\r'; b++)
+            SET_ADD(class, b);
+        break;
+    case 'n':
+        SET_ADD(class, '\n');
+        break;
+    case 't':
+        SET_ADD(class, '\t');
+        break;
+    case 'r':
+        SET_ADD(class, '\r');
+        break;
+    default:
+        SET_ADD(class, c);
+    }
+    for (b = 0; b < 32; b++)
+        set[b] |= negate ? (unsigned char) ~class[b] : class[b];
+}
+
+/* Returns the byte an escape or plain byte in a [...] set stands for, or -1
+   for an escape of several bytes, which is added to set instead */
+static int class_byte(struct rx_parser *ps, unsigned char *set)
+{
+    int c = *ps->p++;
+
+    if (c != '\\' || *ps->p == '\0')
+        return c;
+    c = *ps->p++;
+    if (strchr("dDwWsS", c) != NULL) {
+        escape_set(set, c);
+        return -1;
+    }
+    return c == 'n' ? '\n' : c == 't' ? '\t' : c == 'r' ? '\r' : c;
+}
+
+static int parse_class(struct rx_parser *ps)
+{
+    int set = new_set(ps), negate = 0, lo, hi, b;
+
+    if (*ps->p == '^') {
+        negate = 1;
+        ps->p++;
+    }
+    //A ] right after [ or [^ is a member
+    do {
+        if (*ps->p == '\0' || (ps->p[0] == '\\' && ps->p[1] == '\0'))
+            return fail(ps, "missing ]");
+        lo = class_byte(ps, ps->sets[set]);
+        if (lo >= 0 && ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0') {
+            ps->p++;
+            hi = class_byte(ps, ps->sets[set]);
+            if (hi < lo)
+                return fail(ps, "bad range in []");
+            for (b = lo; b <= hi; b++)
+                SET_ADD(ps->sets[set], b);
+        }
+        else if (lo >= 0)
+            SET_ADD(ps->sets[set], lo);
+    } while (*ps->p != ']');
+    ps->p++;
+
+    if (negate)
+        for (b = 0; b < 32; b++)
+            ps->sets[set][b] = (unsigned char) ~ps->sets[set][b];
+    return new_node(ps, RX_SET, set, 0);
+}
+
+static int parse_alt(struct rx_parser *ps);
+
+static int parse_atom(struct rx_parser *ps)
+{
+    int c = *ps->p++, node, set, b;
+
+    switch (c) {
+    case '(':
+        node = parse_alt(ps);
+        if (*ps->p != ')')
+            return fail(ps, "missing )");
+        ps->p++;
+        return node;
+    case '[':
+        return parse_class(ps);
+    case '.':
+        set = new_set(ps);
+        for (b = 0; b < 256; b++)
+            if (b != '\n')
+                SET_ADD(ps->sets[set], b);
+        return new_node(ps, RX_SET, set, 0);
+    case '*': case '+': case '?': case '{':
+        return fail(ps, "nothing to repeat");
+    case '^': case '$':
+        return fail(ps, "anchors are not supported");
+    case '\\':
+        if (*ps->p == '\0')
+            return fail(ps, "trailing \\");
+        set = new_set(ps);
+        escape_set(ps->sets[set], *ps->p++);
+        return new_node(ps, RX_SET, set, 0);
+    default:
+        set = new_set(ps);
+        SET_ADD(ps->sets[set], c);
+        return new_node(ps, RX_SET, set, 0);
+    }
+}
+
+/* Parses the m or m, or m,n of a {} repeat; *hi is -1 for no bound */
+static int parse_bounds(struct rx_parser *ps, int *lo, int *hi)
+{
+    char *end;
+
+    *lo = (int) strtol((const char *) ps->p, &end, 10);
+    if (end == (char *) ps->p || *lo > 255)
+        return fail(ps, "bad {} repeat");
+    ps->p = (const unsigned char *) end;
+    *hi = *lo;
+    if (*ps->p == ',') {
+        ps->p++;
+        *hi = -1;
+        if (*ps->p != '}') {
+            *hi = (int) strtol((const char *) ps->p, &end, 10);
+            if (end == (char *) ps->p || *hi > 255 || *hi < *lo)
+                return fail(ps, "bad {} repeat");
+            ps->p = (const unsigned char *) end;
+        }
+    }
+    if (*ps->p != '}')
+        return fail(ps, "bad {} repeat");
+    ps->p++;
+    return 0;
+}
+
+static int parse_repeat(struct rx_parser *ps)
+{
+    int node = parse_atom(ps), result, lo, hi, k;
+
+    while (node >= 0 && strchr("*+?{", *ps->p) != NULL && *ps->p != '\0') {
+        switch (*ps->p++) {
+        case '*':
+            node = new_node(ps, RX_STAR, node, 0);
+            break;
+        case '+':
+            node = new_node(ps, RX_PLUS, node, 0);
+            break;
+        case '?':
+            node = new_node(ps, RX_QUEST, node, 0);
+            break;
+        default:
+            if (parse_bounds(ps, &lo, &hi) < 0)
+                return -1;
+            //a{m,n} is m a's then n-m a?'s; a{m,} is m a's then a*
+            result = new_node(ps, RX_EMPTY, 0, 0);
+            for (k = 0; k < lo; k++)
+                result = new_node(ps, RX_CAT, result, node);
+            if (hi < 0)
+                result = new_node(ps, RX_CAT, result, new_node(ps, RX_STAR, node, 0));
+            else if (hi > lo) {
+                int quest = new_node(ps, RX_QUEST, node, 0);
+                for (k = lo; k < hi; k++)
+                    result = new_node(ps, RX_CAT, result, quest);
+            }
+            node = result;
+        }
+    }
+    return node;
+}
+
+static int parse_cat(struct rx_parser *ps)
+{
+    int node = new_node(ps, RX_EMPTY, 0, 0);
+
+    while (node >= 0 && *ps->p != '\0' && *ps->p != '|' && *ps->p != ')')
+        node = new_node(ps, RX_CAT, node, parse_repeat(ps));
+    return node;
+}
+
+static int parse_alt(struct rx_parser *ps)
+{
+    int node = parse_cat(ps);
+
+    while (node >= 0 && *ps->p == '|') {
+        ps->p++;
+        node = new_node(ps, RX_ALT, node, parse_cat(ps));
+    }
+    return node;
+}
+
+/******************************************************************************/
+static int nfa_add(struct rx_nfa *nfa, int type, int arg, int out1, int out2)
+{
+    if (nfa->n >= REGEX_MAX_NODES || out1 < 0 || out2 < 0)
+        return -1;
+    nfa->type[nfa->n] = type;
+    nfa->arg[nfa->n]  = arg;
+    nfa->out1[nfa->n] = out1;
+    nfa->out2[nfa->n] = out2;
+    return nfa->n++;
+}
+
+/* Builds the NFA of the reverse of node's language, going on to next, and
+   returns its first state (Thompson's construction, with the operands of
+   each concatenation swapped) */
+static int build(struct rx_nfa *nfa, const struct rx_node *nodes, int node, int next)
+{
+    const struct rx_node *x = &nodes[node];
+    int s, first;
+
+    switch (x->type) {
+    case RX_SET:
+        return nfa_add(nfa, NFA_SET, x->a, next, 0);
+    case RX_CAT:
+        return build(nfa, nodes, x->b, build(nfa, nodes, x->a, next));
+    case RX_ALT:
+        return nfa_add(nfa, NFA_SPLIT, 0, build(nfa, nodes, x->a, next),
+                       build(nfa, nodes, x->b, next));
+    case RX_STAR:
+        s = nfa_add(nfa, NFA_SPLIT, 0, 0, next);
+        if (s < 0 || (first = build(nfa, nodes, x->a, s)) < 0)
+            return -1;
+        nfa->out1[s] = first;
+        return s;
+    case RX_PLUS:
+        s = nfa_add(nfa, NFA_SPLIT, 0, 0, next);
+        if (s < 0 || (first = build(nfa, nodes, x->a, s)) < 0)
+            return -1;
+        nfa->out1[s] = first;
+        return first;
+    case RX_QUEST:
+        return nfa_add(nfa, NFA_SPLIT, 0, build(nfa, nodes, x->a, next), next);
+    default:
+        return next;
+    }
+}
+
+/* Adds the states reachable from s without reading, that read or match, to
+   list, skipping those already stamped with mark */
+static void closure(const struct rx_nfa *nfa, int s, int *stamp, int mark, int *list, int *count,
+                    int *stack)
+{
+    int top = 0;
+
+    stack[top++] = s;
+    while (top > 0) {
+        s = stack[--top];
+        if (stamp[s] == mark)
+            continue;
+        stamp[s] = mark;
+        if (NFA_SPLIT == nfa->type[s]) {
+            stack[top++] = nfa->out2[s];
+            stack[top++] = nfa->out1[s];
+        }
+        else
+            list[(*count)++] = s;
+    }
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+static unsigned long hash_ints(const int *v, int n)
+{
+    unsigned long h = 14695981039346656037UL;
+    int i;
+
+    for (i = 0; i < n; i++)
+        h = (h ^ (unsigned long) v[i]) * 1099511628211UL;
+    return h;
+}
+
+/******************************************************************************/
+/* Subset construction. Each DFA state is a sorted set of NFA states, kept in
+   one pool, and always includes the closure of the start state, which makes
+   the search unanchored. Returns the number of states, with their moves in
+   *raw and whether they accept in *accept, or -1. */
+static int subsets(const struct rx_nfa *nfa, int start, const unsigned char (*sets)[32],
+                   const unsigned char *rep, int nclasses, int **raw, unsigned char **accept)
+{
+    int hsize = 4 * REGEX_MAX_STATES, *table = malloc(hsize * sizeof(int));
+    int *stamp = calloc(nfa->n, sizeof(int)), mark = 0;
+    int *stack = malloc((2 * nfa->n + 1) * sizeof(int));
+    int *list = malloc(nfa->n * sizeof(int)), count, nstart;
+    int *first = malloc((REGEX_MAX_STATES + 1) * sizeof(int));
+    int *pool = NULL, pool_len = 0, pool_cap = 0, *grown;
+    int nstates = 1, d, c, k, q, h;
+
+    *raw = malloc((long) REGEX_MAX_STATES * nclasses * sizeof(int));
+    *accept = malloc(REGEX_MAX_STATES);
+    memset(table, -1, hsize * sizeof(int));
+
+    //State 0 is the closure of the start state
+    count = 0;
+    closure(nfa, start, stamp, ++mark, list, &count, stack);
+    qsort(list, count, sizeof(int), compare_ints);
+    nstart = count;
+    pool_cap = 1024 + count;
+    pool = malloc(pool_cap * sizeof(int));
+    memcpy(pool, list, count * sizeof(int));
+    pool_len = count;
+    first[0] = 0;
+    first[1] = count;
+    table[hash_ints(list, count) & (hsize - 1)] = 0;
+
+    for (d = 0; d < nstates && nstates > 0; d++) {
+        (*accept)[d] = 0;
+        for (k = first[d]; k < first[d + 1]; k++)
+            if (NFA_MATCH == nfa->type[pool[k]])
+                (*accept)[d] = 1;
+
+        for (c = 0; c < nclasses; c++) {
+            count = 0;
+            ++mark;
+            for (k = 0; k < nstart; k++)
+                closure(nfa, pool[k], stamp, mark, list, &count, stack);
+            for (k = first[d]; k < first[d + 1]; k++) {
+                q = pool[k];
+                if (NFA_SET == nfa->type[q] && SET_HAS(sets[nfa->arg[q]], rep[c]))
+                    closure(nfa, nfa->out1[q], stamp, mark, list, &count, stack);
+            }
+            qsort(list, count, sizeof(int), compare_ints);
+
+            for (h = hash_ints(list, count) & (hsize - 1); table[h] >= 0; h = (h + 1) & (hsize - 1))
+                if (first[table[h] + 1] - first[table[h]] == count &&
+                    memcmp(pool + first[table[h]], list, count * sizeof(int)) == 0)
+                    break;
+            if (table[h] < 0) {
+                if (nstates == REGEX_MAX_STATES) {
+                    nstates = -1;
+                    break;
+                }
+                if (pool_len + count > pool_cap) {
+                    grown = realloc(pool, 2 * (pool_len + count) * sizeof(int));
+                    if (NULL == grown) {
+                        nstates = -1;
+                        break;
+                    }
+                    pool = grown;
+                    pool_cap = 2 * (pool_len + count);
+                }
+                memcpy(pool + pool_len, list, count * sizeof(int));
+                pool_len += count;
+                table[h] = nstates;
+                first[++nstates] = pool_len;
+            }
+            (*raw)[(long) d * nclasses + c] = table[h];
+        }
+    }
+
+    free(pool);
+    free(first);
+    free(list);
+    free(stack);
+    free(stamp);
+    free(table);
+    return nstates;
+}
+
+/******************************************************************************/
+/* Moore's partition refinement: states start split into accepting and not,
+   and a block is split while its states move to different blocks on some
+   class. Returns the number of blocks, with the block of each state in
+   part. */
+static int minimize(int nstates, int nclasses, const int *raw, const unsigned char *accept,
+                    int *part)
+{
+    int width = nclasses + 1;
+    int *sig = malloc((long) nstates * width * sizeof(int));
+    int hsize = 4 * REGEX_MAX_STATES, *table = malloc(hsize * sizeof(int));
+    int nparts = 0, newparts, s, c, h;
+
+    for (s = 0; s < nstates; s++)
+        part[s] = accept[s];
+    for (;;) {
+        for (s = 0; s < nstates; s++) {
+            sig[(long) s * width] = part[s];
+            for (c = 0; c < nclasses; c++)
+                sig[(long) s * width + 1 + c] = part[raw[(long) s * nclasses + c]];
+        }
+
+        //Number the distinct signatures
+        memset(table, -1, hsize * sizeof(int));
+        newparts = 0;
+        for (s = 0; s < nstates; s++) {
+            for (h = hash_ints(sig + (long) s * width, width) & (hsize - 1); table[h] >= 0;
+                 h = (h + 1) & (hsize - 1))
+                if (memcmp(sig + (long) table[h] * width, sig + (long) s * width,
+                           width * sizeof(int)) == 0)
+                    break;
+            if (table[h] < 0) {
+                table[h] = s;
+                part[s] = newparts++;
+            }
+            else
+                part[s] = part[table[h]];
+        }
+        if (newparts == nparts)
+            break;
+        nparts = newparts;
+    }
+
+    free(table);
+    free(sig);
+    return nparts;
+}
+
+/******************************************************************************/
+int regex_compile(struct regex_dfa *d, const char *pattern, char *err, int errlen)
+{
+    struct rx_parser ps;
+    struct rx_nfa nfa;
+    unsigned char rep[256], *accept = NULL;
+    int map[512], root, start, nraw = -1, b, k, s, c, t, ncls;
+    int *raw = NULL, *part = NULL;
+
+    memset(d, 0, sizeof(*d));
+    memset(&ps, 0, sizeof(ps));
+    memset(&nfa, 0, sizeof(nfa));
+    err[0] = '\0';
+    ps.p      = (const unsigned char *) pattern;
+    ps.err    = err;
+    ps.errlen = errlen;
+    ps.cap    = 256;
+    ps.nodes  = malloc(ps.cap * sizeof(*ps.nodes));
+    ps.sets   = malloc((strlen(pattern) + 1) * sizeof(*ps.sets));
+
+    root = parse_alt(&ps);
+    if (root >= 0 && *ps.p != '\0')
+        root = fail(&ps, "unmatched )");
+    if (root < 0)
+        goto done;
+
+    //Byte classes: bytes are split apart by every set one is in and the
+    // other is not
+    memset(d->cls, 0, sizeof(d->cls));
+    d->nclasses = 1;
+    for (k = 0; k < ps.nsets; k++) {
+        for (c = 0; c < 2 * d->nclasses; c++)
+            map[c] = -1;
+        ncls = 0;
+        for (b = 0; b < 256; b++) {
+            c = 2 * d->cls[b] + SET_HAS(ps.sets[k], b);
+            if (map[c] < 0)
+                map[c] = ncls++;
+            d->cls[b] = (unsigned char) map[c];
+        }
+        d->nclasses = ncls;
+    }
+    for (b = 255; b >= 0; b--)
+        rep[d->cls[b]] = (unsigned char) b;
+
+    nfa.type = malloc(REGEX_MAX_NODES * sizeof(int));
+    nfa.arg  = malloc(REGEX_MAX_NODES * sizeof(int));
+    nfa.out1 = malloc(REGEX_MAX_NODES * sizeof(int));
+    nfa.out2 = malloc(REGEX_MAX_NODES * sizeof(int));
+    start = build(&nfa, ps.nodes, root, nfa_add(&nfa, NFA_MATCH, 0, 0, 0));
+    if (start < 0) {
+        fail(&ps, "pattern too large");
+        goto done;
+    }
+
+    nraw = subsets(&nfa, start, (const unsigned char (*)[32]) ps.sets, rep, d->nclasses, &raw,
+                   &accept);
+    if (nraw < 0) {
+        fail(&ps, "pattern needs too many states");
+        goto done;
+    }
+
+    part = malloc(nraw * sizeof(int));
+    d->nstates = minimize(nraw, d->nclasses, raw, accept, part);
+    d->delta   = malloc((long) d->nstates * d->nclasses * sizeof(int));
+    d->accept  = malloc(d->nstates);
+    for (s = 0; s < nraw; s++)
+        d->accept[part[s]] = accept[s];
+    for (s = 0; s < nraw; s++)
+        for (c = 0; c < d->nclasses; c++) {
+            t = part[raw[(long) s * d->nclasses + c]];
+            d->delta[(long) part[s] * d->nclasses + c] = regex_entry(d, t);
+        }
+    d->start = regex_entry(d, part[0]);
+
+done:
+    free(part);
+    free(accept);
+    free(raw);
+    free(nfa.type);
+    free(nfa.arg);
+    free(nfa.out1);
+    free(nfa.out2);
+    free(ps.sets);
+    free(ps.nodes);
+    if (err[0] != '\0') {
+        regex_free(d);
+        return -1;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+void regex_free(struct regex_dfa *d)
+{
+    free(d->delta);
+    free(d->accept);
+    d->delta  = NULL;
+    d->accept = NULL;
+}
+
+/******************************************************************************/
+int regex_state(const struct regex_dfa *d, int entry)
+{
+    return (entry >> 1) / d->nclasses;
+}
+
+int regex_entry(const struct regex_dfa *d, int state)
+{
+    return ((state * d->nclasses) << 1) | d->accept[state];
+}
+
+/******************************************************************************/
+/* Reads text backwards from *entry, leaving the last entry there, and
+   returns the matches in increasing order */
+static long *scan_back(const struct regex_dfa *d, const unsigned char *text, long n, int *entry,
+                       long *count)
+{
+    const int *delta = d->delta;
+    const unsigned char *cls = d->cls;
+    long size = 1024, k = 0, i, t;
+    long *found = malloc(size * sizeof(long));
+    int e = *entry;
+
+    for (i = n - 1; i >= 0; i--) {
+        e = delta[(e >> 1) + cls[text[i]]];
+        if (e & 1) {
+            if (k == size) {
+                size *= 2;
+                found = realloc(found, size * sizeof(long));
+            }
+            found[k++] = i;
+        }
+    }
+    for (i = 0; i < k / 2; i++) {
+        t = found[i];
+        found[i] = found[k - 1 - i];
+        found[k - 1 - i] = t;
+    }
+    *entry = e;
+    *count = k;
+    return found;
+}
+
+long *regex_scan(const struct regex_dfa *d, const char *text, long n, int entry, long *count)
+{
+    return scan_back(d, (const unsigned char *) text, n, &entry, count);
+}
+
+/******************************************************************************/
+long *regex_scan_all(const struct regex_dfa *d, const char *text, long n, int *map,
+                     long *settled, long *count)
+{
+    const unsigned char *t = (const unsigned char *) text;
+    int ns = d->nstates;
+    int *run   = malloc(ns * sizeof(int)); /* entry of each distinct run   */
+    int *of    = malloc(ns * sizeof(int)); /* run followed from each state */
+    int *merge = malloc(ns * sizeof(int)); /* run that each run joined     */
+    int *seen  = malloc(ns * sizeof(int));
+    int nruns = ns, kept, j, s, c, e;
+    long i = n, stop;
+    long *found;
+
+    for (s = 0; s < ns; s++) {
+        run[s]  = regex_entry(d, s);
+        of[s]   = s;
+        seen[s] = -1;
+    }
+
+    //Step every run, merging the runs that have met every 16 bytes
+    while (nruns > 1 && i > 0) {
+        for (stop = i > 16 ? i - 16 : 0; i > stop; ) {
+            c = d->cls[t[--i]];
+            for (j = 0; j < nruns; j++)
+                run[j] = d->delta[(run[j] >> 1) + c];
+        }
+        kept = 0;
+        for (j = 0; j < nruns; j++) {
+            s = regex_state(d, run[j]);
+            if (seen[s] < 0) {
+                seen[s] = kept;
+                run[kept++] = run[j];
+            }
+            merge[j] = seen[s];
+        }
+        for (j = 0; j < kept; j++)
+            seen[regex_state(d, run[j])] = -1;
+        for (s = 0; s < ns; s++)
+            of[s] = merge[of[s]];
+        nruns = kept;
+    }
+    *settled = n - i;
+
+    //One run is left for the rest of the text
+    if (nruns == 1) {
+        e = run[0];
+        found = scan_back(d, t, i, &e, count);
+        for (s = 0; s < ns; s++)
+            map[s] = regex_state(d, e);
+    }
+    else {
+        found = malloc(sizeof(long));
+        *count = 0;
+        for (s = 0; s < ns; s++)
+            map[s] = regex_state(d, run[of[s]]);
+    }
+
+    free(seen);
+    free(merge);
+    free(of);
+    free(run);
+    return found;
+}
@@ -0,0 +1,72 @@
+#ifndef REGEX_DFA_H
+#define REGEX_DFA_H
+
+#define REGEX_MAX_STATES  4096   /* largest DFA built, before minimizing     */
+#define REGEX_MAX_NODES   65536  /* largest pattern, after expanding {m,n}   */
+
+/* A regular expression compiled to a minimal DFA that reads the text
+   backwards, from its last byte to its first, and is in an accepting state
+   after reading text[i] exactly when a match starts at i. It is unanchored:
+   every state also tracks a match that starts at the byte it reads next.
+   Bytes are mapped to classes of bytes the pattern does not tell apart, and
+   each entry of the transition table holds the offset of the next state's
+   row times 2, plus 1 if that state accepts, so the scan costs one load and
+   one test per byte. With a few dozen states and classes the table fits in
+   the L1 cache. */
+struct regex_dfa {
+    int             nstates;
+    int             nclasses;
+    unsigned char   cls[256];   /* byte class of each byte                 */
+    int            *delta;      /* nstates rows of nclasses entries        */
+    unsigned char  *accept;     /* nonzero for accepting states            */
+    int             start;      /* entry of the start state                */
+};
+
+/******************************************************************************/
+/** regex_compile(d, pattern, err, errlen)
+ *  Compiles pattern, which may use literal bytes, . (any byte but newline),
+ *  [...] and [^...] sets with ranges, the escapes \d \w \s \D \W \S \n \t
+ *  \r and \ before any other byte to take it literally, ( ), |, and the
+ *  repeats * + ? {m} {m,} {m,n} with m, n up to 255. Returns 0, or -1 with a
+ *  message of at most errlen bytes in err if the pattern is malformed or its
+ *  DFA has more than REGEX_MAX_STATES states.
+ */
+int regex_compile(struct regex_dfa *d, const char *pattern, char *err, int errlen);
+
+/******************************************************************************/
+/** regex_free(d)
+ *  Releases the tables of d.
+ */
+void regex_free(struct regex_dfa *d);
+
+/******************************************************************************/
+/** regex_state(d, entry) / regex_entry(d, state)
+ *  Convert between table entries and state numbers 0..nstates-1.
+ */
+int regex_state(const struct regex_dfa *d, int entry);
+int regex_entry(const struct regex_dfa *d, int state);
+
+/******************************************************************************/
+/** regex_scan(d, text, n, entry, &count)
+ *  Reads the n bytes at text backwards from the state of entry, and returns
+ *  the offsets at which a match starts in increasing order, in an array of
+ *  *count entries to be freed by the caller.
+ */
+long *regex_scan(const struct regex_dfa *d, const char *text, long n, int entry, long *count);
+
+/******************************************************************************/
+/** regex_scan_all(d, text, n, map, &settled, &count)
+ *  Reads the n bytes at text backwards from every state at once, for text
+ *  whose following bytes are not known yet. Sets map[s] to the state reached
+ *  from state s. The runs from different states mostly meet within a few
+ *  bytes, after which one run is followed; *settled is set to the number of
+ *  bytes at the end of text read before they all met (n if they never did).
+ *  Returns the offsets below n - *settled at which a match starts, which do
+ *  not depend on the state text is entered in, as regex_scan() does. The
+ *  others are found by regex_scan() of the last *settled bytes, once that
+ *  state is known.
+ */
+long *regex_scan_all(const struct regex_dfa *d, const char *text, long n, int *map,
+                     long *settled, long *count);
+
+#endif
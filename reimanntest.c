@@ -1,26 +1,25 @@
+// Serial check of the midpoint approximation of ln(x), using the reference
+// kernel the MPI programs are checked against (see check_integrators.c)
+//
+// BUILD INSTRUCTIONS - gcc -Wall -o <object name> reimanntest.c -lm
+//                      <object name> [<x> [<# of partitions>]]
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include "riemann.c"
+#include "quadrature.c"
 
-double approx_log(int partitions, int trg){
-    double i;
-    double sum, x, dx;
-
-    dx = ((double)trg - 1.0) / (double) partitions;
-    sum = 0.0;
-
-    for (i = 1; i < trg; i+=dx){
-        sum += 1/i;
-    }
-
-    return sum*dx;
-
-}
-
-int main(){
-    int partitions = 1000000;
-    int trg = 10;
+int main(int argc, char* argv[]){
+    long partitions = 1000000;
+    double trg = 10;
     double sum;
-    sum = approx_log(partitions, trg);
+
+    if(argc > 1)
+        trg = atof(argv[1]);
+    if(argc > 2)
+        partitions = strtoll(argv[2], NULL, 10);
+    sum = approx_log_reference(partitions, trg);
     printf("estimate is %.16f\n", sum);
+    printf("error is %.16f\n", fabs(sum - log(trg)));
 }
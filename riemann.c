@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "riemann.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static double (*midpoint_impl)(long, long, double) = NULL;
+
+/******************************************************************************/
+/* Portable kernel. Four independent accumulators let consecutive divides and
+   adds overlap instead of each add waiting for the previous one. */
+static double midpoint_sum_scalar(long first, long last, double dx)
+{
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    double h = (double)first - 0.5;    /* i - 0.5, exact below 2^52       */
+    long   i;
+
+    for (i = first; i + 3 <= last; i += 4, h += 4.0) {
+        s0 += 1 / (dx * h + 1);
+        s1 += 1 / (dx * (h + 1.0) + 1);
+        s2 += 1 / (dx * (h + 2.0) + 1);
+        s3 += 1 / (dx * (h + 3.0) + 1);
+    }
+    for (; i <= last; i++, h += 1.0)
+        s0 += 1 / (dx * h + 1);
+
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef HAVE_X86_KERNELS
+/* The vector kernels avoid the divider, whose throughput is no better per
+   element for wide vectors than for scalars. They start from the hardware
+   reciprocal estimate and refine it with Newton-Raphson steps,
+   r' = r + r*(1 - x*r), each of which doubles the number of correct bits,
+   until the reciprocal is within an ulp or so of 1/x. */
+
+/******************************************************************************/
+/* AVX2: 4 accumulators of 4 lanes, 16 partitions per pass. The estimate is
+   the 12-bit single precision one, so it takes three steps. It is only good
+   while x and 1/x are normal floats; lanes of x beyond RECIP_AVX2_MAX, whose
+   estimate would be 0 or inf, are divided instead. */
+#define RECIP_AVX2_MAX  0x1p125
+
+__attribute__((target("avx2,fma")))
+static inline __m256d recip_avx2(__m256d x)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d big = _mm256_cmp_pd(x, _mm256_set1_pd(RECIP_AVX2_MAX), _CMP_GT_OQ);
+    __m256d r = _mm256_cvtps_pd(_mm_rcp_ps(_mm256_cvtpd_ps(_mm256_min_pd(x,
+                    _mm256_set1_pd(RECIP_AVX2_MAX)))));
+
+    r = _mm256_fmadd_pd(r, _mm256_fnmadd_pd(x, r, one), r);
+    r = _mm256_fmadd_pd(r, _mm256_fnmadd_pd(x, r, one), r);
+    r = _mm256_fmadd_pd(r, _mm256_fnmadd_pd(x, r, one), r);
+    if (!_mm256_testz_pd(big, big))
+        r = _mm256_blendv_pd(r, _mm256_div_pd(one, x), big);
+    return r;
+}
+
+__attribute__((target("avx2,fma")))
+static double midpoint_sum_avx2(long first, long last, double dx)
+{
+    const __m256d one  = _mm256_set1_pd(1.0);
+    const __m256d vdx  = _mm256_set1_pd(dx);
+    const __m256d step = _mm256_set1_pd(16.0);
+    __m256d h0 = _mm256_add_pd(_mm256_set_pd(3.0, 2.0, 1.0, 0.0),
+                               _mm256_set1_pd((double)first - 0.5));
+    __m256d h1 = _mm256_add_pd(h0, _mm256_set1_pd(4.0));
+    __m256d h2 = _mm256_add_pd(h0, _mm256_set1_pd(8.0));
+    __m256d h3 = _mm256_add_pd(h0, _mm256_set1_pd(12.0));
+    __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+    __m256d acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+    double  lanes[4];
+    long    i = first;
+
+    for (; i + 15 <= last; i += 16) {
+        acc0 = _mm256_add_pd(acc0, recip_avx2(_mm256_fmadd_pd(vdx, h0, one)));
+        acc1 = _mm256_add_pd(acc1, recip_avx2(_mm256_fmadd_pd(vdx, h1, one)));
+        acc2 = _mm256_add_pd(acc2, recip_avx2(_mm256_fmadd_pd(vdx, h2, one)));
+        acc3 = _mm256_add_pd(acc3, recip_avx2(_mm256_fmadd_pd(vdx, h3, one)));
+        h0 = _mm256_add_pd(h0, step);
+        h1 = _mm256_add_pd(h1, step);
+        h2 = _mm256_add_pd(h2, step);
+        h3 = _mm256_add_pd(h3, step);
+    }
+
+    acc0 = _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3));
+    _mm256_storeu_pd(lanes, acc0);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3])
+         + midpoint_sum_scalar(i, last, dx);
+}
+
+/******************************************************************************/
+/* AVX-512: 4 accumulators of 8 lanes, 32 partitions per pass. The estimate
+   is good to 14 bits, so two steps suffice. */
+__attribute__((target("avx512f")))
+static inline __m512d recip_avx512(__m512d x)
+{
+    const __m512d one = _mm512_set1_pd(1.0);
+    __m512d r = _mm512_rcp14_pd(x);
+
+    r = _mm512_fmadd_pd(r, _mm512_fnmadd_pd(x, r, one), r);
+    r = _mm512_fmadd_pd(r, _mm512_fnmadd_pd(x, r, one), r);
+    return r;
+}
+
+__attribute__((target("avx512f")))
+static double midpoint_sum_avx512(long first, long last, double dx)
+{
+    const __m512d one  = _mm512_set1_pd(1.0);
+    const __m512d vdx  = _mm512_set1_pd(dx);
+    const __m512d step = _mm512_set1_pd(32.0);
+    __m512d h0 = _mm512_add_pd(_mm512_set_pd(7.0, 6.0, 5.0, 4.0, 3.0, 2.0, 1.0, 0.0),
+                               _mm512_set1_pd((double)first - 0.5));
+    __m512d h1 = _mm512_add_pd(h0, _mm512_set1_pd(8.0));
+    __m512d h2 = _mm512_add_pd(h0, _mm512_set1_pd(16.0));
+    __m512d h3 = _mm512_add_pd(h0, _mm512_set1_pd(24.0));
+    __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+    __m512d acc2 = _mm512_setzero_pd(), acc3 = _mm512_setzero_pd();
+    long    i = first;
+
+    for (; i + 31 <= last; i += 32) {
+        acc0 = _mm512_add_pd(acc0, recip_avx512(_mm512_fmadd_pd(vdx, h0, one)));
+        acc1 = _mm512_add_pd(acc1, recip_avx512(_mm512_fmadd_pd(vdx, h1, one)));
+        acc2 = _mm512_add_pd(acc2, recip_avx512(_mm512_fmadd_pd(vdx, h2, one)));
+        acc3 = _mm512_add_pd(acc3, recip_avx512(_mm512_fmadd_pd(vdx, h3, one)));
+        h0 = _mm512_add_pd(h0, step);
+        h1 = _mm512_add_pd(h1, step);
+        h2 = _mm512_add_pd(h2, step);
+        h3 = _mm512_add_pd(h3, step);
+    }
+
+    acc0 = _mm512_add_pd(_mm512_add_pd(acc0, acc1), _mm512_add_pd(acc2, acc3));
+    return _mm512_reduce_add_pd(acc0) + midpoint_sum_scalar(i, last, dx);
+}
+#endif
+
+/******************************************************************************/
+int select_midpoint_kernel(int kernel)
+{
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (KERNEL_AUTO == kernel ||
+        (KERNEL_AVX512 == kernel && !__builtin_cpu_supports("avx512f")) ||
+        (KERNEL_AVX2 == kernel && !(__builtin_cpu_supports("avx2") &&
+                                    __builtin_cpu_supports("fma")))) {
+        if (__builtin_cpu_supports("avx512f"))
+            kernel = KERNEL_AVX512;
+        else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            kernel = KERNEL_AVX2;
+        else
+            kernel = KERNEL_SCALAR;
+    }
+    if (KERNEL_AVX512 == kernel)
+        midpoint_impl = midpoint_sum_avx512;
+    else if (KERNEL_AVX2 == kernel)
+        midpoint_impl = midpoint_sum_avx2;
+    else
+        midpoint_impl = midpoint_sum_scalar;
+#else
+    kernel = KERNEL_SCALAR;
+    midpoint_impl = midpoint_sum_scalar;
+#endif
+    return kernel;
+}
+
+/******************************************************************************/
+const char *midpoint_kernel_name(int kernel)
+{
+    switch (kernel) {
+        case KERNEL_SCALAR: return "scalar";
+        case KERNEL_AVX2:   return "avx2";
+        case KERNEL_AVX512: return "avx512";
+        default:            return "auto";
+    }
+}
+
+/******************************************************************************/
+double midpoint_sum(long first, long last, double dx)
+{
+    if (NULL == midpoint_impl)
+        select_midpoint_kernel(KERNEL_AUTO);
+    if (last < first)
+        return 0.0;
+    return midpoint_impl(first, last, dx);
+}
+
+/******************************************************************************/
+double approx_log_reference(long partitions, double trg)
+{
+    double dx = (trg - 1.0) / (double) partitions;
+    double sum = 0.0, c = 0.0, term, t;
+    long   i;
+
+    /* The terms are positive and decreasing, so sum >= term and (sum - t) +
+       term recovers exactly what the add of term lost */
+    for (i = 1; i <= partitions; i++) {
+        term = 1 / (dx * ((double) i - 0.5) + 1);
+        t    = sum + term;
+        c   += (sum - t) + term;
+        sum  = t;
+    }
+
+    return (sum + c) * dx;
+}
+
+/******************************************************************************/
+double approx_log_cyclic(long partitions, double trg, int id, int p)
+{
+    double sum = 0.0, dx;
+    long   i;
+
+    dx = (trg - 1.0) / (double) partitions;
+
+    //Each pass of the loop will assign a partition dependent on the number of
+    // processors in use
+    for (i = (long) id + 1; i <= partitions; i += p)
+        sum += 1 / (dx * ((double) i - 0.5) + 1);
+
+    return sum * dx;
+}
+
+/******************************************************************************/
+double approx_log_block(long partitions, double trg, int id, int p)
+{
+    double dx;
+    long   first, last;
+
+    dx = (trg - 1.0) / (double) partitions;
+
+    //Each process takes one contiguous run of partitions
+    first = (long) id * partitions / p + 1;
+    last  = (long) (id + 1) * partitions / p;
+
+    return midpoint_sum(first, last, dx) * dx;
+}
+
+/******************************************************************************/
+//The integrand whose integral from 1 to x is ln(x)
+static double inv_x(double x, void *ctx)
+{
+    (void) ctx;
+    return 1 / x;
+}
+
+void approx_log_quad(int rule, long partitions, double tol, double trg, int id, int p,
+                     struct quad_result *res)
+{
+    double dx;
+    long   first, last;
+
+    if (QUAD_ROMBERG == rule || QUAD_ADAPTIVE == rule) {
+        //Each process refines its own share of [1, trg] to its share of tol
+        dx = (trg - 1.0) / (double) p;
+        if (QUAD_ROMBERG == rule)
+            quad_romberg(inv_x, NULL, 1 + dx * id, 1 + dx * (id + 1), tol / p, res);
+        else
+            quad_adaptive(inv_x, NULL, 1 + dx * id, 1 + dx * (id + 1), tol / p, res);
+    }
+    else {
+        //Each process takes a contiguous block of the panels
+        dx    = (trg - 1.0) / (double) partitions;
+        first = (long) id * partitions / p;
+        last  = (long) (id + 1) * partitions / p;
+        quad_composite(rule, inv_x, NULL, 1 + dx * first, 1 + dx * last, last - first, res);
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef RIEMANN_H
+#define RIEMANN_H
+
+#include "quadrature.h"
+
+/* Midpoint sum kernels, selectable for testing and benchmarking */
+#define KERNEL_AUTO     0   /* widest kernel the CPU supports                */
+#define KERNEL_SCALAR   1
+#define KERNEL_AVX2     2
+#define KERNEL_AVX512   3
+
+/******************************************************************************/
+/** select_midpoint_kernel(kernel)
+ *  Chooses the implementation used by midpoint_sum(). KERNEL_AUTO picks the
+ *  widest one the CPU supports at run time; asking for a kernel the CPU (or
+ *  compiler) cannot run also falls back that way. Returns the KERNEL_* value
+ *  actually selected.
+ */
+int select_midpoint_kernel(int kernel);
+
+/******************************************************************************/
+/** midpoint_kernel_name(kernel)
+ *  Returns a printable name for a KERNEL_* value.
+ */
+const char *midpoint_kernel_name(int kernel);
+
+/******************************************************************************/
+/** midpoint_sum(first, last, dx)
+ *  Returns the sum of 1/x over the midpoints x = dx*(i - 0.5) + 1 of the
+ *  partitions i = first..last. The sum is split over several independent
+ *  accumulators (and SIMD lanes), and the vector kernels compute 1/x by
+ *  Newton-Raphson refinement of the hardware reciprocal estimate rather than
+ *  by division, which leaves each term within about an ulp of the divided
+ *  value. The result therefore differs from a single serial accumulator only
+ *  by rounding: a relative difference below 1e-13 up to 10^10 partitions.
+ */
+double midpoint_sum(long first, long last, double dx);
+
+/******************************************************************************/
+/** approx_log_reference(partitions, trg)
+ *  Serial reference for the midpoint approximation of ln(trg): the sum of
+ *  1/x over the midpoints x = dx*(i - 0.5) + 1, i = 1..partitions, times
+ *  dx = (trg - 1)/partitions. Each midpoint is computed from its index, and
+ *  the sum is compensated, so the result is within a few ulps of the exact
+ *  midpoint sum. It is slow and is meant for checking the other variants.
+ */
+double approx_log_reference(long partitions, double trg);
+
+/******************************************************************************/
+/** approx_log_cyclic(partitions, trg, id, p)
+ *  Midpoint approximation of ln(trg) with the partitions dealt out
+ *  cyclically: process id of p sums partitions id+1, id+1+p, ... up to
+ *  partitions, so the partial results of all processes add up to the
+ *  approximation.
+ */
+double approx_log_cyclic(long partitions, double trg, int id, int p);
+
+/******************************************************************************/
+/** approx_log_block(partitions, trg, id, p)
+ *  Midpoint approximation of ln(trg) with the work split in contiguous
+ *  blocks: process id of p sums partitions floor(id*n/p)+1 up to
+ *  floor((id+1)*n/p) with midpoint_sum(). It covers the same partitions as
+ *  approx_log_cyclic(), so the two differ only by rounding.
+ */
+double approx_log_block(long partitions, double trg, int id, int p);
+
+/******************************************************************************/
+/** approx_log_quad(rule, partitions, tol, trg, id, p, &res)
+ *  Approximation of ln(trg) with the quadrature engine. The composite rules
+ *  split the partitions (their panels) in contiguous blocks as
+ *  approx_log_block() does. QUAD_ROMBERG and QUAD_ADAPTIVE ignore partitions
+ *  and refine process id's 1/p of [1, trg] until its error estimate is at
+ *  most tol/p. res holds this process's part of the integral, its error
+ *  estimate and the number of evaluations of 1/x it took.
+ */
+void approx_log_quad(int rule, long partitions, double tol, double trg, int id, int p,
+                     struct quad_result *res);
+
+#endif
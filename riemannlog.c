@@ -3,101 +3,315 @@
 // partitions they would like to divide the area under the curve into
 //
 // BUILD INSTRUCTIONS:
-//  $ mpicc -Wall -o <target filename> <source name> -lm
+//  $ mpicc -Wall -fopenmp -o <target filename> <source name> -lm
 // RUN INSUTRUCTIONS:
-//  $ mpirun -np n <target filename> <value to approx> <# of partitions>
+//  $ mpirun -np n <target filename> [-m <mode>] [-k <kernel>] [-t <threads>] [-r <rule> [-e <tol>]] <value to approx> <# of partitions>
+//  $ mpirun -np n <target filename> [options] -f <targets file> [-b <batch>] <# of partitions>
+//
+// <value to approx> may be any real x >= 1 and <# of partitions> may be
+// above 2^31.
+// <mode> is how partitions are split among processes:
+//   cyclic - (default) process id takes partitions id+1, id+1+p, ...
+//   block  - each process takes one contiguous block and sums it with the
+//            SIMD kernel in riemann.c. The result agrees with cyclic mode
+//            to within rounding (see riemann.h)
+// <kernel> forces the block mode kernel: auto (default), scalar, avx2, avx512
+// <threads> is the number of OpenMP threads per rank (default 1). Each thread
+// works as one of n*<threads> virtual processes, so the result is the same as
+// with n*<threads> ranks. Run one rank per socket or node and let each rank
+// keep the cores it was given, e.g.
+//  $ export OMP_PLACES=cores OMP_PROC_BIND=close
+//  $ mpirun --map-by ppr:1:socket:pe=16 <target filename> -t 16 ...
+// Thread placement follows OMP_PLACES/OMP_PROC_BIND and is left alone.
+// <rule> replaces the midpoint sum with the quadrature engine in quadrature.c:
+//   simpson, gauss - composite Simpson or 7-point Gauss-Legendre rule on
+//                    <# of partitions> panels, split in contiguous blocks
+//   romberg        - Romberg extrapolation on each process's share of [1, x]
+//   adaptive       - adaptive Gauss-Kronrod bisection on each share
+// <tol> is the wanted absolute error for romberg and adaptive (default 1e-14);
+// each process works to <tol>/n. With a rule, two more columns are printed:
+// the error estimate summed over processes and the number of evaluations.
+// -f computes every x listed in <targets file> ("-" for stdin), one per line;
+// blank lines and lines starting with # are skipped. Rank 0 reads <batch>
+// targets at a time (default 1024) and broadcasts them, all ranks compute the
+// whole batch, and one reduce of a vector collects it. A line is printed per
+// target as each batch completes; the time column is the batch time divided
+// evenly among its targets.
 
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "riemann.c"
+#include "quadrature.c"
 
-/*Approximation of ln(x) by approximation of the area under the curve y = 1/x
- for values of x greater than 1
- @param: partitions - the number of divisions desired for the area under the curve
-       trg - the target value the user wishes to approximate the natural log (ln(trg)) of
-       id - the process id
-       p - the number of processors being used for the computation
- @pre:
- @post: the function has determined the width of each partition and caluclated
-        the area of each of those partitions it should calculate based on the
-        number of processors being used
- @return: returns the sum of the areas of each rectangle multiplied by the differential (dx)
-*/
-double approx_log(int partitions, int trg, int id, int p){
-    int i;
-    double sum, x, dx;
+#define MODE_CYCLIC 0
+#define MODE_BLOCK  1
 
-    dx = ((double)trg - 1.0) / (double) partitions;
-    sum = 0.0;
+#define DEFAULT_BATCH 1024
 
-    //Each pass of the loop will assign a partition dependent on the number of
-    // processors in use
-    for (i = id+1; i <= partitions+1; i += p){
-        x = dx * ((double)i - 0.5) + 1;
-        sum += 1/x;
-    }
+/*Parses one target, which may have blanks after it
+ @return: 0, or -1 if str is not a finite number of at least 1
+*/
+int parse_target(const char *str, double *x){
+    char *end;
 
-    return sum*dx;
+    errno = 0;
+    *x = strtod(str, &end);
+    //NaN fails every comparison, so x >= 1 is tested rather than x < 1
+    if(end == str || strspn(end, " \t\r\n") != strlen(end) || ERANGE == errno ||
+       !(*x >= 1) || !isfinite(*x))
+        return -1;
+    return 0;
+}
+
+/*Reads up to max targets, one per line, from in
+ @post: bad lines and targets below 1 are reported on stderr and skipped
+ @return: the number of targets stored in x, 0 at the end of the input
+*/
+int read_targets(FILE *in, double *x, int max){
+    char line[256];
+    char *start;
+    int count = 0;
 
+    while(count < max && fgets(line, sizeof(line), in) != NULL){
+        start = line + strspn(line, " \t\r\n");
+        if(*start == '\0' || *start == '#')
+            continue;
+        if(parse_target(line, &x[count]) != 0){
+            fprintf(stderr, "Skipping target %s", line);
+            continue;
+        }
+        ++count;
+    }
+    return count;
 }
 
 int main(int argc, char* argv[])
 {
+    int opt;
+    int mode = MODE_CYCLIC;
+    int kernel = KERNEL_AUTO;
+    int threads = 1; //threads per rank
+    int t;
+    int provided; //thread support level granted by MPI
+    int rule = -1; //quadrature rule, -1 for the midpoint sum
+    double tol = 1e-14; //wanted absolute error for romberg and adaptive
+    char *targets = NULL; //file of targets for batch mode
+    int batch = DEFAULT_BATCH; //targets per broadcast and reduce
+
+    while((opt = getopt(argc, argv, "m:k:t:r:e:f:b:")) != -1){
+        switch(opt){
+        case 'm':
+            if(strcmp(optarg, "block") == 0)
+                mode = MODE_BLOCK;
+            else if(strcmp(optarg, "cyclic") == 0)
+                mode = MODE_CYCLIC;
+            else {
+                printf("Unknown mode %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'k':
+            for(kernel = KERNEL_AVX512; kernel > KERNEL_AUTO; --kernel)
+                if(strcmp(optarg, midpoint_kernel_name(kernel)) == 0)
+                    break;
+            if(KERNEL_AUTO == kernel && strcmp(optarg, "auto") != 0){
+                printf("Unknown kernel %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 't':
+            threads = atoi(optarg);
+            if(threads < 1){
+                printf("Threads per rank must be at least 1. Exiting.\n");
+                exit(1);
+            }
+            break;
+        case 'r':
+            rule = quad_rule_parse(optarg);
+            if(rule < 0){
+                printf("Unknown rule %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'e':
+            tol = atof(optarg);
+            break;
+        case 'f':
+            targets = optarg;
+            break;
+        case 'b':
+            batch = atoi(optarg);
+            if(batch < 1){
+                printf("Batch size must be at least 1. Exiting.\n");
+                exit(1);
+            }
+            break;
+        default:
+            exit(1);
+        }
+    }
+
     //ensure arguments are submitted
-    if(argc < 2){
+    if(argc - optind < (NULL == targets ? 2 : 1)){
         printf("Too few arguments. Exiting.");
         exit(1);
     }
     int id; //procedure id
     int p; //num procedures
-    int trg; //value whose log is determined
-    int partitions; //number of partitions
-    double local_total; //the total area found by a local process
-    double total; //final sum of areas across all processes
+    double *trg; //values whose log is determined, one batch of them
+    long partitions; //number of partitions
+    int count; //number of targets in the current batch
+    char *end; //first character after the partition count
+    int nsums; //values reduced per target
+    int i;
+    FILE *in = NULL; //source of the targets in batch mode
+    double *local; //partial results of this process for the batch:
+                   //areas, then error estimates and evaluations with a rule
+    double *total; //the same, summed across all processes
     double error; //used to calculate the difference
                   //between the approximation and math.log()
     double e_time; // used to evaluate the elapsed time of computation
+    struct quad_result part; //result of the quadrature engine for one thread
 
     //Initialize MPI
-    MPI_Init(&argc, &argv);
+    //Only the main thread of each rank makes MPI calls
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
     MPI_Comm_rank(MPI_COMM_WORLD, &id);
     MPI_Comm_size(MPI_COMM_WORLD, &p);
 
-    //Collect the command line variables and convert to int
-    trg = atoi(argv[1]);
-    partitions = atoi(argv[2]);
+    //Collect the command line variables
+    errno = 0;
+    partitions = strtoll(argv[argc-1], &end, 10);
+    if(end == argv[argc-1] || *end != '\0' || ERANGE == errno){
+        if(id == 0)
+            printf("Bad number of partitions %s. Exiting.\n", argv[argc-1]);
+        MPI_Finalize();
+        exit(1);
+    }
+    if(NULL == targets)
+        batch = 1;
+    nsums = rule >= 0 ? 3 : 1;
+    trg = malloc(batch * sizeof(double));
+    local = malloc((size_t) nsums * batch * sizeof(double));
+    total = malloc((size_t) nsums * batch * sizeof(double));
+    if(NULL != targets)
+        count = 0;
+    else {
+        if(parse_target(argv[optind], &trg[0]) != 0){
+            if(id == 0)
+                printf("Bad log target %s; it must be a finite number of at least 1. Exiting.\n",
+                       argv[optind]);
+            MPI_Finalize();
+            exit(1);
+        }
+        count = 1;
+    }
 
     //Check if the command line variables meet requirements
     if(id == 0){
-        if(trg < 1 || partitions < 1){
+        if(partitions < 1){
             printf("Partitions must be greater than or equal to 1\n");
-            printf("and log target greater than or equal to 2\n");
-            MPI_Finalize();
-            exit(1);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if(NULL != targets){
+            in = strcmp(targets, "-") == 0 ? stdin : fopen(targets, "r");
+            if(NULL == in){
+                perror(targets);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
         }
     }
 
-    //Begin timer
-    MPI_Barrier(MPI_COMM_WORLD);
-    e_time = - MPI_Wtime();
+    //Warn when the threads cannot run side by side
+    if(id == 0 && threads > 1){
+#ifdef _OPENMP
+        if(omp_get_num_procs() < threads)
+            fprintf(stderr, "Warning: %d threads per rank but only %d cpus bound to each rank\n",
+                    threads, omp_get_num_procs());
+#else
+        fprintf(stderr, "Warning: built without OpenMP, threads of a rank run one after another\n");
+#endif
+    }
 
-    //Calculate the approximation and collect results from all tasks
-    local_total = approx_log(partitions, trg, id, p);
+    select_midpoint_kernel(kernel);
 
-    MPI_Reduce(&local_total, &total, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    for(;;){
+        //Rank 0 reads the next batch and shares it, an empty batch ends the run
+        if(NULL != targets){
+            if(id == 0)
+                count = read_targets(in, trg, batch);
+            MPI_Bcast(&count, 1, MPI_INT, 0, MPI_COMM_WORLD);
+            if(count == 0)
+                break;
+            MPI_Bcast(trg, count, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        }
 
-    //Stop timer
-    MPI_Barrier(MPI_COMM_WORLD);
-    e_time += MPI_Wtime();
+        //Begin timer
+        MPI_Barrier(MPI_COMM_WORLD);
+        e_time = - MPI_Wtime();
 
-    //ROOT task will calculate the error and display results
-    if(id == 0){
-        error = fabs(total - log((double)trg));
-        printf("%d \t %.16f \t %.16f \t %f\n", trg, total, error, e_time);
-        fflush(stdout);
+        //Calculate the approximations and collect results from all tasks.
+        // Thread t of this rank acts as virtual process id*threads + t of
+        // p*threads, and the thread partial sums are combined before the reduce
+        memset(local, 0, (size_t) nsums * count * sizeof(double));
+#ifdef _OPENMP
+        #pragma omp parallel for num_threads(threads) schedule(static, 1) private(i, part) \
+                                 reduction(+:local[:nsums*count])
+#endif
+        for(t = 0; t < threads; ++t){
+            for(i = 0; i < count; ++i){
+                if(rule >= 0){
+                    approx_log_quad(rule, partitions, tol, trg[i], id*threads + t, p*threads, &part);
+                    local[i] += part.value;
+                    local[count + i] += part.error;
+                    local[2*count + i] += (double) part.evals;
+                }
+                else if(MODE_BLOCK == mode)
+                    local[i] += approx_log_block(partitions, trg[i], id*threads + t, p*threads);
+                else
+                    local[i] += approx_log_cyclic(partitions, trg[i], id*threads + t, p*threads);
+            }
+        }
+
+        //One reduce for the whole batch; evaluation counts stay exact as
+        // doubles up to 2^53
+        MPI_Reduce(local, total, nsums*count, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+        //Stop timer
+        MPI_Barrier(MPI_COMM_WORLD);
+        e_time += MPI_Wtime();
+
+        //ROOT task will calculate the error and display results
+        if(id == 0){
+            for(i = 0; i < count; ++i){
+                error = fabs(total[i] - log(trg[i]));
+                if(rule >= 0)
+                    printf("%.17g \t %.16f \t %.16f \t %f \t %.3e \t %.0f\n", trg[i], total[i],
+                           error, e_time / count, total[count + i], total[2*count + i]);
+                else
+                    printf("%.17g \t %.16f \t %.16f \t %f\n", trg[i], total[i], error,
+                           e_time / count);
+            }
+            fflush(stdout);
+        }
+
+        if(NULL == targets)
+            break;
     }
 
+    if(NULL != in && stdin != in)
+        fclose(in);
+    free(trg);
+    free(local);
+    free(total);
     MPI_Finalize();
     return 0;
 }
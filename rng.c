@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rng.h"
+
+#define PHILOX_M0       0xD2511F53u
+#define PHILOX_M1       0xCD9E8D57u
+#define PHILOX_W0       0x9E3779B9u     /* key schedule increments */
+#define PHILOX_W1       0xBB67AE85u
+#define PHILOX_ROUNDS   10
+
+/******************************************************************************/
+/* Blocks first .. first+nblocks-1 of a stream into out, four words each.
+   The blocks do not depend on each other, so the loop over them is left
+   for the compiler to vectorize. */
+static void philox_blocks(
+        const uint32_t  key[2],
+        uint64_t        stream,
+        uint64_t        first,
+        uint32_t       *out,
+        size_t          nblocks)
+{
+    size_t b;
+
+    for ( b = 0; b < nblocks; b++ ) {
+        uint32_t c0 = (uint32_t) (first + b), c1 = (uint32_t) ((first + b) >> 32);
+        uint32_t c2 = (uint32_t) stream, c3 = (uint32_t) (stream >> 32);
+        uint32_t k0 = key[0], k1 = key[1];
+        uint64_t p0, p1;
+        int      round;
+
+        for ( round = 0; round < PHILOX_ROUNDS; round++ ) {
+            p0 = (uint64_t) PHILOX_M0 * c0;
+            p1 = (uint64_t) PHILOX_M1 * c2;
+            c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+            c1 = (uint32_t) p1;
+            c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+            c3 = (uint32_t) p0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+        out[4*b]     = c0;
+        out[4*b + 1] = c1;
+        out[4*b + 2] = c2;
+        out[4*b + 3] = c3;
+    }
+}
+
+/******************************************************************************/
+void rng_init(
+        struct rng_stream *r,          /* the stream                          */
+        uint64_t           seed,       /* the user's seed                     */
+        uint64_t           stream)     /* which stream of the seed            */
+{
+    memset(r, 0, sizeof(*r));
+    r->key[0] = (uint32_t) seed;
+    r->key[1] = (uint32_t) (seed >> 32);
+    r->stream = stream;
+}
+
+/******************************************************************************/
+void rng_refill(struct rng_stream *r)
+{
+    philox_blocks(r->key, r->stream, r->block, r->buf, RNG_BATCH / 4);
+    r->block += RNG_BATCH / 4;
+    r->left   = RNG_BATCH;
+}
+
+/******************************************************************************/
+void rng_fill_u32(struct rng_stream *r, uint32_t *out, size_t n)
+{
+    uint32_t last[4];
+
+    philox_blocks(r->key, r->stream, r->block, out, n / 4);
+    r->block += n / 4;
+    if ( n % 4 != 0 ) {
+        philox_blocks(r->key, r->stream, r->block++, last, 1);
+        memcpy(out + n / 4 * 4, last, n % 4 * sizeof(uint32_t));
+    }
+}
+
+/******************************************************************************/
+void rng_fill_double(struct rng_stream *r, double *out, size_t n)
+{
+    uint32_t words[RNG_BATCH];
+    size_t   done, i, m;
+
+    for ( done = 0; done < n; done += m ) {
+        m = n - done < RNG_BATCH ? n - done : RNG_BATCH;
+        rng_fill_u32(r, words, m);
+        for ( i = 0; i < m; i++ )
+            out[done + i] = words[i] * (1.0 / 4294967296.0);
+    }
+}
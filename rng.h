@@ -0,0 +1,88 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Counter-based random numbers: Philox4x32-10 (Salmon et al., "Parallel
+   random numbers: as easy as 1, 2, 3", SC11). Block b of stream s under
+   seed k is a fixed function of (k, s, b), four 32-bit words that pass
+   BigCrush, so a stream needs no state but its counter and any number of
+   streams are independent however they are spread over ranks and threads:
+   give each its own stream number, e.g. rank << 32 | thread. Numbers are
+   made a batch at a time, whose blocks are computed independently of each
+   other so that the compiler can vectorize them, and handed out one by one
+   from a buffer. */
+#define RNG_BATCH   64      /* words made at once, a multiple of 4          */
+
+struct rng_stream {
+    uint32_t key[2];        /* the seed                                     */
+    uint64_t stream;        /* the stream number, high words of the counter */
+    uint64_t block;         /* next block, low words of the counter         */
+    int      left;          /* words of buf not yet handed out              */
+    uint32_t buf[RNG_BATCH];
+};
+
+/******************************************************************************/
+/** rng_init(&r, seed, stream)
+ *  Starts stream number stream of the seed at its first block.
+ */
+void rng_init(
+        struct rng_stream *r,          /* the stream                          */
+        uint64_t           seed,       /* the user's seed                     */
+        uint64_t           stream      /* which stream of the seed            */
+        );
+
+/******************************************************************************/
+/** rng_fill_u32(&r, out, n)
+ *  Sets out[0..n) to the next n words of the stream. Whole blocks are used,
+ *  so the words of a last part block are skipped. Words still in the buffer
+ *  of rng_next_u32() are not used, and stay there.
+ */
+void rng_fill_u32(struct rng_stream *r, uint32_t *out, size_t n);
+
+/******************************************************************************/
+/** rng_fill_double(&r, out, n)
+ *  Sets out[0..n) to uniform doubles in [0, 1), multiples of 2^-32, from the
+ *  next n words, as rng_fill_u32() would give them.
+ */
+void rng_fill_double(struct rng_stream *r, double *out, size_t n);
+
+/******************************************************************************/
+/** rng_refill(&r)
+ *  Fills the buffer of rng_next_u32() with the next RNG_BATCH words.
+ */
+void rng_refill(struct rng_stream *r);
+
+/******************************************************************************/
+/** rng_next_u32(&r)
+ *  Returns the next word of the stream, refilling the buffer a batch at a
+ *  time.
+ */
+static inline uint32_t rng_next_u32(struct rng_stream *r)
+{
+    if ( 0 == r->left )
+        rng_refill(r);
+    return r->buf[RNG_BATCH - r->left--];
+}
+
+/******************************************************************************/
+/** rng_below(&r, n)
+ *  Returns an integer from 0 to n - 1, from the high bits of a word times n.
+ *  For the n of a program here the bias, under n / 2^32, is of no account.
+ */
+static inline int rng_below(struct rng_stream *r, int n)
+{
+    return (int) (((uint64_t) rng_next_u32(r) * (uint32_t) n) >> 32);
+}
+
+/******************************************************************************/
+/** rng_uniform(&r)
+ *  Returns a uniform double in [0, 1), a multiple of 2^-32.
+ */
+static inline double rng_uniform(struct rng_stream *r)
+{
+    return rng_next_u32(r) * (1.0 / 4294967296.0);
+}
+
+#endif
@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "alloc_matrix.h"
+#include "room_build.h"
+
+/* A pairing of two students, s < t, and its cost */
+struct room_edge {
+    double cost;
+    int    s;
+    int    t;
+};
+
+/* The best swap found for a student: of x and y, lowering the cost by -delta */
+struct room_move {
+    double delta;
+    int    x;
+    int    y;
+};
+
+/******************************************************************************/
+/* Orders edges by cost, then by students, so that the order is the same on
+   every rank */
+static int compare_edges(const void *a, const void *b)
+{
+    const struct room_edge *x = a, *y = b;
+
+    if ( x->cost != y->cost )
+        return x->cost < y->cost ? -1 : 1;
+    if ( x->s != y->s )
+        return x->s < y->s ? -1 : 1;
+    return (x->t > y->t) - (x->t < y->t);
+}
+
+/******************************************************************************/
+void room_candidates_build(
+        struct room_candidates  *rc,       /* the candidate lists             */
+        const struct sym_matrix *matrix,   /* symmetric cost matrix           */
+        int                      k,        /* candidates per student          */
+        int                      threads,  /* OpenMP threads per rank         */
+        MPI_Comm                 comm,     /* ranks that share the work       */
+        int                     *errvalue) /* return code for error, if any   */
+{
+    int     n = matrix->n;
+    int     id, p, r, lo, hi;
+    int     local_err;
+    int    *counts, *displs;
+    double *cost;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+    memset(rc, 0, sizeof(*rc));
+
+    if ( k > n - 1 )
+        k = n - 1;
+    if ( k < 1 )
+        k = 1;
+    lo = (int) ((long) id * n / p);
+    hi = (int) ((long) (id + 1) * n / p);
+
+    rc->near = malloc(((size_t) n * k > 0 ? (size_t) n * k : 1) * sizeof(int));
+    cost     = malloc(((size_t) (hi - lo) * k > 0 ? (size_t) (hi - lo) * k : 1) * sizeof(double));
+    counts   = malloc(p * sizeof(int));
+    displs   = malloc(p * sizeof(int));
+    local_err = NULL == rc->near || NULL == cost || NULL == counts || NULL == displs ?
+                MALLOC_ERROR : SUCCESS;
+    MPI_Allreduce(&local_err, errvalue, 1, MPI_INT, MPI_MAX, comm);
+    if ( SUCCESS != *errvalue ) {
+        free(displs);
+        free(counts);
+        free(cost);
+        room_candidates_free(rc);
+        return;
+    }
+    rc->students = n;
+    rc->k        = k;
+
+    /* Step 1: Keep the k cheapest roommates of each student of the block in
+       a sorted list. Later students only displace on a strictly lower cost,
+       so ties go to the lower student. */
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+#endif
+    for ( int s = lo; s < hi; s++ ) {
+        int    *near = rc->near + (size_t) s * k;
+        double *best = cost + (size_t) (s - lo) * k;
+        int     filled = 0, m, t;
+        double  c;
+
+        for ( t = 0; t < n; t++ ) {
+            if ( t == s )
+                continue;
+            c = room_pair_cost(matrix, s, t);
+            if ( filled == k && c >= best[k - 1] )
+                continue;
+            m = filled < k ? filled++ : k - 1;
+            for ( ; m > 0 && best[m - 1] > c; m-- ) {
+                best[m] = best[m - 1];
+                near[m] = near[m - 1];
+            }
+            best[m] = c;
+            near[m] = t;
+        }
+    }
+
+    /* Step 2: Every rank gets every block */
+    for ( r = 0; r < p; r++ ) {
+        displs[r] = (int) ((long) r * n / p) * k;
+        counts[r] = (int) ((long) (r + 1) * n / p) * k - displs[r];
+    }
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, rc->near, counts, displs, MPI_INT, comm);
+
+    free(displs);
+    free(counts);
+    free(cost);
+    *errvalue = SUCCESS;
+}
+
+void room_candidates_free(struct room_candidates *rc)
+{
+    free(rc->near);
+    memset(rc, 0, sizeof(*rc));
+}
+
+/******************************************************************************/
+void room_greedy(
+        struct room_state            *st,        /* set to the assignment    */
+        const struct sym_matrix      *matrix,    /* symmetric cost matrix    */
+        const struct room_candidates *rc,        /* candidate roommates      */
+        int                          *errvalue)  /* return code for error    */
+{
+    int     n = rc->students, k = rc->k;
+    size_t  e, edges = (size_t) n * k;
+    struct room_edge *edge;
+    char   *placed;
+    int    *order, *left;
+    int     s, t, m, i, j, nleft, count = 0;
+    double  c, best;
+
+    edge   = malloc(edges * sizeof(struct room_edge));
+    placed = calloc(n, 1);
+    order  = malloc(n * sizeof(int));
+    left   = malloc(n * sizeof(int));
+    if ( NULL == edge || NULL == placed || NULL == order || NULL == left ) {
+        free(left);
+        free(order);
+        free(placed);
+        free(edge);
+        *errvalue = MALLOC_ERROR;
+        return;
+    }
+
+    /* Step 1: Take the candidate pairings from the cheapest up. A pairing
+       that is a candidate of both students appears twice, which is harmless. */
+    for ( s = 0, e = 0; s < n; s++ )
+        for ( m = 0; m < k; m++, e++ ) {
+            t = rc->near[(size_t) s * k + m];
+            edge[e].cost = room_pair_cost(matrix, s, t);
+            edge[e].s    = s < t ? s : t;
+            edge[e].t    = s < t ? t : s;
+        }
+    qsort(edge, edges, sizeof(struct room_edge), compare_edges);
+
+    for ( e = 0; e < edges; e++ )
+        if ( !placed[edge[e].s] && !placed[edge[e].t] ) {
+            placed[edge[e].s] = placed[edge[e].t] = 1;
+            order[count++] = edge[e].s;
+            order[count++] = edge[e].t;
+        }
+
+    /* Step 2: Students whose candidates were all taken get the cheapest of
+       the students left */
+    for ( s = 0, nleft = 0; s < n; s++ )
+        if ( !placed[s] )
+            left[nleft++] = s;
+    for ( i = 0; i < nleft; i++ ) {
+        if ( !placed[left[i]] ) {
+            placed[left[i]] = 1;
+            order[count++] = left[i];
+            for ( j = i + 1, t = -1, best = 0.0; j < nleft; j++ ) {
+                if ( placed[left[j]] )
+                    continue;
+                c = room_pair_cost(matrix, left[i], left[j]);
+                if ( t < 0 || c < best ) {
+                    t = left[j];
+                    best = c;
+                }
+            }
+            if ( t >= 0 ) {
+                placed[t] = 1;
+                order[count++] = t;
+            }
+        }
+    }
+
+    room_state_pair(st, matrix, order);
+
+    free(left);
+    free(order);
+    free(placed);
+    free(edge);
+    *errvalue = SUCCESS;
+}
+
+/******************************************************************************/
+long room_local_search(
+        struct room_state            *st,        /* the assignment, improved */
+        const struct sym_matrix      *matrix,    /* symmetric cost matrix    */
+        const struct room_candidates *rc,        /* candidate roommates      */
+        int                           passes,    /* most passes to make      */
+        int                           threads,   /* OpenMP threads           */
+        int                          *errvalue)  /* return code for error    */
+{
+    int     n = st->students, k = rc->k;
+    struct room_move *move;
+    char   *touched;
+    long    made = 0, made_pass = 1;
+    int     pass, s, x, y, rx, ry;
+    double  delta, ca, cb;
+
+    move    = malloc(n * sizeof(struct room_move));
+    touched = malloc(st->rooms + 1);
+    if ( NULL == move || NULL == touched ) {
+        free(touched);
+        free(move);
+        *errvalue = MALLOC_ERROR;
+        return 0;
+    }
+
+    for ( pass = 0; pass < passes && made_pass > 0; pass++ ) {
+        /* Step 1: The best swap that makes each student the roommate of one
+           of their candidates, c: by swapping their roommate with c, or
+           themselves with the roommate of c. The state is only read. */
+#ifdef _OPENMP
+        #pragma omp parallel for num_threads(threads) schedule(dynamic, 256)
+#endif
+        for ( int a = 0; a < n; a++ ) {
+            struct room_move best = {0.0, -1, -1};
+            int    pa = st->partner[a], c, pc, m;
+            double d, na, nb;
+
+            for ( m = 0; m < k; m++ ) {
+                c = rc->near[(size_t) a * k + m];
+                if ( c == pa )
+                    continue;
+                pc = st->partner[c];
+                if ( pa >= 0 && (d = room_swap_delta(st, matrix, pa, c, &na, &nb)) < best.delta ) {
+                    best.delta = d;
+                    best.x = pa;
+                    best.y = c;
+                }
+                if ( pc >= 0 && (d = room_swap_delta(st, matrix, a, pc, &na, &nb)) < best.delta ) {
+                    best.delta = d;
+                    best.x = a;
+                    best.y = pc;
+                }
+            }
+            move[a] = best;
+        }
+
+        /* Step 2: Make the swaps in order of student. A swap that touches
+           only rooms not yet changed in this pass still has the change in
+           cost it was found with; the room of the student left over, if
+           any, counts as room st.rooms. */
+        memset(touched, 0, st->rooms + 1);
+        made_pass = 0;
+        for ( s = 0; s < n; s++ ) {
+            x = move[s].x;
+            y = move[s].y;
+            if ( x < 0 )
+                continue;
+            rx = st->room_of[x] >= 0 ? st->room_of[x] : st->rooms;
+            ry = st->room_of[y] >= 0 ? st->room_of[y] : st->rooms;
+            if ( touched[rx] || touched[ry] )
+                continue;
+            delta = room_swap_delta(st, matrix, x, y, &ca, &cb);
+            room_swap(st, x, y, ca, cb, delta);
+            touched[rx] = touched[ry] = 1;
+            made_pass++;
+        }
+        made += made_pass;
+    }
+
+    free(touched);
+    free(move);
+    *errvalue = SUCCESS;
+    return made;
+}
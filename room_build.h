@@ -0,0 +1,72 @@
+#ifndef ROOM_BUILD_H
+#define ROOM_BUILD_H
+
+#include <mpi.h>
+#include "sym_matrix.h"
+#include "room_state.h"
+
+/* Construction of a good assignment to start from, in a fraction of the
+   time an annealer takes to get there from a random one. Every student's
+   k cheapest roommates are found by all the ranks together, each scanning a
+   block of rows with its threads; the cheapest of those pairings are then
+   taken greedily, and the result is improved by swapping students between
+   rooms until no swap with a candidate roommate lowers the cost. Everything
+   after the candidate lists is done the same way on every rank, so every
+   rank ends with the same assignment, whatever the number of ranks and
+   threads. */
+struct room_candidates {
+    int   students;
+    int   k;                /* candidates per student                       */
+    int  *near;             /* near[s*k + m] is the m-th cheapest roommate  */
+};
+
+/******************************************************************************/
+/** room_candidates_build(&rc, &M, k, threads, comm, &err)
+ *  Collective. Finds every student's k cheapest roommates, in order of
+ *  cost, ties to the lower student. Each rank scans a block of rows with
+ *  threads OpenMP threads and the blocks are gathered to every rank. k is
+ *  cut to the number of students less one. Release with
+ *  room_candidates_free().
+ */
+void room_candidates_build(
+        struct room_candidates  *rc,       /* the candidate lists             */
+        const struct sym_matrix *matrix,   /* symmetric cost matrix           */
+        int                      k,        /* candidates per student          */
+        int                      threads,  /* OpenMP threads per rank         */
+        MPI_Comm                 comm,     /* ranks that share the work       */
+        int                     *errvalue  /* return code for error, if any   */
+        );
+void room_candidates_free(struct room_candidates *rc);
+
+/******************************************************************************/
+/** room_greedy(&st, &M, &rc, &err)
+ *  Pairs the students greedily: candidate pairings are taken from the
+ *  cheapest up while neither student has a room, and the students left
+ *  then each get the cheapest of the others left, in order of number.
+ */
+void room_greedy(
+        struct room_state            *st,        /* set to the assignment    */
+        const struct sym_matrix      *matrix,    /* symmetric cost matrix    */
+        const struct room_candidates *rc,        /* candidate roommates      */
+        int                          *errvalue   /* return code for error    */
+        );
+
+/******************************************************************************/
+/** room_local_search(&st, &M, &rc, passes, threads, &err)
+ *  Improves st by swaps of two students that make a student and one of their
+ *  candidates roommates. Each pass finds the best such swap for every
+ *  student with threads OpenMP threads, then makes those that lower the
+ *  cost, in order of student, skipping any that would touch a room already
+ *  changed in the pass. Stops after a pass that makes none, or after
+ *  passes passes. Returns the number of swaps made.
+ */
+long room_local_search(
+        struct room_state            *st,        /* the assignment, improved */
+        const struct sym_matrix      *matrix,    /* symmetric cost matrix    */
+        const struct room_candidates *rc,        /* candidate roommates      */
+        int                           passes,    /* most passes to make      */
+        int                           threads,   /* OpenMP threads           */
+        int                          *errvalue   /* return code for error    */
+        );
+
+#endif
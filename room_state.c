@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc_matrix.h"
+#include "room_state.h"
+
+/******************************************************************************/
+void room_state_init(struct room_state *st, int students, int *errvalue)
+{
+    memset(st, 0, sizeof(*st));
+    st->students  = students;
+    st->rooms     = students / 2;
+    st->partner   = malloc(students * sizeof(int));
+    st->room_of   = malloc(students * sizeof(int));
+    st->room_cost = malloc((st->rooms > 0 ? st->rooms : 1) * sizeof(double));
+    *errvalue = SUCCESS;
+    if ( NULL == st->partner || NULL == st->room_of || NULL == st->room_cost ) {
+        room_state_free(st);
+        *errvalue = MALLOC_ERROR;
+    }
+}
+
+void room_state_free(struct room_state *st)
+{
+    free(st->room_cost);
+    free(st->room_of);
+    free(st->partner);
+    memset(st, 0, sizeof(*st));
+}
+
+/******************************************************************************/
+void room_state_pair(struct room_state *st, const struct sym_matrix *matrix, const int *order)
+{
+    int k, s, t;
+
+    for ( k = 0; k < st->rooms; k++ ) {
+        s = order[2*k];
+        t = order[2*k + 1];
+        st->partner[s] = t;
+        st->partner[t] = s;
+        st->room_of[s] = st->room_of[t] = k;
+        st->room_cost[k] = room_pair_cost(matrix, s, t);
+    }
+    if ( st->students % 2 != 0 ) {
+        s = order[st->students - 1];
+        st->partner[s] = st->room_of[s] = -1;
+    }
+    st->cost = room_state_total(st);
+}
+
+/******************************************************************************/
+void room_state_copy(struct room_state *dst, const struct room_state *src)
+{
+    memcpy(dst->partner, src->partner, src->students * sizeof(int));
+    memcpy(dst->room_of, src->room_of, src->students * sizeof(int));
+    memcpy(dst->room_cost, src->room_cost, src->rooms * sizeof(double));
+    dst->cost = src->cost;
+}
+
+/******************************************************************************/
+double room_state_total(const struct room_state *st)
+{
+    double cost = 0.0;
+    int    k;
+
+    for ( k = 0; k < st->rooms; k++ )
+        cost += st->room_cost[k];
+    return cost;
+}
@@ -0,0 +1,121 @@
+#ifndef ROOM_STATE_H
+#define ROOM_STATE_H
+
+#include "sym_matrix.h"
+
+/* An assignment of students to rooms of two, kept so that the change in
+   cost of swapping two students is found from two matrix entries and two
+   cached room costs, and a swap is made in place in constant time. Every
+   student has a room and a roommate, except the one left over when the
+   number of students is odd, who has neither (-1). The cost of a room is
+   the matrix entry of its two students in the upper triangle, so the
+   matrix is taken to be symmetric and only that triangle is read; it may
+   be a full matrix or a packed one (sym_matrix.h) of any element type. */
+struct room_state {
+    int      students;      /* students assigned                            */
+    int      rooms;         /* students / 2                                 */
+    int     *partner;       /* roommate of each student, or -1              */
+    int     *room_of;       /* room of each student, or -1                  */
+    double  *room_cost;     /* cost of each room                            */
+    double   cost;          /* sum of room_cost                             */
+};
+
+/******************************************************************************/
+/** room_pair_cost(&M, s, t)
+ *  Returns the cost of students s and t sharing a room, M(min, max), or 0
+ *  if either is -1.
+ */
+static inline double room_pair_cost(const struct sym_matrix *matrix, int s, int t)
+{
+    if ( s < 0 || t < 0 )
+        return 0.0;
+    return s < t ? sym_matrix_get(matrix, s, t) : sym_matrix_get(matrix, t, s);
+}
+
+/******************************************************************************/
+/** room_state_init(&st, n, &err) / room_state_free(&st)
+ *  Allocate the arrays of an assignment of n students, and release them.
+ *  The assignment is not set; see room_state_pair().
+ */
+void room_state_init(
+        struct room_state *st,         /* the assignment                      */
+        int                students,   /* number of students, at least 2      */
+        int               *errvalue    /* return code for error, if any       */
+        );
+void room_state_free(struct room_state *st);
+
+/******************************************************************************/
+/** room_state_pair(&st, &M, order)
+ *  Puts students order[2k] and order[2k+1] in room k; with an odd number of
+ *  students the last one of order is left over. Computes the room costs
+ *  and the total.
+ */
+void room_state_pair(
+        struct room_state *st,         /* the assignment                      */
+        const struct sym_matrix *matrix, /* symmetric cost matrix             */
+        const int         *order       /* a permutation of the students       */
+        );
+
+/******************************************************************************/
+/** room_state_copy(&dst, &src)
+ *  Copies the assignment src into dst, which has the same number of
+ *  students.
+ */
+void room_state_copy(struct room_state *dst, const struct room_state *src);
+
+/******************************************************************************/
+/** room_state_total(&st)
+ *  Returns the sum of the cached room costs, summed again, to check the
+ *  running total st.cost against.
+ */
+double room_state_total(const struct room_state *st);
+
+/******************************************************************************/
+/** room_swap_delta(&st, &M, a, b, &ca, &cb)
+ *  Returns the change in cost of swapping students a and b, who must not
+ *  share a room, and sets ca and cb to the new costs of the rooms of a and
+ *  b: those of b with a's roommate and of a with b's.
+ */
+static inline double room_swap_delta(const struct room_state *st,
+                                     const struct sym_matrix *matrix, int a, int b,
+                                     double *ca, double *cb)
+{
+    int ra = st->room_of[a], rb = st->room_of[b];
+    double delta = 0.0;
+
+    *ca = room_pair_cost(matrix, b, st->partner[a]);
+    *cb = room_pair_cost(matrix, a, st->partner[b]);
+    if ( ra >= 0 )
+        delta += *ca - st->room_cost[ra];
+    if ( rb >= 0 )
+        delta += *cb - st->room_cost[rb];
+    return delta;
+}
+
+/******************************************************************************/
+/** room_swap(&st, a, b, ca, cb, delta)
+ *  Swaps students a and b, with the room costs and change in cost given by
+ *  room_swap_delta().
+ */
+static inline void room_swap(struct room_state *st, int a, int b, double ca, double cb,
+                             double delta)
+{
+    int ra = st->room_of[a], rb = st->room_of[b];
+    int pa = st->partner[a], pb = st->partner[b];
+
+    st->partner[a] = pb;
+    st->partner[b] = pa;
+    if ( pa >= 0 )
+        st->partner[pa] = b;
+    if ( pb >= 0 )
+        st->partner[pb] = a;
+    st->room_of[a] = rb;
+    st->room_of[b] = ra;
+    if ( ra >= 0 )
+        st->room_cost[ra] = ca;
+    if ( rb >= 0 )
+        st->room_cost[rb] = cb;
+    st->cost += delta;
+}
+
+#endif
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <mpi.h>
+#include "search_results.h"
+
+#define RESULTS_TAG  7
+
+static const char *results_mode_names[] = {
+    "count", "gather", "stream"
+};
+
+/******************************************************************************/
+const char *results_mode_name(int mode)
+{
+    if (mode < RESULTS_COUNT || mode > RESULTS_STREAM)
+        return "unknown";
+    return results_mode_names[mode];
+}
+
+int results_mode_parse(const char *name)
+{
+    int mode;
+
+    for (mode = RESULTS_COUNT; mode <= RESULTS_STREAM; mode++)
+        if (strcmp(name, results_mode_names[mode]) == 0)
+            return mode;
+    return -1;
+}
+
+/******************************************************************************/
+void match_list_init(struct match_list *l, int patterns, int mode)
+{
+    memset(l, 0, sizeof(*l));
+    l->patterns = patterns;
+    l->store    = RESULTS_COUNT != mode;
+}
+
+/******************************************************************************/
+int match_list_spill(struct match_list *l)
+{
+    const char *dir = getenv("TMPDIR");
+    char path[4096];
+    int fd;
+
+    if (!l->store || NULL != l->spill)
+        return 0;
+    snprintf(path, sizeof(path), "%s/match_list.XXXXXX", NULL != dir && *dir ? dir : "/tmp");
+    fd = mkstemp(path);
+    if (fd < 0)
+        return -1;
+    unlink(path);
+    l->spill = fdopen(fd, "w+");
+    if (NULL == l->spill) {
+        close(fd);
+        return -1;
+    }
+    return 0;
+}
+
+/* Writes the data of a spilling list to its file once it has a block */
+static int spill_data(struct match_list *l)
+{
+    if (NULL == l->spill || l->len < RESULTS_BLOCK)
+        return 0;
+    if (fwrite(l->data, 1, l->len, l->spill) != (size_t) l->len)
+        return -1;
+    l->spilled += l->len;
+    l->len = 0;
+    return 0;
+}
+
+static void put_varint(unsigned char *data, long *len, unsigned long v)
+{
+    while (v >= 0x80) {
+        data[(*len)++] = (unsigned char) (v | 0x80);
+        v >>= 7;
+    }
+    data[(*len)++] = (unsigned char) v;
+}
+
+/* Returns the index after the varint at data[i], whose value goes in *v */
+static long get_varint(const unsigned char *data, long i, unsigned long *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    do {
+        *v |= (unsigned long) (data[i] & 0x7f) << shift;
+        shift += 7;
+    } while (data[i++] & 0x80);
+    return i;
+}
+
+/******************************************************************************/
+int match_list_add(struct match_list *l, long offset, int pattern)
+{
+    unsigned char *grown;
+
+    l->count++;
+    if (!l->store)
+        return 0;
+
+    //Two varints take at most 20 bytes
+    if (l->len + 20 > l->cap) {
+        grown = realloc(l->data, l->cap > 0 ? 2 * l->cap : 4096);
+        if (NULL == grown)
+            return -1;
+        l->data = grown;
+        l->cap  = l->cap > 0 ? 2 * l->cap : 4096;
+    }
+    put_varint(l->data, &l->len, (unsigned long) (offset - l->last));
+    if (l->patterns)
+        put_varint(l->data, &l->len, (unsigned long) pattern);
+    l->last = offset;
+    return spill_data(l);
+}
+
+/******************************************************************************/
+int match_list_append(struct match_list *l, const struct match_list *from)
+{
+    unsigned char *grown;
+    unsigned long first;
+    long i, cap;
+
+    if (!l->store || 0 == from->count) {
+        l->count += from->count;
+        return 0;
+    }
+
+    //The first distance of from is its first offset; the rest carry over
+    i = get_varint(from->data, 0, &first);
+    for (cap = l->cap > 0 ? l->cap : 4096; l->len + 10 + from->len - i > cap; cap *= 2)
+        ;
+    if (cap > l->cap) {
+        grown = realloc(l->data, cap);
+        if (NULL == grown)
+            return -1;
+        l->data = grown;
+        l->cap  = cap;
+    }
+    put_varint(l->data, &l->len, (unsigned long) ((long) first - l->last));
+    memcpy(l->data + l->len, from->data + i, from->len - i);
+    l->len   += from->len - i;
+    l->count += from->count;
+    l->last   = from->last;
+    return spill_data(l);
+}
+
+/******************************************************************************/
+void match_list_free(struct match_list *l)
+{
+    if (NULL != l->spill)
+        fclose(l->spill);
+    free(l->data);
+    memset(l, 0, sizeof(*l));
+}
+
+/******************************************************************************/
+/* A position in a rank's list, or in the block of it at hand */
+struct list_cursor {
+    const unsigned char *data;
+    long                 len;       /* bytes at data                       */
+    long                 i;         /* next byte to decode                 */
+    long                 offset;    /* the match decoded last              */
+    unsigned long        pattern;
+    int                  patterns;
+    long                 pos;       /* next byte of rank 0's own list      */
+};
+
+/* Decodes the next match of the cursor; returns 0 at the end of its data */
+static int cursor_next(struct list_cursor *c)
+{
+    unsigned long delta;
+
+    if (c->i >= c->len)
+        return 0;
+    c->i = get_varint(c->data, c->i, &delta);
+    c->offset += (long) delta;
+    if (c->patterns)
+        c->i = get_varint(c->data, c->i, &c->pattern);
+    return 1;
+}
+
+static void print_match(const struct list_cursor *c, const char *label)
+{
+    if (c->patterns)
+        printf("%s%lu %li \n", label, c->pattern, c->offset);
+    else
+        printf("%s%li \n", label, c->offset);
+}
+
+/* Returns the index of the cursor whose match comes first, or -1. Only the
+   cursors with live[k] set have a match decoded. */
+static int first_cursor(const struct list_cursor *c, const int *live, int p)
+{
+    int k, best = -1;
+
+    for (k = 0; k < p; k++)
+        if (live[k] && (best < 0 || c[k].offset < c[best].offset ||
+                        (c[k].offset == c[best].offset && c[k].pattern < c[best].pattern)))
+            best = k;
+    return best;
+}
+
+/* Returns the length of the longest run of whole matches at the start of
+   the n bytes at data */
+static long whole_length(const unsigned char *data, long n, int patterns)
+{
+    long end = 0, next;
+    int  k;
+
+    for ( ; ; end = next) {
+        next = end;
+        for (k = 0; k < (patterns ? 2 : 1); k++) {
+            while (next < n && data[next] & 0x80)
+                next++;
+            if (next++ >= n)
+                return end;
+        }
+    }
+}
+
+/* Copies the longest run of whole matches from byte i of the list, spilled
+   or not, that fits in a block; returns its length, 0 at the end */
+static long read_block(const struct match_list *l, long i, unsigned char *block)
+{
+    long n = 0, want;
+
+    if (i < l->spilled) {
+        want = l->spilled - i < RESULTS_BLOCK ? l->spilled - i : RESULTS_BLOCK;
+        if (pread(fileno(l->spill), block, want, i) != (ssize_t) want) {
+            fprintf(stderr, "Could not read back the spilled matches\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        n = want;
+    }
+    if (n < RESULTS_BLOCK && i + n >= l->spilled && i + n < l->spilled + l->len) {
+        want = l->len - (i + n - l->spilled);
+        if (want > RESULTS_BLOCK - n)
+            want = RESULTS_BLOCK - n;
+        memcpy(block + n, l->data + (i + n - l->spilled), want);
+        n += want;
+    }
+    return whole_length(block, n, l->patterns);
+}
+
+/* Asks rank k for the next block of its list, or reads it from l for rank
+   0, and points c at it; returns 0 if the list has ended */
+static int next_block(struct list_cursor *c, unsigned char *block, int k,
+                      const struct match_list *l, MPI_Comm comm)
+{
+    MPI_Status status;
+    int size, ask = 1;
+
+    if (0 == k) {
+        size = (int) read_block(l, c->pos, block);
+        c->pos += size;
+    }
+    else {
+        MPI_Send(&ask, 1, MPI_INT, k, RESULTS_TAG, comm);
+        MPI_Recv(block, RESULTS_BLOCK, MPI_BYTE, k, RESULTS_TAG, comm, &status);
+        MPI_Get_count(&status, MPI_BYTE, &size);
+    }
+    c->data = block;
+    c->len  = size;
+    c->i    = 0;
+    return size > 0;
+}
+
+/******************************************************************************/
+/* Rank 0 asks the other ranks for their lists a block at a time, and each
+   answers every request with its next block, or with an empty message once
+   its list has ended; rank 0 reads its own the same way. In rank order only
+   one block is held at a time; a merge holds one per rank. */
+static long collect_stream(const struct match_list *l, int merge, const char *label,
+                           MPI_Comm comm)
+{
+    int id, p, k, ask;
+    long i, len, total = 0;
+    unsigned char *blocks;
+    struct list_cursor *c;
+    int *live;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+
+    if (NULL != l->spill && fflush(l->spill) != 0) {
+        fprintf(stderr, "Could not write the spilled matches\n");
+        MPI_Abort(comm, 1);
+    }
+
+    if (0 != id) {
+        blocks = malloc(RESULTS_BLOCK);
+        for (i = 0; ; i += len) {
+            MPI_Recv(&ask, 1, MPI_INT, 0, RESULTS_TAG, comm, MPI_STATUS_IGNORE);
+            len = read_block(l, i, blocks);
+            MPI_Send(blocks, (int) len, MPI_BYTE, 0, RESULTS_TAG, comm);
+            if (len == 0) {
+                free(blocks);
+                return l->count;
+            }
+        }
+    }
+
+    blocks = malloc((long) (merge ? p : 1) * RESULTS_BLOCK);
+    c = calloc(p, sizeof(*c));
+    live = calloc(p, sizeof(int));
+    for (k = 0; k < p; k++)
+        c[k].patterns = l->patterns;
+
+    if (!merge) {
+        for (k = 0; k < p; k++) {
+            if (!next_block(&c[k], blocks, k, l, comm))
+                continue;
+            do {
+                while (cursor_next(&c[k])) {
+                    print_match(&c[k], label);
+                    total++;
+                }
+            } while (next_block(&c[k], blocks, k, l, comm));
+        }
+    }
+    else {
+        for (k = 0; k < p; k++)
+            while (!live[k] && next_block(&c[k], blocks + (long) k * RESULTS_BLOCK, k, l, comm))
+                live[k] = cursor_next(&c[k]);
+        while ((k = first_cursor(c, live, p)) >= 0) {
+            print_match(&c[k], label);
+            total++;
+            live[k] = cursor_next(&c[k]);
+            while (!live[k] && next_block(&c[k], blocks + (long) k * RESULTS_BLOCK, k, l, comm))
+                live[k] = cursor_next(&c[k]);
+        }
+    }
+
+    free(live);
+    free(c);
+    free(blocks);
+    return total;
+}
+
+/******************************************************************************/
+long results_collect(const struct match_list *l, int mode, int merge, const char *label,
+                     MPI_Comm comm)
+{
+    int id, p, k;
+    int *counts = NULL, *displs = NULL, *live;
+    long total = 0, bytes, all_bytes;
+    unsigned char *all = NULL;
+    struct list_cursor *c;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+
+    if (RESULTS_COUNT == mode) {
+        MPI_Reduce(&l->count, &total, 1, MPI_LONG, MPI_SUM, 0, comm);
+        if (0 == id)
+            printf("%s%li matches\n", label, total);
+        return 0 == id ? total : l->count;
+    }
+
+    //The displacements of MPI_Gatherv are ints, and a spilled list is not
+    //all in memory; a spill counts as too many bytes
+    bytes = NULL != l->spill && l->spilled > 0 ? (long) INT_MAX + 1 : l->len;
+    MPI_Allreduce(&bytes, &all_bytes, 1, MPI_LONG, MPI_SUM, comm);
+    if (RESULTS_STREAM == mode || all_bytes > INT_MAX)
+        return collect_stream(l, merge, label, comm);
+
+    if (0 == id) {
+        counts = malloc(p * sizeof(int));
+        displs = malloc(p * sizeof(int));
+        all = malloc(all_bytes > 0 ? all_bytes : 1);
+    }
+    k = (int) bytes;
+    MPI_Gather(&k, 1, MPI_INT, counts, 1, MPI_INT, 0, comm);
+    if (0 == id) {
+        displs[0] = 0;
+        for (k = 1; k < p; k++)
+            displs[k] = displs[k - 1] + counts[k - 1];
+    }
+    MPI_Gatherv(l->data, (int) bytes, MPI_BYTE, all, counts, displs, MPI_BYTE, 0, comm);
+    if (0 != id)
+        return l->count;
+
+    //Print the lists one after the other, or merged
+    c = calloc(p, sizeof(*c));
+    live = malloc(p * sizeof(int));
+    for (k = 0; k < p; k++) {
+        c[k].data     = all + displs[k];
+        c[k].len      = counts[k];
+        c[k].patterns = l->patterns;
+        live[k]       = cursor_next(&c[k]);
+    }
+    if (merge)
+        while ((k = first_cursor(c, live, p)) >= 0) {
+            print_match(&c[k], label);
+            total++;
+            live[k] = cursor_next(&c[k]);
+        }
+    else
+        for (k = 0; k < p; k++)
+            for (; live[k]; live[k] = cursor_next(&c[k])) {
+                print_match(&c[k], label);
+                total++;
+            }
+
+    free(live);
+    free(c);
+    free(all);
+    free(displs);
+    free(counts);
+    return total;
+}
@@ -0,0 +1,98 @@
+#ifndef SEARCH_RESULTS_H
+#define SEARCH_RESULTS_H
+
+#include <stdio.h>
+#include <mpi.h>
+
+/* How the matches found by the ranks reach the output */
+#define RESULTS_COUNT   0   /* only their number, summed on rank 0           */
+#define RESULTS_GATHER  1   /* all of them, gathered on rank 0 at once       */
+#define RESULTS_STREAM  2   /* all of them, passed to rank 0 a block at once */
+
+#define RESULTS_BLOCK  (1 << 20)   /* largest block sent by RESULTS_STREAM   */
+
+/* The matches found by one rank, in increasing order of offset. Each is
+   stored as the distance from the previous one (from 0 for the first) as a
+   varint of 7 bits per byte, low bits first, followed by the pattern number
+   as a varint when there are several patterns. A match then takes a byte or
+   two where the text has many, and the lists are cheap to send. A list made
+   to spill writes its data to a file of its own whenever it reaches
+   RESULTS_BLOCK bytes, so that it holds at most about a block in memory;
+   the list is then the spilled bytes followed by those of data. */
+struct match_list {
+    unsigned char  *data;
+    long            len;        /* bytes of data used                        */
+    long            cap;        /* bytes of data allocated                   */
+    FILE           *spill;      /* file of the spilled bytes, or NULL        */
+    long            spilled;    /* bytes written to it                       */
+    long            count;      /* matches added                             */
+    long            last;       /* offset of the last match added            */
+    int             patterns;   /* nonzero if matches have a pattern number  */
+    int             store;      /* zero if only count is kept                */
+};
+
+/******************************************************************************/
+/** results_mode_name(mode) / results_mode_parse(name)
+ *  Convert between RESULTS_* values and the names count, gather and stream.
+ *  results_mode_parse() returns -1 for unknown names.
+ */
+const char *results_mode_name(int mode);
+int results_mode_parse(const char *name);
+
+/******************************************************************************/
+/** match_list_init(l, patterns, mode)
+ *  Prepares an empty list, whose matches have pattern numbers if patterns is
+ *  nonzero. For RESULTS_COUNT the matches are only counted.
+ */
+void match_list_init(struct match_list *l, int patterns, int mode);
+
+/******************************************************************************/
+/** match_list_spill(l)
+ *  Makes l spill, to a file made and at once unlinked in $TMPDIR, or /tmp,
+ *  which is removed when the list is freed. Does nothing for a list that
+ *  only counts. Returns 0, or -1 if the file cannot be made.
+ */
+int match_list_spill(struct match_list *l);
+
+/******************************************************************************/
+/** match_list_add(l, offset, pattern)
+ *  Appends a match at offset, which must not be below that of the last one.
+ *  pattern is ignored if the list has no pattern numbers. Returns 0, or -1
+ *  if memory runs out or a spill cannot be written.
+ */
+int match_list_add(struct match_list *l, long offset, int pattern);
+
+/******************************************************************************/
+/** match_list_append(l, from)
+ *  Appends the matches of from, whose first one must not be below the last
+ *  one of l, and which must have pattern numbers if l has. Only the first
+ *  match is encoded again; the rest of the data is copied. from must not
+ *  spill. Returns 0, or -1 if memory runs out or a spill cannot be written.
+ */
+int match_list_append(struct match_list *l, const struct match_list *from);
+
+/******************************************************************************/
+/** match_list_free(l)
+ *  Releases the list and closes its spill file, if any.
+ */
+void match_list_free(struct match_list *l);
+
+/******************************************************************************/
+/** results_collect(l, mode, merge, label, comm)
+ *  Collective over comm. Rank 0 prints the matches of every rank's list l
+ *  to stdout in rank order, or merged into one increasing order if merge is
+ *  nonzero, for ranks whose matches interleave. Each is printed on a line
+ *  as label followed by the offset, or by the pattern number and the
+ *  offset; with RESULTS_COUNT only the total is printed. RESULTS_GATHER
+ *  moves all lists to rank 0 with one MPI_Gatherv, or falls back to
+ *  RESULTS_STREAM when they would not fit its int counts or any of them
+ *  spilled. RESULTS_STREAM has rank 0 ask the ranks for their lists, its
+ *  own included, in blocks of at most RESULTS_BLOCK bytes, so it holds one
+ *  block, or one per rank for a merge, besides its own list. Spilling lists
+ *  keep every rank to about a block of matches for the whole search. Returns
+ *  the total number of matches on rank 0, and l->count on the others.
+ */
+long results_collect(const struct match_list *l, int mode, int merge, const char *label,
+                     MPI_Comm comm);
+
+#endif
@@ -1,4 +1,9 @@
 //find all occurences of pattern in string
+//
+// BUILD INSTRUCTIONS - mpicc -Wall -o <object name> search_text.c
+//                      mpirun -np <# procs> <object name> [-a <algorithm>] [-r <results>] <search string> <text file>
+//
+// <results> is gather (default), stream or count, see search_results.h
 
 #include <mpi.h>
 #include <stdio.h>
@@ -8,6 +13,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdint.h>
+#include "matcher.c"
+#include "search_results.c"
 
 //Traverse a string and remove any instances of rmChar
 //params:
@@ -35,37 +42,62 @@ char *stringParse(char *str) {
     return z;
 }
 
-int *scanText(char *search, char *text, long offset) {
-    int arrayIndex = 0;
-    int *indexes = malloc(sizeof(text) * sizeof(int));
-
-    for(int i = 0; i < sizeof(text); ++i){
-        int iCpy = i;
-        for(int j = 0; j < strlen(search); ++j){
-            //check if the search string continues to match the current text
-            //printf("search:text - %c : %c\n", search[j], text[iCpy]);
-            if(search[j] == text[iCpy]){
-                //if reaching the end of the search string with a match
-                //add the index of the text where the match started to
-                //the indexes array
-                //printf("j:sizeofsearch - %i : %i \n", j, sizeof(search));
-                if(j == strlen(search) - 1){
-                    printf("indexed: %li \n", i+offset);
-                    indexes[arrayIndex] = i + offset;
-                    arrayIndex+=1;
-                }
-                iCpy++;
-            }
-            else
-                break;
+//Traverses a text buffer, searching for all instances of the pattern of m
+//params: m, a matcher prepared for the search string (see matcher.h)
+//params: text, the buffer searched; it need not be NUL terminated
+//params: len, the number of bytes in text
+//params: offset, the min index of the current processors text portion.
+//params: count, set to the number of matches found
+//post: any instances of the pattern that start in 'text' are indexed in
+// the returned array, where indexes are adjusted by the offset to give
+// the true value of the index in the text as a whole
+//returns an array of *count indexes, to be freed by the caller
+long *scanText(const struct matcher *m, const char *text, long len, long offset, long *count) {
+    long arrayIndex = 0;
+    long size = 1024;
+    long *indexes = malloc(size * sizeof(long));
+    long i = 0;
+
+    while((i = matcher_next(m, text, len, i)) >= 0){
+        if(arrayIndex == size){
+            size *= 2;
+            indexes = realloc(indexes, size * sizeof(long));
         }
+        indexes[arrayIndex++] = i + offset;
+        ++i;
     }
+    *count = arrayIndex;
     return indexes;
 }
 
 int main(int argc, char* argv[])
 {
-    if(argc < 2){
+    int opt;
+    int kind = MATCHER_AUTO; //search algorithm, see matcher.h
+    int report = RESULTS_GATHER; //how matches are collected, see search_results.h
+
+    while((opt = getopt(argc, argv, "a:r:")) != -1){
+        switch(opt){
+        case 'a':
+            kind = matcher_parse(optarg);
+            if(kind < 0){
+                printf("Unknown algorithm %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'r':
+            report = results_mode_parse(optarg);
+            if(report < 0){
+                printf("Unknown results mode %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        default:
+            exit(1);
+        }
+    }
+
+    if(argc - optind < 2){
         printf("Too few arguments. Exiting.");
         exit(1);
     }
@@ -74,25 +106,28 @@ int main(int argc, char* argv[])
     int id; //processor id
     int p; //num processors
     char *search, *localText;
+    char *textFile = argv[optind+1];
     long locMin, locMax, min, max; //hold the indexes of the text sent to each processor
-    int localElems;
-    int prompt;
+    long localElems;
+    long localCount; //number of matches found by this process
+    struct match_list localMatches; //the same, to be collected on process 0
+    struct matcher m;
 
-
-    if(stat(argv[2], &statbuff) == -1) {
-        printf("Could not stat the file %s. Exiting\n", argv[2]);
+    if(stat(textFile, &statbuff) == -1) {
+        printf("Could not stat the file %s. Exiting\n", textFile);
         exit(1);
     }
 
     long n = (long)statbuff.st_size; //holds the size of the file in bytes
 
-    search = stringParse(argv[1]); //remove any escape characters from the string
-    int searchLen = strlen(search); //holds the length of the search string, used for overlap
+    search = stringParse(argv[optind]); //remove any escape characters from the string
+    long searchLen = strlen(search); //holds the length of the search string, used for overlap
 
-    if(searchLen > n){
-        printf("Search string is larger than the text file. Exiting");
+    if(searchLen < 1 || searchLen > n){
+        printf("Search string is empty or larger than the text file. Exiting");
         exit(1);
     }
+    matcher_init(&m, search, searchLen, kind);
 
     //Initialize MPI
     MPI_Init(&argc, &argv);
@@ -101,92 +136,78 @@ int main(int argc, char* argv[])
 
     // Determine how many elements each local process should expect
     // and generate array
-    if((p-1) != id){
-        locMin = floor( (id*n) / p );
-        locMax = floor( ( ( (id+1) * (n) ) / p) - 1 );
-
-        if (locMax + (searchLen - 1) < n)
-            localElems = locMax - locMin + (searchLen - 1);
-        else
-            localElems = locMax - locMin;
-        localText = malloc(localElems * sizeof(localElems));
-    }
-
-    //Create array for p-1 and begin distribution of text to each process
-    //The array for p-1 will be at least as large as the largest array
-    //of all other processes
+    locMin = (id*n) / p;
+    locMax = ((id+1)*n) / p - 1;
+
+    //Because the text is split and a match may occur at the end of one text section
+    // and continue into another text section, give each section
+    // access to the characters of the next section at a length
+    // matching the length of the search key (searchLen)
+    localElems = locMax - locMin + 1 + (searchLen - 1);
+    if (locMin + localElems > n)
+        localElems = n - locMin;
+    localText = malloc(localElems > 0 ? localElems : 1);
+
+    //Begin distribution of text to each process from p-1
     if((p-1) == id) {
-        int elem_count; //holds the total elements that will be sent to a process
+        long elem_count; //holds the total elements that will be sent to a process
         size_t elements_read; //holds the total elements tat are read from the file
+        //The buffer for the other processes is at least as large as any of theirs
+        char *sendText = malloc(n / p + searchLen);
 
-        FILE *iFile = fopen(argv[2], "r");
+        FILE *iFile = fopen(textFile, "r");
+        if(NULL == iFile)
+            MPI_Abort(MPI_COMM_WORLD, 1);
 
         //portion out the text
         for(int k = 0; k < p - 1; k++) {
-            min = floor( (k*n) / p );
-            max = floor( (((k+1)*n) / p) - 1 );
-            
-            if (max + (searchLen - 1) < n)
-                elem_count = max - min + (searchLen - 1);
-            else
-                elem_count = max - min;
-            
-            elements_read = fread(localText, 1, elem_count, iFile);
-            
+            //calculate the min and max indexes for the process
+            min = (k*n) / p;
+            max = ((k+1)*n) / p - 1;
+
+            //The overlap may not run past the end of the file
+            elem_count = max - min + 1 + (searchLen - 1);
+            if (min + elem_count > n)
+                elem_count = n - min;
+
+            //fread adjusts the index of the file read, so overlap will throw off the
+            // next call to fread. Set the read index of the file to the min
+            // of the text section
+            fseek(iFile, min, SEEK_SET);
+            elements_read = fread(sendText, 1, elem_count, iFile);
+
             if(elements_read != elem_count)
                 MPI_Abort(MPI_COMM_WORLD, 1);
-            
-            MPI_Send(localText, elem_count, MPI_CHAR, k, 1, MPI_COMM_WORLD);
-           
-            fseek(iFile, max+1, SEEK_SET);
+
+            MPI_Send(sendText, (int) elem_count, MPI_CHAR, k, 1, MPI_COMM_WORLD);
         }
-        
-        //find number of elements for process p-1, generate the array and fill
-        localElems = ceil(n / p);
-        locMax = n;
-        localText = malloc(localElems * sizeof(localElems));
+
+        //fill the array for process p-1
+        fseek(iFile, locMin, SEEK_SET);
         elements_read = fread(localText, 1, localElems, iFile);
 
         if(elements_read != localElems)
             MPI_Abort(MPI_COMM_WORLD, 1);
 
         fclose(iFile);
+        free(sendText);
     }
     else {
         //all process other than p-1 will wait to receive data from p-1
-        MPI_Recv(localText, localElems, MPI_CHAR, p-1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-    }/*
-    
-    int *localIndexes = scanText(search, localText, locMin);
-    
-    if (0 == id) {
-
-        if(p > 1){
-            //generate a holding array of size n (number of bytes in the file) because
-            //in the maximal case, each character in the file is a match to the search
-            int *buffer = malloc(n * sizeof(int));
-            int elem_count;
-
-            //Begin requesting each process to send its data
-            for(int k = 1; k < p; ++k){
-                min = floor( (k*n) / p );
-                max = floor( (((k+1)*n) / p) - 1 );
-                elem_count = max-min;
-
-                MPI_Send (&prompt, 1, MPI_INT, k, 1, MPI_COMM_WORLD);
-
-                MPI_Recv (buffer, elem_count, MPI_INT, k, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-                
-            }
-            free (buffer);
-        }
+        MPI_Recv(localText, (int) localElems, MPI_CHAR, p-1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
     }
-    else {
-        MPI_Recv (&prompt, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
-        MPI_Send (localIndexes, localElems, MPI_INT, 0, 1, MPI_COMM_WORLD);
-    }
-*/
+    long *localIndexes = scanText(&m, localText, localElems, locMin, &localCount);
+
+    //Process 0 prints the matches of every process in order
+    match_list_init(&localMatches, 0, report);
+    for(long j = 0; j < localCount; ++j)
+        if(match_list_add(&localMatches, localIndexes[j], 0) != 0)
+            MPI_Abort(MPI_COMM_WORLD, 1);
+    results_collect(&localMatches, report, 0, "indexed: ", MPI_COMM_WORLD);
+
+    match_list_free(&localMatches);
+    free(localIndexes);
+    free(localText);
     MPI_Finalize();
 }
@@ -1,8 +1,56 @@
 
 // This program ATTEMPTS to search a string using a multiprocessor approach.
 //
-// BUILD INSTRUCTIONS - mpicc -Wall -o <object name> <file-name>.c
-//                      mpirun -np <# procs> <object name> <search string> <text file>
+// BUILD INSTRUCTIONS - mpicc -Wall -pthread -fopenmp -o <object name> <file-name>.c
+//                      mpirun -np <# procs> <object name> [-a <algorithm>] [-i <input>] [-c <chunk>] [-r <results>] [-t <threads>] <search string> <text file>
+//                      mpirun -np <# procs> <object name> [-i <input>] [-c <chunk>] [-r <results>] [-t <threads>] -P <pattern file> <text file>
+//                      mpirun -np <# procs> <object name> [-i <input>] [-r <results>] -E <regex> <text file>
+//                      mpirun -np <# procs> <object name> [-r <results>] -I <index file> <search string> <text file>
+//
+// <algorithm> is the search algorithm of matcher.c: auto (default), memchr,
+// horspool, twoway or simd
+// <input> is how each process gets its section of the text (see text_io.h):
+// mmap (default) and mpiio have every process read its own section, so the
+// file must be visible to all of them; send has the last process read every
+// section and send it on, for files that only it can see. stream reads each
+// section in chunks of <chunk> bytes (default 16 MiB, suffixes k, m and g
+// allowed) while the previous chunk is searched, so that each process needs
+// only two chunks of memory for a file of any size; its matches spill to a
+// temporary file (in $TMPDIR, or /tmp) a block at a time rather than being
+// held until the end. dynamic cuts the whole file in chunks of <chunk> bytes
+// (default 4 MiB) that the processes take from a shared counter as they
+// become free, so that faster processes search more of the text; the time
+// each process worked and then waited for the others is printed on stderr
+// at the end.
+// <results> is how the matches are reported (see search_results.h): gather
+// (default) and stream have process 0 print every index in increasing
+// order; count prints only their number. stream has every process spill its
+// matches as -i stream does, and pass them on to process 0 a block at a
+// time, so that no process needs much memory however many there are. With
+// -i stream, gather works as stream.
+// <threads> is the number of OpenMP threads each process searches its text
+// with (default 1). The section, or each chunk of it, is cut in blocks of
+// 256 KiB that the threads take in turn, each block overlapping the next
+// by the longest pattern less one byte, and the matches of the blocks are
+// joined in order; so one process per node can keep all of its cores busy.
+// -E and -I use one thread.
+// -P searches for every line of <pattern file> at once with the Aho-Corasick
+// automaton of aho_corasick.c, in one pass over the text. Empty lines are
+// skipped, and the patterns are numbered from 0 in file order. Each match is
+// printed as <pattern number> <index>.
+// -E prints the index of every byte where a match of the regular expression
+// <regex> starts (see regex_dfa.h for the syntax). Matches may have any
+// length, so sections are not overlapped; instead each process reads its
+// section from every state of the DFA at once, and the states the sections
+// are entered in are found with one MPI_Exscan of the state maps. -E does
+// not work with -i stream.
+// -I looks the search string up in <index file>, a q-gram index of the text
+// made by build_index.c, instead of reading the whole text: each process
+// maps the index and reads only the parts of its section where the index
+// says a match may start. The text is still scanned, with a note on stderr,
+// if the string is too short for the index (see qgram_index.h) or the index
+// is not of a file of the text's size; -I is ignored with -P, -E and
+// -i stream or dynamic.
 
 
 #include <mpi.h>
@@ -13,6 +61,17 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "matcher.c"
+#include "aho_corasick.c"
+#include "text_io.c"
+#include "search_results.c"
+#include "regex_dfa.c"
+#include "qgram_index.c"
+
+#define SUB_BLOCK (256 * 1024) //bytes searched at once by a thread of -t, to stay in its cache
 
 //Traverse a string and remove any instances of rmChar
 //params: str, a string passed by pointer
@@ -49,180 +108,550 @@ char * stringParse(char *str) {
     return z;
 }
 
-//Traverses a text string, searching for all instances of search
-//params: search, a string that is sought in the 'text'
-//params: text, a string that is used as a search field for 'search'
+//Traverses a text buffer, searching for all instances of the pattern of m
+//params: m, a matcher prepared for the search string (see matcher.h)
+//params: text, the buffer searched; it need not be NUL terminated
+//params: len, the number of bytes in text
 //params: offset, the min index of the current processors text portion.
-//pre: no instances of the 'search' key are located in the 'text' string
-//post: any instances of 'search' that exist in 'text' are indexed in
-// the 'indexes' array, where indexes are adjusted by the offset to gives
+//params: count, set to the number of matches found
+//post: any instances of the pattern that start in 'text' are indexed in
+// the returned array, where indexes are adjusted by the offset to give
 // the true value of the index in the text as a whole
-int *scanText(char *search, char *text, long offset) {
-    int arrayIndex = 0;
-    int *indexes = malloc(strlen(text) * sizeof(int));
-
-    for(int i = 0; i < strlen(text); ++i){
-        int iCpy = i;
-        for(int j = 0; j < strlen(search); ++j){
-            //check if the search string continues to match the current text
-            //printf("search:text - %c : %c\n", search[j], text[iCpy]);
-            if(search[j] == text[iCpy]){
-                //if reaching the end of the search string with a match
-                //add the index of the text where the match started to
-                //the indexes array
-                //printf("j:sizeofsearch - %i : %i \n", j, sizeof(search));
-                if(j == strlen(search) - 1){
-                    indexes[arrayIndex] = i + offset;
-                    arrayIndex+=1;
-                }
-                iCpy++;
-            }
-            else
-                break;
+//returns an array of *count indexes, to be freed by the caller
+long *scanText(const struct matcher *m, const char *text, long len, long offset, long *count) {
+    long arrayIndex = 0;
+    long size = 1024;
+    long *indexes = malloc(size * sizeof(long));
+    long i = 0;
+
+    while((i = matcher_next(m, text, len, i)) >= 0){
+        if(arrayIndex == size){
+            size *= 2;
+            indexes = realloc(indexes, size * sizeof(long));
         }
+        indexes[arrayIndex++] = i + offset;
+        ++i;
     }
+    *count = arrayIndex;
     return indexes;
 }
 
-int main(int argc, char* argv[])
-{
-    if(argc < 2){
-        printf("Too few arguments. Exiting.");
-        exit(1);
-    }
+//Orders matches by index, then by pattern number
+int compareMatches(const void *a, const void *b) {
+    const struct ac_match *x = a, *y = b;
 
-    struct stat statbuff;
-    int id; //processor id
-    int p; //num processors
-    char *search, *localText;
-    long locMin, locMax, min, max; //hold the indexes of the text sent to each processor
-    int localElems;
-    //int prompt;
+    if(x->offset != y->offset)
+        return x->offset < y->offset ? -1 : 1;
+    return (x->pattern > y->pattern) - (x->pattern < y->pattern);
+}
 
-    if(stat(argv[2], &statbuff) == -1) {
-        printf("Could not stat the file %s. Exiting\n", argv[2]);
-        exit(1);
+//Searches one block of the text and adds every match that starts in it to a list
+//params: m, a matcher prepared for the search string, or NULL for the patterns of ac
+//params: ac, an automaton for the multi-pattern mode
+//params: text, the block followed by the rest of the text at hand
+//params: len, the number of bytes in text
+//params: limit, the number of bytes of text in the block itself
+//params: offset, the index of text[0] in the text as a whole
+//params: results, the list the matches are added to, in increasing order
+//returns the number of matches found
+long searchBlock(const struct matcher *m, const struct ac_automaton *ac, const char *text,
+                 long len, long limit, long offset, struct match_list *results) {
+    long count;
+
+    if(NULL == m){
+        //One pass finds every pattern that starts in this block
+        if(len > limit + ac->maxlen - 1)
+            len = limit + ac->maxlen - 1;
+        struct ac_match *matches = ac_scan(ac, text, len, limit, &count);
+        qsort(matches, count, sizeof(*matches), compareMatches);
+        for(long j = 0; j < count; ++j)
+            if(match_list_add(results, matches[j].offset + offset, matches[j].pattern) != 0)
+                MPI_Abort(MPI_COMM_WORLD, 1);
+        free(matches);
+    }
+    else {
+        //A match that fits in len but starts past limit belongs to the next block
+        if(len > limit + m->len - 1)
+            len = limit + m->len - 1;
+        long *indexes = scanText(m, text, len, offset, &count);
+        for(long j = 0; j < count; ++j)
+            if(match_list_add(results, indexes[j], 0) != 0)
+                MPI_Abort(MPI_COMM_WORLD, 1);
+        free(indexes);
     }
+    return count;
+}
 
-    long n = (long)statbuff.st_size; //holds the size of the file in bytes
+//Looks the search string up in a q-gram index instead of scanning a section
+//params: ix, the index of the text
+//params: search, the search string, of searchLen bytes
+//params: local, this process's section, with the overlap into the next one
+//params: results, the list the matches are added to
+//post: only the pages of the section where a match may start are read
+//returns the number of matches found
+long searchIndex(const struct qgram_index *ix, const char *search, long searchLen,
+                 const struct text_window *local, struct match_list *results) {
+    long count;
+    long *indexes = qgram_query(ix, search, searchLen, local->text, local->first, local->len,
+                                local->owned, &count);
+
+    for(long j = 0; j < count; ++j)
+        if(match_list_add(results, indexes[j], 0) != 0)
+            MPI_Abort(MPI_COMM_WORLD, 1);
+    free(indexes);
+    return count;
+}
+
+//Searches one section of the text and adds every match that starts in it to a list
+//params: m, ac, as for searchBlock()
+//params: text, the section followed by the overlap into the next one
+//params: len, the number of bytes in text
+//params: limit, the number of bytes of text in the section itself
+//params: offset, the index of text[0] in the text as a whole
+//params: results, the list the matches are added to, in increasing order
+//params: threads, the number of threads to search with
+//post: with several threads the section is cut in blocks of SUB_BLOCK bytes,
+// which read on into the next block as the section does into the next
+// section. The threads take the blocks as they become free and list the
+// matches of each apart; the lists are then appended in block order.
+//returns the number of matches found
+long searchSection(const struct matcher *m, const struct ac_automaton *ac, const char *text,
+                   long len, long limit, long offset, struct match_list *results, int threads) {
+    long count = 0;
+    long nblocks = (limit + SUB_BLOCK - 1) / SUB_BLOCK;
+
+    if(threads <= 1 || nblocks <= 1)
+        return searchBlock(m, ac, text, len, limit, offset, results);
+
+    struct match_list *found = malloc(nblocks * sizeof(*found));
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(threads) schedule(dynamic) reduction(+:count)
+#endif
+    for(long b = 0; b < nblocks; ++b){
+        long start = b * SUB_BLOCK;
+
+        match_list_init(&found[b], results->patterns, results->store ? RESULTS_GATHER : RESULTS_COUNT);
+        count += searchBlock(m, ac, text + start, len - start,
+                             limit - start < SUB_BLOCK ? limit - start : SUB_BLOCK,
+                             offset + start, &found[b]);
+    }
+    for(long b = 0; b < nblocks; ++b){
+        if(match_list_append(results, &found[b]) != 0)
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        match_list_free(&found[b]);
+    }
+    free(found);
+    return count;
+}
 
-    search = stringParse(argv[1]); //remove any escape characters from the string
-    int searchLen = sizeof(search); //holds the length of the search string, used for overlap
+//Parses a size in bytes, which may end in k, m or g
+//returns the size, or -1 if str is not a positive size
+long parseSize(const char *str) {
+    char *end;
+    long size = strtol(str, &end, 10);
+
+    switch(*end){
+    case 'g': case 'G':
+        size <<= 10;
+        /* fall through */
+    case 'm': case 'M':
+        size <<= 10;
+        /* fall through */
+    case 'k': case 'K':
+        size <<= 10;
+        ++end;
+    }
+    return (end == str || *end != '\0' || size < 1) ? -1 : size;
+}
 
-    if(searchLen > n){
-        printf("Search string is larger than the text file. Exiting");
-        exit(1);
+//Composes the state maps of runs of the DFA over text sections, for MPI_Exscan
+//params: in, *len maps of sections read first
+//params: inout, *len maps of sections read after those, replaced by the
+// maps of both: state s goes to inout[in[s]]
+//params: type, a map of contiguous ints, one per state
+void composeMaps(void *in, void *inout, int *len, MPI_Datatype *type) {
+    int size, nstates, *first = in, *then = inout;
+
+    MPI_Type_size(*type, &size);
+    nstates = size / sizeof(int);
+    int *both = malloc(nstates * sizeof(int));
+    for(int k = 0; k < *len; ++k, first += nstates, then += nstates){
+        for(int s = 0; s < nstates; ++s)
+            both[s] = then[first[s]];
+        memcpy(then, both, nstates * sizeof(int));
     }
+    free(both);
+}
+
+//Searches a section of the text for a regular expression, whose matches may
+// run on into the following sections
+//params: d, the expression compiled to a DFA that reads the text backwards
+//params: local, this process's section, without overlap
+//params: results, the list the matches are added to
+//post: the processes have all read their sections before any of them knows
+// the state it entered its own in, since that depends on the sections after
+// it. Each one reads its section from every state at once, which yields its
+// state map; the map of all the sections after a process is the composition
+// of theirs, an exclusive scan in reverse process order. Only the bytes read
+// before the runs from the different states met are read again.
+//returns the number of matches found
+long searchRegex(const struct regex_dfa *d, const struct text_window *local,
+                 struct match_list *results) {
+    int id, p, reverseId, entry;
+    long settled, count, tailCount;
+    int *map = malloc(d->nstates * sizeof(int));
+    int *after = malloc(d->nstates * sizeof(int)); //map of the sections after this one
+    MPI_Comm reverse;
+    MPI_Datatype mapType;
+    MPI_Op compose;
 
-    //Initialize MPI
-    MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &id);
     MPI_Comm_size(MPI_COMM_WORLD, &p);
+    MPI_Comm_split(MPI_COMM_WORLD, 0, p - 1 - id, &reverse);
+    MPI_Comm_rank(reverse, &reverseId);
 
-    // Determine how many elements each local process should expect
-    // and generate array
-    if((p-1) != id){
-        locMin = floor( (id*n) / p );
-        locMax = floor( ( ( (id+1) * (n) ) / p) - 1 );
-
-        //Because the text is split and a match may occur at the end of one text section
-        // and continue into another text section, give each section
-        // access to the characters of the next section at a length
-        // matching the length of the search key (searchLen)
-        if (locMax + (searchLen - 1) < n)
-            localElems = locMax - locMin + (searchLen - 1);
-        else
-            localElems = locMax - locMin;
-        localText = malloc(localElems * sizeof(localElems));
-    }
+    long *found = regex_scan_all(d, local->text, local->owned, map, &settled, &count);
 
-    //Create array for p-1 and begin distribution of text to each process
-    //The array for p-1 will be at least as large as the largest array
-    //of all other processes
-    if((p-1) == id) {
-        int elem_count; //holds the total elements that will be sent to a process
-        size_t elements_read; //holds the total elements tat are read from the file
+    MPI_Type_contiguous(d->nstates, MPI_INT, &mapType);
+    MPI_Type_commit(&mapType);
+    MPI_Op_create(composeMaps, 0, &compose);
+    MPI_Exscan(map, after, 1, mapType, compose, reverse);
+    entry = 0 == reverseId ? d->start : regex_entry(d, after[regex_state(d, d->start)]);
 
-        FILE *iFile = fopen(argv[2], "r");
+    long *tail = regex_scan(d, local->text + local->owned - settled, settled, entry, &tailCount);
+    for(long j = 0; j < count; ++j)
+        if(match_list_add(results, found[j] + local->first, 0) != 0)
+            MPI_Abort(MPI_COMM_WORLD, 1);
+    for(long j = 0; j < tailCount; ++j)
+        if(match_list_add(results, tail[j] + local->first + local->owned - settled, 0) != 0)
+            MPI_Abort(MPI_COMM_WORLD, 1);
 
-        //portion out the text
-        for(int k = 0; k < p - 1; k++) {
-            //calculate the min and max indexes for the process
-            min = floor( (k*n) / p );
-            max = floor( (((k+1)*n) / p) - 1 );
+    MPI_Op_free(&compose);
+    MPI_Type_free(&mapType);
+    MPI_Comm_free(&reverse);
+    free(tail);
+    free(found);
+    free(after);
+    free(map);
+    return count + tailCount;
+}
 
-            //If the string overlap makes the
-            if (max + (searchLen - 1) < n)
-                elem_count = max - min + (searchLen - 1);
-            else
-                elem_count = max - min;
+//Prints on stderr how the chunks of -i dynamic were shared out
+//params: busy, the seconds this process spent reading and searching chunks
+//params: queue, the seconds it spent taking them from the counter
+//params: chunks, the number of chunks it took
+//post: process 0 prints a line per process, with the seconds it then spent
+// idle until the slowest process ran out of chunks
+void reportBalance(double busy, double queue, long chunks) {
+    int id, p;
+    double done, idle, mine[4], *all = NULL;
 
-            elements_read = fread(localText, 1, elem_count, iFile);
+    MPI_Comm_rank(MPI_COMM_WORLD, &id);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
+    done = MPI_Wtime();
+    MPI_Barrier(MPI_COMM_WORLD);
+    idle = MPI_Wtime() - done;
+
+    mine[0] = (double) chunks;
+    mine[1] = busy;
+    mine[2] = queue;
+    mine[3] = idle;
+    if(0 == id)
+        all = malloc(4 * p * sizeof(double));
+    MPI_Gather(mine, 4, MPI_DOUBLE, all, 4, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if(0 == id){
+        fprintf(stderr, "process \t chunks \t busy (s) \t queue (s) \t idle (s)\n");
+        for(int k = 0; k < p; ++k)
+            fprintf(stderr, "%d \t %.0f \t %f \t %f \t %f\n", k, all[4*k], all[4*k+1],
+                    all[4*k+2], all[4*k+3]);
+        free(all);
+    }
+}
 
-            if(elements_read != elem_count)
-                MPI_Abort(MPI_COMM_WORLD, 1);
+//Reads a file of patterns, one per line
+//params: path, the pattern file
+//params: lens, set to an array of the length of each pattern
+//params: npats, set to the number of patterns
+//params: buffer, set to the file contents, which the patterns point into
+//post: line ends (\n or \r\n) are removed and empty lines skipped
+//returns an array of *npats patterns, or NULL if the file cannot be read or
+// has no patterns. The caller frees the array, *lens and *buffer
+char **readPatterns(const char *path, long **lens, int *npats, char **buffer) {
+    FILE *pFile = fopen(path, "rb");
+    char **patterns;
+    char *line, *end;
+    long size;
+    int count = 0;
+
+    if(NULL == pFile)
+        return NULL;
+    fseek(pFile, 0, SEEK_END);
+    size = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+    *buffer = malloc(size + 1);
+    if(fread(*buffer, 1, size, pFile) != size){
+        fclose(pFile);
+        free(*buffer);
+        return NULL;
+    }
+    fclose(pFile);
+    (*buffer)[size] = '\n';
+
+    //at most one pattern per two bytes, counting its line end
+    patterns = malloc((size / 2 + 1) * sizeof(char *));
+    *lens = malloc((size / 2 + 1) * sizeof(long));
+    for(line = *buffer; line < *buffer + size; line = end + 1){
+        end = memchr(line, '\n', *buffer + size + 1 - line);
+        patterns[count] = line;
+        (*lens)[count] = end - line;
+        if((*lens)[count] > 0 && '\r' == line[(*lens)[count] - 1])
+            (*lens)[count]--;
+        if((*lens)[count] > 0)
+            ++count;
+    }
 
-            MPI_Send(localText, elem_count, MPI_CHAR, k, 1, MPI_COMM_WORLD);
+    *npats = count;
+    if(0 == count){
+        free(*buffer);
+        free(patterns);
+        free(*lens);
+        return NULL;
+    }
+    return patterns;
+}
 
-            //fread adjusts the index of the file read, so overlap will throw off the
-            // next call to fread. Set the read index of the file back to the max
-            // of the previous text section
-            fseek(iFile, max, SEEK_SET);
+int main(int argc, char* argv[])
+{
+    int opt;
+    int kind = MATCHER_AUTO; //search algorithm, see matcher.h
+    char *patternFile = NULL; //file of patterns for the multi-pattern mode
+    int input = TEXT_IO_MMAP; //how the text is read, see text_io.h
+    long chunk = 0; //bytes read at once by -i stream and dynamic, 0 for their default
+    int report = RESULTS_GATHER; //how matches are collected, see search_results.h
+    char *regex = NULL; //regular expression searched for by -E
+    char *indexFile = NULL; //q-gram index of the text used by -I
+    int threads = 1; //OpenMP threads per process
+
+    while((opt = getopt(argc, argv, "a:i:c:r:P:E:I:t:")) != -1){
+        switch(opt){
+        case 'a':
+            kind = matcher_parse(optarg);
+            if(kind < 0){
+                printf("Unknown algorithm %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'i':
+            input = text_io_parse(optarg);
+            if(input < 0){
+                printf("Unknown input mode %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'c':
+            chunk = parseSize(optarg);
+            if(chunk < 0){
+                printf("Bad chunk size %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'r':
+            report = results_mode_parse(optarg);
+            if(report < 0){
+                printf("Unknown results mode %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'P':
+            patternFile = optarg;
+            break;
+        case 'E':
+            regex = optarg;
+            break;
+        case 'I':
+            indexFile = optarg;
+            break;
+        case 't':
+            threads = atoi(optarg);
+            if(threads < 1){
+                printf("Bad thread count %s. Exiting.\n", optarg);
+                exit(1);
+            }
+            break;
+        default:
+            exit(1);
         }
+    }
 
-        //find number of elements for process p-1, generate the array and fill
-        localElems = ceil(n / p);
-        locMax = n;
-        locMin = n - localElems;
-        localText = malloc(localElems * sizeof(localElems));
-        elements_read = fread(localText, 1, localElems, iFile);
-
-        if(elements_read != localElems)
-            MPI_Abort(MPI_COMM_WORLD, 1);
-
-        fclose(iFile);
+    if(argc - optind < (NULL == patternFile && NULL == regex ? 2 : 1)){
+        printf("Too few arguments. Exiting.");
+        exit(1);
     }
-    else {
-        //all process other than p-1 will wait to receive data from p-1
-        MPI_Recv(localText, localElems, MPI_CHAR, p-1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    if(NULL != regex && (NULL != patternFile || TEXT_IO_STREAM == input || TEXT_IO_DYNAMIC == input)){
+        printf("-E cannot be used with -P, -i stream or -i dynamic. Exiting.\n");
+        exit(1);
     }
 
-    //Search the text for the search key and store in the local index array
-    int *localIndexes = scanText(search, localText, locMin);
-    for(int j = 0; j<sizeof(localIndexes)/sizeof(localIndexes[0]); ++j)
-        printf("%i \n", localIndexes[j]);
-/*
-    THE COLLECTION CODE FAILED TO RUN
+    struct stat statbuff;
+    int id; //processor id
+    int p; //num processors
+    char *search = NULL;
+    char *textFile = argv[argc-1];
+    struct text_window local; //this process's section of the text
+    struct text_stream stream; //or the chunks of it, with -i stream
+    struct text_queue queue; //or the chunks taken by it, with -i dynamic
+    struct match_list localMatches; //matches found by this process
+    long searchLen; //longest pattern, used for overlap
+    struct matcher m;
+    struct ac_automaton ac; //automaton for the multi-pattern mode
+    struct regex_dfa dfa; //and for -E
+    struct qgram_index ix = {0}; //index of the text for -I
+    int indexed = 0; //nonzero if every process can use the index
+    char regexError[128];
+    char **patterns = NULL, *patternText = NULL;
+    long *patternLens = NULL;
+    int npats = 0;
+
+    if(stat(textFile, &statbuff) == -1) {
+        printf("Could not stat the file %s. Exiting\n", textFile);
+        exit(1);
+    }
 
-    //Collect the data from all other processes into p0
-    if (0 == id) {
+    long n = (long)statbuff.st_size; //holds the size of the file in bytes
+
+    if(NULL != patternFile){
+        //A match may run up to the longest pattern past a section
+        patterns = readPatterns(patternFile, &patternLens, &npats, &patternText);
+        if(NULL == patterns || ac_build(&ac, (const char *const *) patterns, patternLens, npats, 0) != 0){
+            printf("Could not read patterns from %s. Exiting\n", patternFile);
+            exit(1);
+        }
+        searchLen = ac.maxlen;
+    }
+    else if(NULL != regex){
+        if(regex_compile(&dfa, regex, regexError, sizeof(regexError)) != 0){
+            printf("Bad regular expression %s: %s. Exiting\n", regex, regexError);
+            exit(1);
+        }
+        searchLen = 1; //no overlap, see searchRegex()
+    }
+    else {
+        search = stringParse(argv[optind]); //remove any escape characters from the string
+        searchLen = strlen(search); //holds the length of the search string, used for overlap
 
-        if(p > 1){
-            //generate a holding array of size n (number of bytes in the file) because
-            //in the maximal case, each character in the file is a match to the search
-            int *buffer = malloc(n * sizeof(int));
-            int elem_count;
-            printf("here\n");
-            //Begin requesting each process to send its data
-            for(int k = 1; k < p; ++k){
-                min = floor( (k*n) / p );
-                max = floor( (((k+1)*n) / p) - 1 );
-                elem_count = max-min;
+        if(searchLen < 1 || searchLen > n){
+            printf("Search string is empty or larger than the text file. Exiting");
+            exit(1);
+        }
+        matcher_init(&m, search, searchLen, kind);
+    }
 
-                MPI_Send (&prompt, 1, MPI_INT, k, 1, MPI_COMM_WORLD);
+    //Initialize MPI
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &id);
+    MPI_Comm_size(MPI_COMM_WORLD, &p);
 
-                MPI_Recv (buffer, elem_count, MPI_INT, k, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    //Warn when the threads cannot run side by side
+    if(0 == id && threads > 1){
+#ifdef _OPENMP
+        if(omp_get_num_procs() < threads)
+            fprintf(stderr, "Warning: %d threads per process but only %d cpus bound to each process\n",
+                    threads, omp_get_num_procs());
+#else
+        fprintf(stderr, "Warning: built without OpenMP, threads of a process run one after another\n");
+#endif
+    }
 
-                printf("%ls \n", buffer);
-            }
-            free (buffer);
+    //Because the text is split and a match may occur at the end of one text section
+    // and continue into another text section, give each section
+    // access to the characters of the next section at a length
+    // matching the length of the search key (searchLen)
+    match_list_init(&localMatches, NULL != patternFile, report);
+    if((TEXT_IO_STREAM == input || RESULTS_STREAM == report) && match_list_spill(&localMatches) != 0){
+        printf("Could not make a file to spill matches to on process %d. Exiting\n", id);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if(NULL != indexFile && NULL == patternFile && NULL == regex &&
+       TEXT_IO_STREAM != input && TEXT_IO_DYNAMIC != input){
+        int usable = qgram_open(&ix, indexFile) == 0 && ix.header->text_size == n &&
+                     searchLen >= ix.header->q + ix.header->step - 1;
+
+        MPI_Allreduce(&usable, &indexed, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if(!indexed && 0 == id)
+            fprintf(stderr, "Index %s cannot serve this search; scanning the text\n", indexFile);
+    }
+    if(TEXT_IO_STREAM == input){
+        const char *text;
+        long len, first, limit;
+
+        if(text_stream_open(&stream, textFile, n, searchLen - 1, chunk, MPI_COMM_WORLD) != 0){
+            if(0 == id)
+                printf("Could not read %s. Exiting\n", textFile);
+            MPI_Finalize();
+            exit(1);
+        }
+        while((len = text_stream_next(&stream, &text, &first, &limit)) > 0)
+            searchSection(NULL == patternFile ? &m : NULL, &ac, text, len, limit, first, &localMatches,
+                          threads);
+        if(len < 0){
+            printf("Read of %s failed on process %d. Exiting\n", textFile, id);
+            MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        text_stream_close(&stream);
+    }
+    else if(TEXT_IO_DYNAMIC == input){
+        const char *text;
+        long len, first, limit;
+        double busy;
+
+        if(text_queue_open(&queue, textFile, n, searchLen - 1, chunk, MPI_COMM_WORLD) != 0){
+            if(0 == id)
+                printf("Could not read %s. Exiting\n", textFile);
+            MPI_Finalize();
+            exit(1);
+        }
+        busy = - MPI_Wtime();
+        while((len = text_queue_next(&queue, &text, &first, &limit)) > 0)
+            searchSection(NULL == patternFile ? &m : NULL, &ac, text, len, limit, first, &localMatches,
+                          threads);
+        if(len < 0){
+            printf("Read of %s failed on process %d. Exiting\n", textFile, id);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        busy += MPI_Wtime();
+        reportBalance(busy - queue.wait, queue.wait, queue.taken);
+        text_queue_close(&queue);
     }
     else {
-        MPI_Recv (&prompt, 1, MPI_INT, 0, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        if(text_window_read(&local, textFile, n, searchLen - 1, input, MPI_COMM_WORLD) != 0){
+            if(0 == id)
+                printf("Could not read %s with %s. Exiting\n", textFile, text_io_name(input));
+            MPI_Finalize();
+            exit(1);
+        }
+        if(NULL != regex)
+            searchRegex(&dfa, &local, &localMatches);
+        else if(indexed)
+            searchIndex(&ix, search, searchLen, &local, &localMatches);
+        else
+            searchSection(NULL == patternFile ? &m : NULL, &ac, local.text, local.len, local.owned,
+                          local.first, &localMatches, threads);
+        text_window_free(&local);
+    }
 
-        MPI_Send (localIndexes, localElems, MPI_INT, 0, 1, MPI_COMM_WORLD);
+    //Process 0 prints the matches of every process in order; chunks taken
+    // dynamically leave each process's matches interleaved with the others'
+    results_collect(&localMatches, report, TEXT_IO_DYNAMIC == input, "", MPI_COMM_WORLD);
+    match_list_free(&localMatches);
+    if(NULL != patternFile){
+        ac_free(&ac);
+        free(patterns);
+        free(patternLens);
+        free(patternText);
     }
-*/
+    if(NULL != regex)
+        regex_free(&dfa);
+    if(NULL != indexFile)
+        qgram_close(&ix);
     MPI_Finalize();
 }
@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sym_matrix.h"
+
+/******************************************************************************/
+/* Element j of a row of dtype elements, as a double */
+static double sym_row_element(const void *row, int dtype, int j)
+{
+    switch ( dtype ) {
+        case MATRIX_DTYPE_FLOAT32:  return ((const float*) row)[j];
+        case MATRIX_DTYPE_INT16:    return ((const int16_t*) row)[j];
+        default:                    return ((const double*) row)[j];
+    }
+}
+
+/******************************************************************************/
+void sym_matrix_from_rows(
+        struct sym_matrix *sm,         /* the view of the matrix              */
+        int                n,          /* rows and columns                    */
+        int                dtype,      /* MATRIX_DTYPE_* of the elements      */
+        size_t             ld,         /* row stride, in elements             */
+        const void        *storage,    /* element (0, 0)                      */
+        int               *errvalue)   /* return code for error, if any       */
+{
+    int i;
+
+    memset(sm, 0, sizeof(*sm));
+    if ( 0 == matrix_dtype_size(dtype) ) {
+        *errvalue = FILE_FORMAT_ERROR;
+        return;
+    }
+    sm->row_off = malloc((n > 0 ? n : 1) * sizeof(size_t));
+    if ( NULL == sm->row_off ) {
+        *errvalue = MALLOC_ERROR;
+        return;
+    }
+    for ( i = 0; i < n; i++ )
+        sm->row_off[i] = (size_t) i * ld;
+
+    sm->n      = n;
+    sm->dtype  = dtype;
+    sm->scale  = 1.0;
+    sm->offset = 0.0;
+    sm->data   = storage;
+    *errvalue  = SUCCESS;
+}
+
+/******************************************************************************/
+int is_sym_matrix_file(const char *path)
+{
+    uint32_t magic = 0;
+    FILE    *in = fopen(path, "rb");
+
+    if ( NULL == in )
+        return 0;
+    if ( fread(&magic, sizeof(magic), 1, in) != 1 )
+        magic = 0;
+    fclose(in);
+
+    return SYM_FILE_MAGIC == magic || __builtin_bswap32(SYM_FILE_MAGIC) == magic;
+}
+
+/******************************************************************************/
+void map_sym_matrix_file(
+        const char        *path,       /* packed file to map                  */
+        int                hints,      /* MAP_HINT_* options                  */
+        struct sym_matrix *sm,         /* the view of the matrix              */
+        int               *errvalue)   /* return code for error, if any       */
+{
+    struct sym_file_header hdr;
+    struct stat st;
+    size_t element_size;
+    int    fd;
+    int    i;
+    int    map_flags = MAP_SHARED;
+
+    memset(sm, 0, sizeof(*sm));
+
+    fd = open(path, O_RDONLY);
+    if ( fd < 0 ) {
+        *errvalue = FILE_OPEN_ERROR;
+        return;
+    }
+    if ( fstat(fd, &st) != 0 ) {
+        close(fd);
+        *errvalue = FILE_OPEN_ERROR;
+        return;
+    }
+
+    /* Step 1: Check the header and that the file holds the whole triangle */
+    if ( pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t) sizeof(hdr) ) {
+        close(fd);
+        *errvalue = FILE_FORMAT_ERROR;
+        return;
+    }
+    if ( __builtin_bswap32(SYM_FILE_MAGIC) == hdr.magic ) {
+        close(fd);
+        *errvalue = FILE_ENDIAN_ERROR;
+        return;
+    }
+    /* The data must start past the header and on an element boundary, as
+       in a row-major file. With n at most INT_MAX the triangle's element
+       count fits in 64 bits; dividing the space left by the element size
+       keeps a damaged n from overflowing the byte count. */
+    element_size = matrix_dtype_size(hdr.dtype);
+    if ( SYM_FILE_MAGIC != hdr.magic || SYM_FILE_VERSION != hdr.version ||
+         0 == element_size || hdr.n > INT_MAX ||
+         hdr.data_offset < sizeof(hdr) || hdr.data_offset > (uint64_t) st.st_size ||
+         hdr.data_offset % element_size != 0 ||
+         hdr.n * (hdr.n + 1) / 2 > ((uint64_t) st.st_size - hdr.data_offset) / element_size ) {
+        close(fd);
+        *errvalue = FILE_FORMAT_ERROR;
+        return;
+    }
+    if ( hdr.endian != matrix_host_endian() ) {
+        close(fd);
+        *errvalue = FILE_ENDIAN_ERROR;
+        return;
+    }
+
+    /* Step 2: Map the whole file */
+#ifdef MAP_POPULATE
+    if ( hints & MAP_HINT_POPULATE )
+        map_flags |= MAP_POPULATE;
+#endif
+    sm->map_len = st.st_size;
+    sm->map = mmap(NULL, sm->map_len, PROT_READ, map_flags, fd, 0);
+    close(fd);
+    if ( MAP_FAILED == sm->map ) {
+        sm->map = NULL;
+        *errvalue = MMAP_ERROR;
+        return;
+    }
+
+    if ( hints & MAP_HINT_SEQUENTIAL )
+        madvise(sm->map, sm->map_len, MADV_SEQUENTIAL);
+    if ( hints & MAP_HINT_RANDOM )
+        madvise(sm->map, sm->map_len, MADV_RANDOM);
+    if ( hints & MAP_HINT_WILLNEED )
+        madvise(sm->map, sm->map_len, MADV_WILLNEED);
+
+    /* Step 3: Row i of the triangle starts after the n + (n-1) + ... +
+       (n-i+1) elements of the rows before it, and its first element is in
+       column i, so row_off[i] is that count less i. */
+    sm->row_off = malloc((hdr.n > 0 ? hdr.n : 1) * sizeof(size_t));
+    if ( NULL == sm->row_off ) {
+        munmap(sm->map, sm->map_len);
+        sm->map = NULL;
+        *errvalue = MALLOC_ERROR;
+        return;
+    }
+    for ( i = 0; i < (int) hdr.n; i++ )
+        sm->row_off[i] = (size_t) i * hdr.n - (size_t) i * (i + 1) / 2;
+
+    sm->n      = hdr.n;
+    sm->dtype  = hdr.dtype;
+    sm->scale  = hdr.scale;
+    sm->offset = hdr.offset;
+    sm->data   = (char*) sm->map + hdr.data_offset;
+    *errvalue  = SUCCESS;
+}
+
+/******************************************************************************/
+void sym_matrix_free(struct sym_matrix *sm)
+{
+    if ( NULL != sm->map )
+        munmap(sm->map, sm->map_len);
+    free(sm->row_off);
+    memset(sm, 0, sizeof(*sm));
+}
+
+/******************************************************************************/
+void write_sym_matrix_file(
+        const char  *path,      /* file to create                             */
+        int          n,         /* rows and columns of M                      */
+        int          src_dtype, /* MATRIX_DTYPE_* of the elements of M        */
+        void       **matrix,    /* row pointer array                          */
+        int          dtype,     /* MATRIX_DTYPE_* to write                    */
+        int         *errvalue)  /* return code for error, if any              */
+{
+    struct sym_file_header hdr;
+    FILE   *out;
+    size_t  element_size = matrix_dtype_size(dtype);
+    char   *buf, *zeros;
+    double  v, lo, hi;
+    long    q;
+    int     i, j;
+    int     ok;
+
+    if ( 0 == element_size || 0 == matrix_dtype_size(src_dtype) ) {
+        *errvalue = FILE_FORMAT_ERROR;
+        return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic       = SYM_FILE_MAGIC;
+    hdr.version     = SYM_FILE_VERSION;
+    hdr.dtype       = dtype;
+    hdr.endian      = matrix_host_endian();
+    hdr.n           = n;
+    hdr.scale       = 1.0;
+    hdr.offset      = 0.0;
+    hdr.data_offset = MATRIX_FILE_ALIGN;
+
+    /* INT16 spans [-32767, 32767] evenly over [min, max] of the triangle */
+    if ( MATRIX_DTYPE_INT16 == dtype && n > 0 ) {
+        lo = hi = sym_row_element(matrix[0], src_dtype, 0);
+        for ( i = 0; i < n; i++ )
+            for ( j = i; j < n; j++ ) {
+                v = sym_row_element(matrix[i], src_dtype, j);
+                if ( v < lo )
+                    lo = v;
+                if ( v > hi )
+                    hi = v;
+            }
+        hdr.offset = (hi + lo) / 2;
+        hdr.scale  = hi > lo ? (hi - lo) / 65534 : 1.0;
+    }
+
+    buf   = malloc((n > 0 ? n : 1) * element_size);
+    zeros = calloc(MATRIX_FILE_ALIGN, 1);
+    out = fopen(path, "wb");
+    if ( NULL == out || NULL == buf || NULL == zeros ) {
+        if ( NULL != out )
+            fclose(out);
+        free(zeros);
+        free(buf);
+        *errvalue = NULL == out ? FILE_OPEN_ERROR : MALLOC_ERROR;
+        return;
+    }
+
+    ok = fwrite(&hdr, sizeof(hdr), 1, out) == 1 &&
+         fwrite(zeros, MATRIX_FILE_ALIGN - sizeof(hdr), 1, out) == 1;
+    for ( i = 0; ok && i < n; i++ ) {
+        for ( j = i; j < n; j++ ) {
+            v = sym_row_element(matrix[i], src_dtype, j);
+            switch ( dtype ) {
+                case MATRIX_DTYPE_FLOAT32:
+                    ((float*) buf)[j - i] = v;
+                    break;
+                case MATRIX_DTYPE_INT16:
+                    q = lround((v - hdr.offset) / hdr.scale);
+                    ((int16_t*) buf)[j - i] = q > 32767 ? 32767 : q < -32767 ? -32767 : q;
+                    break;
+                default:
+                    ((double*) buf)[j - i] = v;
+                    break;
+            }
+        }
+        ok = fwrite(buf, element_size, n - i, out) == (size_t) (n - i);
+    }
+
+    if ( fclose(out) != 0 )
+        ok = 0;
+    free(zeros);
+    free(buf);
+    *errvalue = ok ? SUCCESS : FILE_OPEN_ERROR;
+}
@@ -0,0 +1,129 @@
+#ifndef SYM_MATRIX_H
+#define SYM_MATRIX_H
+
+#include <stdint.h>
+#include "matrix_file.h"
+
+/* Symmetric matrix file, version 1: only the upper triangle, diagonal
+   included, packed row after row, so row i holds the n - i elements
+   (i, i) .. (i, n-1). That halves the size of a full matrix, and with
+   MATRIX_DTYPE_FLOAT32 or MATRIX_DTYPE_INT16 elements halves it again or
+   quarters it. INT16 elements are quantized: the value of element q is
+   offset + scale * q. The data starts at data_offset, a multiple of
+   MATRIX_FILE_ALIGN, and all fields are in the writer's byte order. */
+#define SYM_FILE_MAGIC      0x49525450u /* "PTRI" read as little endian */
+#define SYM_FILE_VERSION    1
+
+struct sym_file_header {
+    uint32_t magic;         /* SYM_FILE_MAGIC                               */
+    uint16_t version;       /* SYM_FILE_VERSION                             */
+    uint8_t  dtype;         /* MATRIX_DTYPE_*                               */
+    uint8_t  endian;        /* MATRIX_ENDIAN_* of the writer                */
+    uint64_t n;             /* rows and columns                             */
+    double   scale;         /* value of an INT16 element q is               */
+    double   offset;        /*   offset + scale * q; 1 and 0 otherwise      */
+    uint64_t data_offset;   /* byte offset of element (0, 0)                */
+    uint8_t  pad[24];       /* header is 64 bytes                           */
+};
+
+/* The upper triangle of a symmetric n by n matrix, read in place: element
+   (i, j), i <= j, is data[row_off[i] + j]. For a packed file row_off[i] is
+   i*n - i*(i+1)/2; for a full row-major matrix it is i*ld, so one lookup
+   serves both and the optimizers need not know which they were given. */
+struct sym_matrix {
+    int          n;
+    int          dtype;         /* MATRIX_DTYPE_*                           */
+    double       scale;         /* value = offset + scale * element         */
+    double       offset;
+    size_t      *row_off;       /* n entries                                */
+    const void  *data;
+    void        *map;           /* mapping of a packed file, or NULL        */
+    size_t       map_len;
+};
+
+/******************************************************************************/
+/** sym_matrix_get(&sm, i, j)
+ *  Returns element (i, j) of the matrix, which must have i <= j.
+ */
+static inline double sym_matrix_get(const struct sym_matrix *sm, int i, int j)
+{
+    size_t k = sm->row_off[i] + j;
+
+    switch ( sm->dtype ) {
+        case MATRIX_DTYPE_FLOAT32:
+            return ((const float*) sm->data)[k];
+        case MATRIX_DTYPE_INT16:
+            return sm->offset + sm->scale * ((const int16_t*) sm->data)[k];
+        default:
+            return ((const double*) sm->data)[k];
+    }
+}
+
+/******************************************************************************/
+/** sym_matrix_ptr(&sm, i, j)
+ *  Returns the address of element (i, j), i <= j, e.g. to prefetch it.
+ */
+static inline const void *sym_matrix_ptr(const struct sym_matrix *sm, int i, int j)
+{
+    return (const char*) sm->data + (sm->row_off[i] + j) * matrix_dtype_size(sm->dtype);
+}
+
+/******************************************************************************/
+/** sym_matrix_from_rows(&sm, n, dtype, ld, storage, &err)
+ *  Makes sm read the upper triangle of the full n by n matrix of dtype
+ *  elements at storage, whose rows are ld elements apart, in place: a
+ *  mapped matrix file, say, or one from alloc_matrix_aligned(). Release
+ *  with sym_matrix_free(), which leaves the storage alone.
+ */
+void sym_matrix_from_rows(
+        struct sym_matrix *sm,         /* the view of the matrix              */
+        int                n,          /* rows and columns                    */
+        int                dtype,      /* MATRIX_DTYPE_* of the elements      */
+        size_t             ld,         /* row stride, in elements             */
+        const void        *storage,    /* element (0, 0)                      */
+        int               *errvalue    /* return code for error, if any       */
+        );
+
+/******************************************************************************/
+/** is_sym_matrix_file(path)
+ *  Returns 1 if the file at path starts with SYM_FILE_MAGIC in either byte
+ *  order, else 0.
+ */
+int is_sym_matrix_file(const char *path);
+
+/******************************************************************************/
+/** map_sym_matrix_file(path, hints, &sm, &err)
+ *  Maps the packed file at path read-only and makes sm read it in place.
+ *  hints is an OR of MAP_HINT_* values, as for map_matrix_file(). Release
+ *  with sym_matrix_free().
+ */
+void map_sym_matrix_file(
+        const char        *path,       /* packed file to map                  */
+        int                hints,      /* MAP_HINT_* options                  */
+        struct sym_matrix *sm,         /* the view of the matrix              */
+        int               *errvalue    /* return code for error, if any       */
+        );
+
+/******************************************************************************/
+/** sym_matrix_free(&sm)
+ *  Releases the row offsets and any mapping of sm.
+ */
+void sym_matrix_free(struct sym_matrix *sm);
+
+/******************************************************************************/
+/** write_sym_matrix_file(path, n, src_dtype, M, dtype, &err)
+ *  Writes the upper triangle of the n by n matrix M of src_dtype elements
+ *  to path as a packed file of dtype elements. For MATRIX_DTYPE_INT16 the
+ *  values are quantized evenly between the least and greatest of them, so
+ *  each is off by at most (max - min) / 131068.
+ */
+void write_sym_matrix_file(
+        const char  *path,      /* file to create                             */
+        int          n,         /* rows and columns of M                      */
+        int          src_dtype, /* MATRIX_DTYPE_* of the elements of M        */
+        void       **matrix,    /* row pointer array                          */
+        int          dtype,     /* MATRIX_DTYPE_* to write                    */
+        int         *errvalue   /* return code for error, if any              */
+        );
+
+#endif
@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <mpi.h>
+#include "text_io.h"
+
+/* Largest read issued at once, below the int count of MPI-IO */
+#define TEXT_IO_MAX_READ  (1L << 30)
+
+static const char *text_io_names[] = {
+    "send", "mmap", "mpiio", "stream", "dynamic"
+};
+
+/* Windows of no bytes point here rather than at NULL */
+static const char empty_window[1];
+
+/******************************************************************************/
+const char *text_io_name(int mode)
+{
+    if (mode < TEXT_IO_SEND || mode > TEXT_IO_DYNAMIC)
+        return "unknown";
+    return text_io_names[mode];
+}
+
+int text_io_parse(const char *name)
+{
+    int mode;
+
+    for (mode = TEXT_IO_SEND; mode <= TEXT_IO_DYNAMIC; mode++)
+        if (strcmp(name, text_io_names[mode]) == 0)
+            return mode;
+    return -1;
+}
+
+/* The window of rank k of p: its first byte and its length, overlap included */
+static long window_of(long n, long overlap, int k, int p, long *first)
+{
+    long len;
+
+    *first = (k * n) / p;
+    len = ((k + 1) * n) / p - *first + overlap;
+    if (*first + len > n)
+        len = n - *first;
+    return len;
+}
+
+/******************************************************************************/
+/* The last rank reads each window in turn and sends it to its rank */
+static int read_send(struct text_window *w, const char *path, long n, long overlap,
+                     MPI_Comm comm)
+{
+    int id, p, k;
+    long min, elem_count;
+    char *buffer = malloc(w->len > 0 ? w->len : 1);
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+    w->base = buffer;
+    w->text = buffer;
+
+    if ((p - 1) == id) {
+        //The buffer for the other processes is at least as large as any of theirs
+        char *sendText = malloc(n / p + overlap + 1);
+        FILE *iFile = fopen(path, "r");
+
+        if (NULL == iFile)
+            MPI_Abort(comm, 1);
+
+        for (k = 0; k < p; k++) {
+            elem_count = window_of(n, overlap, k, p, &min);
+
+            //fread adjusts the index of the file read, so overlap would throw
+            // off the next call; seek to the start of each window
+            fseek(iFile, min, SEEK_SET);
+            if (fread(k == id ? buffer : sendText, 1, elem_count, iFile) != (size_t) elem_count)
+                MPI_Abort(comm, 1);
+            if (k != id)
+                MPI_Send(sendText, (int) elem_count, MPI_CHAR, k, 1, comm);
+        }
+        fclose(iFile);
+        free(sendText);
+    }
+    else
+        MPI_Recv(buffer, (int) w->len, MPI_CHAR, p - 1, 1, comm, MPI_STATUS_IGNORE);
+    return 0;
+}
+
+/******************************************************************************/
+/* Maps the pages that hold the window; the kernel reads them in as the scan
+   reaches them, and neighbouring ranks share the pages of the overlap */
+static int read_mmap(struct text_window *w, const char *path)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    long start = w->first / page * page;
+    void *map;
+    int fd;
+
+    if (w->len == 0)
+        return 0;
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    w->base_len = w->len + (w->first - start);
+    map = mmap(NULL, w->base_len, PROT_READ, MAP_PRIVATE, fd, start);
+    close(fd);
+    if (MAP_FAILED == map)
+        return -1;
+    madvise(map, w->base_len, MADV_SEQUENTIAL);
+    w->base = map;
+    w->text = (const char *) map + (w->first - start);
+    return 0;
+}
+
+/******************************************************************************/
+/* Each rank reads its window with collective calls, which lets MPI-IO merge
+   the requests of neighbouring ranks. Every rank makes the same number of
+   calls, those with less to read asking for 0 bytes at the end. */
+static int read_mpiio(struct text_window *w, const char *path, MPI_Comm comm)
+{
+    MPI_File fh;
+    MPI_Status status;
+    char *buffer = malloc(w->len > 0 ? w->len : 1);
+    long rounds = (w->len + TEXT_IO_MAX_READ - 1) / TEXT_IO_MAX_READ, max_rounds, done = 0;
+    long size;
+    int count, ok = 1;
+
+    w->base = buffer;
+    w->text = buffer;
+    MPI_Allreduce(&rounds, &max_rounds, 1, MPI_LONG, MPI_MAX, comm);
+    if (MPI_File_open(comm, (char *) path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS)
+        return -1;
+
+    for (; max_rounds > 0; max_rounds--) {
+        size = w->len - done < TEXT_IO_MAX_READ ? w->len - done : TEXT_IO_MAX_READ;
+        if (MPI_File_read_at_all(fh, (MPI_Offset) (w->first + done), buffer + done, (int) size,
+                                 MPI_CHAR, &status) != MPI_SUCCESS)
+            ok = 0;
+        else {
+            MPI_Get_count(&status, MPI_CHAR, &count);
+            if (count != size)
+                ok = 0;
+        }
+        done += size;
+    }
+    MPI_File_close(&fh);
+    return ok ? 0 : -1;
+}
+
+/******************************************************************************/
+int text_window_read(struct text_window *w, const char *path, long n, long overlap, int mode,
+                     MPI_Comm comm)
+{
+    int id, p, ret, err;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+    memset(w, 0, sizeof(*w));
+    w->mode  = mode;
+    w->len   = window_of(n, overlap, id, p, &w->first);
+    w->owned = ((id + 1) * n) / p - w->first;
+    w->text  = empty_window;
+
+    switch (mode) {
+    case TEXT_IO_SEND:
+        ret = read_send(w, path, n, overlap, comm);
+        break;
+    case TEXT_IO_MMAP:
+        ret = read_mmap(w, path);
+        break;
+    case TEXT_IO_MPIIO:
+        ret = read_mpiio(w, path, comm);
+        break;
+    default:
+        ret = -1;
+    }
+
+    MPI_Allreduce(&ret, &err, 1, MPI_INT, MPI_MIN, comm);
+    if (err < 0)
+        text_window_free(w);
+    return err;
+}
+
+/******************************************************************************/
+void text_window_free(struct text_window *w)
+{
+    if (TEXT_IO_MMAP == w->mode && NULL != w->base)
+        munmap(w->base, w->base_len);
+    else
+        free(w->base);
+    w->base = NULL;
+    w->text = empty_window;
+    w->len  = 0;
+}
+
+/******************************************************************************/
+/* Reads len bytes at offset off of fd, however many calls it takes */
+static int read_at(int fd, char *buffer, long len, long off)
+{
+    ssize_t got;
+
+    while (len > 0) {
+        got = pread(fd, buffer, len, off);
+        if (got <= 0)
+            return -1;
+        buffer += got;
+        off    += got;
+        len    -= got;
+    }
+    return 0;
+}
+
+/* The reader thread. Chunk k is read once chunk k-2, whose buffer it reuses,
+   is released; all of it for the first chunk, and the bytes after the
+   carried overlap for the others. */
+static void *stream_reader(void *arg)
+{
+    struct text_stream *s = arg;
+    long k, start, from, to;
+    int stop, ret;
+
+    for (k = 0; k < s->nchunks; k++) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->stop && k >= s->released + 2)
+            pthread_cond_wait(&s->cond, &s->lock);
+        stop = s->stop;
+        pthread_mutex_unlock(&s->lock);
+        if (stop)
+            break;
+
+        start = s->first + k * s->chunk;
+        to    = start + s->chunk + s->overlap < s->end ? start + s->chunk + s->overlap : s->end;
+        from  = k == 0 ? start : start + s->overlap;
+        if (from > to)
+            from = to;
+        ret = read_at(s->fd, s->buf[k % 2] + (from - start), to - from, from);
+
+        pthread_mutex_lock(&s->lock);
+        if (ret < 0)
+            s->error = 1;
+        s->read = k + 1;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        if (ret < 0)
+            break;
+    }
+    return NULL;
+}
+
+/******************************************************************************/
+int text_stream_open(struct text_stream *s, const char *path, long n, long overlap, long chunk,
+                     MPI_Comm comm)
+{
+    int id, p, ret = -1, err;
+    long size;
+
+    MPI_Comm_rank(comm, &id);
+    MPI_Comm_size(comm, &p);
+    memset(s, 0, sizeof(*s));
+    s->chunk   = chunk > 0 ? chunk : TEXT_STREAM_CHUNK;
+    s->overlap = overlap;
+    s->end     = window_of(n, overlap, id, p, &s->first);
+    s->end    += s->first;
+    s->owned   = ((id + 1) * n) / p - s->first;
+    s->nchunks = (s->owned + s->chunk - 1) / s->chunk;
+
+    //A part smaller than a chunk needs no more than its window
+    size = (s->owned < s->chunk ? s->owned : s->chunk) + overlap;
+    s->buf[0] = malloc(size > 0 ? size : 1);
+    s->buf[1] = malloc(size > 0 ? size : 1);
+    s->fd = open(path, O_RDONLY);
+    if (NULL != s->buf[0] && NULL != s->buf[1] && s->fd >= 0) {
+        posix_fadvise(s->fd, s->first, s->end - s->first, POSIX_FADV_SEQUENTIAL);
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->cond, NULL);
+        ret = pthread_create(&s->reader, NULL, stream_reader, s) == 0 ? 0 : -1;
+        if (ret < 0) {
+            pthread_cond_destroy(&s->cond);
+            pthread_mutex_destroy(&s->lock);
+        }
+    }
+    if (ret < 0) {
+        if (s->fd >= 0)
+            close(s->fd);
+        s->fd = -1;
+        free(s->buf[0]);
+        free(s->buf[1]);
+        s->buf[0] = s->buf[1] = NULL;
+    }
+
+    MPI_Allreduce(&ret, &err, 1, MPI_INT, MPI_MIN, comm);
+    if (err < 0 && ret == 0)
+        text_stream_close(s);
+    return err;
+}
+
+/******************************************************************************/
+long text_stream_next(struct text_stream *s, const char **text, long *first, long *limit)
+{
+    long k = s->next, start, carry;
+    int ready;
+
+    if (k >= s->nchunks)
+        return 0;
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->error && s->read <= k)
+        pthread_cond_wait(&s->cond, &s->lock);
+    ready = s->read > k;
+    pthread_mutex_unlock(&s->lock);
+    if (!ready)
+        return -1;
+
+    //Carry the overlap over from the previous chunk, then hand its buffer to
+    // the reader for chunk k+1
+    start = s->first + k * s->chunk;
+    if (k > 0) {
+        carry = s->end - start < s->overlap ? s->end - start : s->overlap;
+        memcpy(s->buf[k % 2], s->buf[(k - 1) % 2] + s->chunk, carry);
+    }
+    pthread_mutex_lock(&s->lock);
+    s->released = k;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    s->next++;
+    *text  = s->buf[k % 2];
+    *first = start;
+    *limit = s->first + s->owned - start < s->chunk ? s->first + s->owned - start : s->chunk;
+    return s->end - start < s->chunk + s->overlap ? s->end - start : s->chunk + s->overlap;
+}
+
+/******************************************************************************/
+void text_stream_close(struct text_stream *s)
+{
+    if (s->fd < 0)
+        return;
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->reader, NULL);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+
+    close(s->fd);
+    s->fd = -1;
+    free(s->buf[0]);
+    free(s->buf[1]);
+    s->buf[0] = s->buf[1] = NULL;
+}
+
+/******************************************************************************/
+int text_queue_open(struct text_queue *q, const char *path, long n, long overlap, long chunk,
+                    MPI_Comm comm)
+{
+    int id, ret = 0, err;
+
+    MPI_Comm_rank(comm, &id);
+    memset(q, 0, sizeof(*q));
+    q->n       = n;
+    q->overlap = overlap;
+    q->chunk   = chunk > 0 ? chunk : TEXT_QUEUE_CHUNK;
+    q->nchunks = (n + q->chunk - 1) / q->chunk;
+    q->buffer  = malloc(q->chunk + overlap);
+    q->fd      = open(path, O_RDONLY);
+    if (NULL == q->buffer || q->fd < 0)
+        ret = -1;
+    else
+        posix_fadvise(q->fd, 0, n, POSIX_FADV_SEQUENTIAL);
+
+    //The counter starts at 0; every rank keeps a shared lock on it throughout
+    MPI_Win_allocate(0 == id ? sizeof(long) : 0, sizeof(long), MPI_INFO_NULL, comm, &q->counter,
+                     &q->win);
+    if (0 == id)
+        *q->counter = 0;
+    MPI_Barrier(comm);
+    MPI_Win_lock_all(0, q->win);
+
+    MPI_Allreduce(&ret, &err, 1, MPI_INT, MPI_MIN, comm);
+    if (err < 0)
+        text_queue_close(q);
+    return err;
+}
+
+/******************************************************************************/
+long text_queue_next(struct text_queue *q, const char **text, long *first, long *limit)
+{
+    const long one = 1;
+    long k, len;
+
+    q->wait -= MPI_Wtime();
+    MPI_Fetch_and_op(&one, &k, MPI_LONG, 0, 0, MPI_SUM, q->win);
+    MPI_Win_flush(0, q->win);
+    q->wait += MPI_Wtime();
+    if (k >= q->nchunks)
+        return 0;
+
+    *first = k * q->chunk;
+    *limit = q->n - *first < q->chunk ? q->n - *first : q->chunk;
+    len = q->n - *first < q->chunk + q->overlap ? q->n - *first : q->chunk + q->overlap;
+    if (read_at(q->fd, q->buffer, len, *first) < 0)
+        return -1;
+    q->taken++;
+    *text = q->buffer;
+    return len;
+}
+
+/******************************************************************************/
+void text_queue_close(struct text_queue *q)
+{
+    MPI_Win_unlock_all(q->win);
+    MPI_Win_free(&q->win);
+    if (q->fd >= 0)
+        close(q->fd);
+    free(q->buffer);
+    q->fd = -1;
+    q->buffer = NULL;
+}
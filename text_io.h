@@ -0,0 +1,155 @@
+#ifndef TEXT_IO_H
+#define TEXT_IO_H
+
+#include <pthread.h>
+#include <mpi.h>
+
+/* How the ranks get their part of the text file */
+#define TEXT_IO_SEND   0   /* the last rank freads every part and sends it    */
+#define TEXT_IO_MMAP   1   /* each rank maps its own part of the file         */
+#define TEXT_IO_MPIIO  2   /* each rank reads its own part with MPI-IO        */
+#define TEXT_IO_STREAM 3   /* each rank reads its part in chunks, see below   */
+#define TEXT_IO_DYNAMIC 4  /* ranks take chunks of the file from a queue      */
+
+#define TEXT_STREAM_CHUNK  (16L << 20)  /* default chunk of a text_stream     */
+#define TEXT_QUEUE_CHUNK   (4L << 20)   /* default chunk of a text_queue      */
+
+/* The part of the text held by one rank. Rank id of p owns the bytes from
+   floor(id*n/p) up to floor((id+1)*n/p) - 1 of the n byte file, and holds
+   them followed by up to overlap bytes of the next part, so that a match
+   that starts in the part can be found without the other ranks. */
+struct text_window {
+    int          mode;      /* TEXT_IO_* used                               */
+    long         first;     /* offset in the file of text[0]                */
+    long         owned;     /* bytes of the rank's own part                 */
+    long         len;       /* bytes at text, overlap included              */
+    const char  *text;      /* the window, not terminated                   */
+    void        *base;      /* what text_window_free() releases             */
+    size_t       base_len;  /* length of a mapping                          */
+};
+
+/******************************************************************************/
+/** text_io_name(mode) / text_io_parse(name)
+ *  Convert between TEXT_IO_* values and the names send, mmap, mpiio,
+ *  stream and dynamic. text_io_parse() returns -1 for unknown names.
+ */
+const char *text_io_name(int mode);
+int text_io_parse(const char *name);
+
+/******************************************************************************/
+/** text_window_read(w, path, n, overlap, mode, comm)
+ *  Collective over comm. Gives each rank its window of the n byte file path
+ *  as described above. With TEXT_IO_MMAP and TEXT_IO_MPIIO every rank opens
+ *  the file itself and no text is sent between ranks, so the file must be
+ *  visible to all of them; TEXT_IO_SEND needs it only on the last rank, and
+ *  aborts if it cannot be read. TEXT_IO_STREAM and TEXT_IO_DYNAMIC are not
+ *  window modes; use text_stream_open() and text_queue_open(). Returns 0 on
+ *  every rank, or -1 on every rank if any of them failed.
+ */
+int text_window_read(struct text_window *w, const char *path, long n, long overlap, int mode,
+                     MPI_Comm comm);
+
+/******************************************************************************/
+/** text_window_free(w)
+ *  Unmaps or frees the window.
+ */
+void text_window_free(struct text_window *w);
+
+/* A rank's part of the text read in chunks, for files larger than the
+   memory of the ranks. Chunk k of the part holds the bytes from
+   first + k*chunk, that is chunk bytes of the part and the overlap bytes
+   after them, the first overlap of which were carried over from chunk k-1.
+   A reader thread fills one of two buffers with the next chunk while the
+   caller scans the other, so a rank holds 2 * (chunk + overlap) bytes of
+   text however large the file is. */
+struct text_stream {
+    int              fd;
+    long             first;     /* offset in the file of the part            */
+    long             owned;     /* bytes of the rank's own part              */
+    long             end;       /* offset of the end of the part's window    */
+    long             overlap;
+    long             chunk;
+    long             nchunks;
+    char            *buf[2];    /* chunk k is in buf[k % 2]                  */
+    long             next;      /* chunk text_stream_next() returns next     */
+    long             read;      /* chunks read by the reader thread          */
+    long             released;  /* chunks the caller is done with            */
+    int              error;     /* set by the reader if a read failed        */
+    int              stop;      /* set to make the reader exit early         */
+    pthread_t        reader;
+    pthread_mutex_t  lock;
+    pthread_cond_t   cond;
+};
+
+/******************************************************************************/
+/** text_stream_open(s, path, n, overlap, chunk, comm)
+ *  Collective over comm. Opens this rank's part of the n byte file path,
+ *  with the same parts and overlap as text_window_read(), to be read in
+ *  chunks of chunk bytes (0 for TEXT_STREAM_CHUNK), and starts reading the
+ *  first one. Returns 0 on every rank, or -1 on every rank if any of them
+ *  failed.
+ */
+int text_stream_open(struct text_stream *s, const char *path, long n, long overlap, long chunk,
+                     MPI_Comm comm);
+
+/******************************************************************************/
+/** text_stream_next(s, &text, &first, &limit)
+ *  Waits for the next chunk and points text at it. Sets first to the offset
+ *  in the file of text[0] and limit to the number of bytes of the rank's part
+ *  in the chunk; a match is reported once if it is reported only when it
+ *  starts before limit. The previous chunk may no longer be used. Returns
+ *  the number of bytes at text, 0 after the last chunk, or -1 if a read
+ *  failed.
+ */
+long text_stream_next(struct text_stream *s, const char **text, long *first, long *limit);
+
+/******************************************************************************/
+/** text_stream_close(s)
+ *  Stops the reader and releases the buffers. It may be called before the
+ *  last chunk.
+ */
+void text_stream_close(struct text_stream *s);
+
+/* The whole file cut in chunks that the ranks take in turn, for ranks that
+   work at different speeds. The number of the next chunk to be taken is
+   kept in an RMA window on rank 0 and taken with MPI_Fetch_and_op, so no
+   rank has to hand out the work and a rank that scans faster takes more
+   chunks. Each chunk is read with the overlap bytes after it. */
+struct text_queue {
+    int      fd;
+    long     n;         /* bytes in the file                               */
+    long     overlap;
+    long     chunk;
+    long     nchunks;
+    char    *buffer;    /* the chunk last taken                            */
+    MPI_Win  win;       /* holds the counter on rank 0                     */
+    long    *counter;
+    long     taken;     /* chunks this rank took                           */
+    double   wait;      /* seconds this rank spent taking them             */
+};
+
+/******************************************************************************/
+/** text_queue_open(q, path, n, overlap, chunk, comm)
+ *  Collective over comm. Opens the n byte file path to be taken in chunks
+ *  of chunk bytes (0 for TEXT_QUEUE_CHUNK) with overlap bytes after each.
+ *  Returns 0 on every rank, or -1 on every rank if any of them failed.
+ */
+int text_queue_open(struct text_queue *q, const char *path, long n, long overlap, long chunk,
+                    MPI_Comm comm);
+
+/******************************************************************************/
+/** text_queue_next(q, &text, &first, &limit)
+ *  Takes the next chunk no rank has taken and reads it, as
+ *  text_stream_next() does; chunks come in increasing order of offset on
+ *  each rank, but interleave between ranks. Returns the number of bytes at
+ *  text, 0 once all chunks are taken, or -1 if the read failed.
+ */
+long text_queue_next(struct text_queue *q, const char **text, long *first, long *limit);
+
+/******************************************************************************/
+/** text_queue_close(q)
+ *  Collective over the comm of text_queue_open(). Releases the queue.
+ */
+void text_queue_close(struct text_queue *q);
+
+#endif